@@ -1,6 +1,8 @@
 #pragma once
 
 #include <string>
+#include <vector>
+#include <deque>
 #include "lexicon.hpp"
 #include "forward_index.hpp"
 #include "inverted_index.hpp"
@@ -8,6 +10,23 @@
 class MetadataParser 
 {
 private:
+    //folder with metadata.csv and the full text subsets
+    std::string data_path = "D:/searchEngine/data/2020-04-10";
+
+    //csv lines handed to a worker at once
+    static const size_t BATCH_LINES = 16;
+
+    //one csv line after the parse/tokenize stage: its words with their counts,
+    //in order of first occurrence (the order the lexicon sees them)
+    struct ParsedDocument {
+        bool valid = false;
+        std::string cord_uid;
+        std::deque<std::pair<std::string, size_t>> terms;
+    };
+
+    //read the full text and tokenize one csv line, touches no shared state
+    ParsedDocument parse_document(const std::string& line) const;
+
     //There can be multiple sha for one document, we use only 1 for identification
     std::string extract_first_sha(const std::string& sha) const;
 
@@ -19,9 +38,13 @@ private:
     std::string extract_text_from_json(const std::string& file_path) const;
 public:
 
+    void set_data_path(const std::string& path) { data_path = path; }
+
         //parse a CSV line into fields (handles quoted commas)
-    void parse_line(const std::string&, std::vector<std::string>&);
+    void parse_line(const std::string&, std::vector<std::string>&) const;
     
-    // Main parsing function: populates Lexicon, ForwardIndex, and InvertedIndex
-    int metadata_parse(Lexicon& lex, ForwardIndex& fwd, InvertedIndex& inv, size_t max_docs);
+    // Main parsing function: populates Lexicon, ForwardIndex, and InvertedIndex.
+    // Documents are read and tokenized on `threads` workers (0 = all cores, 1 = serial) and
+    // merged in file order, so word ids and doc ids do not depend on the thread count
+    size_t metadata_parse(Lexicon& lex, ForwardIndex& fwd, InvertedIndex& inv, size_t max_docs, size_t threads = 0);
 };   
\ No newline at end of file
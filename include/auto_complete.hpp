@@ -1,13 +1,97 @@
 #pragma once
 #include <string>
 #include <vector>
+#include <cstdint>
 #include "lexicon.hpp"
 
+//Completion trie built once from the lexicon.
+//Words are kept sorted, so every trie node covers a contiguous range of them.
+//The trie is path compressed (one node per branching point) and every node
+//with more than cached_k words stores its cached_k most frequent words, so a
+//suggestion only walks the prefix and copies at most k words.
 class AutoComplete {
 public:
-    //suggest top-k words starting with prefix
+    //build the trie from all words of the lexicon, caching the top cached_k words per node
+    void build(const Lexicon& lex, std::size_t cached_k = 10);
+
+    bool empty() const { return nodes.empty(); }
+
+    std::size_t memory_bytes() const;
+
+    //suggest top-k words starting with prefix (most frequent first, ties in word order).
+    //If no word starts with it, words starting within a few typos of it are suggested instead.
+    //Without build() this scans the prefix range of the lexicon (no typo tolerance)
     std::vector<std::string> suggest( const std::string& raw_prefix,
         const Lexicon& lex,
         std::size_t top_k = 10
     ) const;
-};
\ No newline at end of file
+
+    //top-k words whose beginning is within max_distance edits of the prefix
+    //(closest first, then most frequent). Walks the trie with one edit distance row per
+    //character, so only paths still within max_distance are visited. Needs build()
+    std::vector<std::string> suggest_fuzzy( const std::string& raw_prefix,
+        std::size_t top_k,
+        std::size_t max_distance
+    ) const;
+
+private:
+    struct Node {
+        uint32_t label_offset;  // label bytes in the arena (taken from the first word of the range)
+        uint32_t label_length;
+        uint32_t first_child;   // children are consecutive nodes, sorted by their first label byte
+        uint32_t child_count;
+        uint32_t lo, hi;        // words [lo, hi) start with the path to this node
+        uint32_t top_begin;     // cached top words in top_words, top_count == 0 if hi - lo <= cached_k
+        uint32_t top_count;
+    };
+
+    std::size_t cached_k = 0;
+
+    //words sorted, bytes in one arena
+    std::string arena;
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> freqs;
+
+    std::vector<Node> nodes;
+    //first label byte of every node, apart from the nodes so the children of a node
+    //(consecutive nodes) share a cache line while they are searched
+    std::string first_bytes;
+    std::vector<uint32_t> top_words;
+
+    std::string_view word(uint32_t i) const {
+        return std::string_view(arena.data() + offsets[i], offsets[i + 1] - offsets[i]);
+    }
+
+    //more frequent first, then word order
+    bool ranks_before(uint32_t a, uint32_t b) const {
+        return freqs[a] != freqs[b] ? freqs[a] > freqs[b] : a < b;
+    }
+
+    //fill nodes[node] for the words [lo, hi) that share their first depth bytes
+    void build_node(uint32_t node, uint32_t lo, uint32_t hi, std::size_t depth);
+
+    //node the normalized prefix ends in (possibly inside its label), or -1
+    long find_node(const std::string& prefix) const;
+
+    //the k best words under a node, cached list or ranked from its range
+    void top_of_node(const Node& node, std::size_t k, std::vector<uint32_t>& out) const;
+
+    struct FuzzyState {
+        const std::string& prefix;
+        std::size_t max_distance;
+        std::vector<std::size_t> rows;  // edit distance row of prefix against every path length
+        std::string path;               // characters of the current path
+        std::vector<std::pair<uint32_t, std::size_t>> hits;  // (node, distance of its whole subtree)
+    };
+
+    //append c to the path of depth characters: computes the row of the longer path, returns its minimum
+    std::size_t fuzzy_step(FuzzyState& state, std::size_t depth, char c) const;
+
+    //extend the rows by the label of node n from byte from on (the path so far has depth characters,
+    //best is the smallest distance seen on this node so far) and record the node if some point of its
+    //label is closer to the prefix than covered (the best ancestor match), then go on with the children
+    void fuzzy_walk(uint32_t n, uint32_t from, std::size_t depth, std::size_t covered, std::size_t best,
+                    FuzzyState& state) const;
+
+    static std::string normalize_prefix(const std::string& raw_prefix);
+};
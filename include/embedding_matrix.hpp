@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <string>
+#include <vector>
+#include "mapped_file.hpp"
+
+// Allocator returning 64-byte aligned memory (one cache line / one AVX-512 register)
+template <typename T>
+struct AlignedAllocator {
+    using value_type = T;
+    static constexpr std::size_t ALIGNMENT = 64;
+
+    AlignedAllocator() = default;
+    template <typename U>
+    AlignedAllocator(const AlignedAllocator<U>&) {}
+
+    T* allocate(std::size_t n) {
+        return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(ALIGNMENT)));
+    }
+    void deallocate(T* p, std::size_t) {
+        ::operator delete(p, std::align_val_t(ALIGNMENT));
+    }
+
+    template <typename U>
+    bool operator==(const AlignedAllocator<U>&) const { return true; }
+    template <typename U>
+    bool operator!=(const AlignedAllocator<U>&) const { return false; }
+};
+
+// Dense row-major float matrix with one embedding per row and a parallel doc_id array.
+// Rows are padded with zeros to a multiple of 16 floats, so every row starts on a
+// 64-byte boundary and all rows are scanned as one contiguous block.
+class EmbeddingMatrix {
+public:
+    EmbeddingMatrix() = default;
+    explicit EmbeddingMatrix(std::size_t dim) { reset(dim); }
+
+    // drop all rows and set the embedding dimension
+    void reset(std::size_t dim);
+
+    void reserve(std::size_t rows);
+
+    // append a row (dim floats), returns its row index
+    std::size_t add_row(std::size_t doc_id, const float* values);
+
+    // grow or shrink to rows rows; new rows are zero with doc_id 0, to be filled
+    // in place through row(r) and set_doc_id (different rows from different threads is fine)
+    void resize(std::size_t rows);
+    void set_doc_id(std::size_t r, std::size_t doc_id) { doc_ids[r] = doc_id; }
+
+    std::size_t rows() const { return doc_ids.size(); }
+    std::size_t dim() const { return dimension; }
+    std::size_t stride() const { return row_stride; }
+    bool empty() const { return doc_ids.empty(); }
+
+    const float* row(std::size_t r) const { return data.data() + r * row_stride; }
+    float* row(std::size_t r) { return data.data() + r * row_stride; }
+    const float* raw() const { return data.data(); }
+
+    std::size_t doc_id(std::size_t r) const { return doc_ids[r]; }
+    const std::vector<std::size_t>& ids() const { return doc_ids; }
+
+    std::size_t memory_bytes() const {
+        return data.capacity() * sizeof(float) + doc_ids.capacity() * sizeof(std::size_t);
+    }
+
+private:
+    std::size_t dimension = 0;
+    std::size_t row_stride = 0;
+    std::vector<float, AlignedAllocator<float>> data;
+    std::vector<std::size_t> doc_ids;
+};
+
+// Read-only view of a document embedding file as written by SemanticSearch::save_document_embeddings
+// (size_t count, size_t dim, then per document a size_t doc_id followed by dim floats).
+// The file is mapped, so single rows can be read without loading the whole file into memory.
+class EmbeddingFile {
+public:
+    bool open(const std::string& path);
+    void close();
+
+    bool is_open() const { return file.is_open(); }
+    std::size_t rows() const { return count; }
+    std::size_t dim() const { return dimension; }
+
+    std::size_t doc_id(std::size_t r) const;
+
+    // dim floats of row r (4-byte aligned only)
+    const float* row(std::size_t r) const {
+        return reinterpret_cast<const float*>(file.data() + HEADER_BYTES + r * record_bytes + sizeof(std::size_t));
+    }
+
+private:
+    static constexpr std::size_t HEADER_BYTES = 2 * sizeof(std::size_t);
+
+    MappedFile file;
+    std::size_t count = 0;
+    std::size_t dimension = 0;
+    std::size_t record_bytes = 0;
+};
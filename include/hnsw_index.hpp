@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+#include "embedding_matrix.hpp"
+
+// HNSW construction parameters
+struct HnswParams {
+    std::size_t M = 16;                 // links per node on the upper layers (2*M on layer 0)
+    std::size_t ef_construction = 200;  // candidate list size while inserting
+    std::uint32_t seed = 42;            // level sampling, fixed so builds are reproducible
+};
+
+// Hierarchical Navigable Small World graph over the rows of an EmbeddingMatrix.
+// Rows are expected to be normalized, so the dot product is the similarity.
+// The graph only stores row numbers; the vectors themselves stay in the matrix,
+// which has to be passed to every call and must be the one the graph was built on.
+class HnswIndex {
+public:
+    //header of a graph file, followed by one level byte per node, the layer 0 links
+    //(node_count * (2M + 1) uint32: count, then neighbours) and the upper layer links
+    //of every node with level > 0 (level * (M + 1) uint32 each).
+    //Integers are stored in native byte order.
+    struct FileHeader {
+        char magic[4];
+        std::uint32_t version;
+        std::uint64_t node_count;
+        std::uint32_t dim;
+        std::uint32_t M;
+        std::int32_t max_level;
+        std::uint32_t entry_point;
+        std::uint64_t ids_hash;     // fingerprint of the matrix doc_ids the graph belongs to
+    };
+
+    void build(const EmbeddingMatrix& matrix, const HnswParams& params = HnswParams());
+
+    // up to k (similarity, row) pairs, best first.
+    // ef is the size of the candidate list on layer 0 (raised to k if smaller):
+    // larger ef means better recall and slower queries
+    std::vector<std::pair<float, std::uint32_t>> search(const EmbeddingMatrix& matrix, const float* query,
+                                                        std::size_t k, std::size_t ef) const;
+
+    bool save(const std::string& path, const EmbeddingMatrix& matrix) const;
+
+    // fails if the file was built for a different matrix
+    bool load(const std::string& path, const EmbeddingMatrix& matrix);
+
+    void clear();
+
+    bool empty() const { return node_count == 0; }
+    std::size_t size() const { return node_count; }
+    std::size_t max_connections() const { return M; }
+    std::size_t memory_bytes() const;
+
+private:
+    static constexpr std::uint32_t FILE_VERSION = 1;
+    static constexpr int MAX_LEVEL = 16;
+
+    struct Candidate {
+        float dist;
+        std::uint32_t node;
+    };
+
+    std::size_t M = 0;
+    std::size_t M0 = 0;
+    std::size_t node_count = 0;
+    int max_level = -1;
+    std::uint32_t entry_point = 0;
+
+    std::vector<std::uint8_t> levels;
+    //layer 0: node * (M0 + 1) slots, neighbour count first
+    std::vector<std::uint32_t> links0;
+    //layers 1..level of each node: (level - 1) * (M + 1) slots per layer, empty for level 0 nodes
+    std::vector<std::vector<std::uint32_t>> upper_links;
+
+    std::uint32_t* links(std::uint32_t node, int level);
+    const std::uint32_t* links(std::uint32_t node, int level) const;
+
+    // walk down from the entry point to target_level, one closest node per layer
+    std::uint32_t greedy_descent(const EmbeddingMatrix& matrix, const float* query, int target_level) const;
+
+    // best-first search on one layer, returns at most ef candidates in no particular order
+    std::vector<Candidate> search_layer(const EmbeddingMatrix& matrix, const float* query,
+                                        std::uint32_t entry, std::size_t ef, int level) const;
+
+    // keep at most max_links candidates (sorted by distance) that are not closer to an already kept one than to the base
+    static void select_neighbours(const EmbeddingMatrix& matrix, std::vector<Candidate>& candidates,
+                                  std::size_t max_links);
+
+    void insert(const EmbeddingMatrix& matrix, std::uint32_t node, std::size_t ef_construction);
+
+    static std::uint64_t hash_ids(const EmbeddingMatrix& matrix);
+};
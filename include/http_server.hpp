@@ -0,0 +1,64 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct HttpRequest {
+    std::string method;
+    std::string path;                                         // without the query string
+    std::vector<std::pair<std::string, std::string>> params;  // decoded query string
+
+    // value of the first query parameter called name, "" if there is none
+    const std::string& param(const std::string& name) const;
+    bool has_param(const std::string& name) const;
+};
+
+struct HttpResponse {
+    int status = 200;
+    std::string body;
+    std::string content_type = "application/json";
+};
+
+// Minimal HTTP/1.1 server for the JSON api: GET requests only, keep-alive and
+// pipelining, no request bodies. One thread runs an epoll loop over every
+// connection; the handlers run on a fixed pool of worker threads. Requests on one
+// connection are handled one at a time, so pipelined responses go out in order.
+// epoll only exists on Linux, elsewhere listen() reports an error.
+class HttpServer {
+public:
+    // called from several workers at once
+    using Handler = std::function<HttpResponse(const HttpRequest&)>;
+
+    HttpServer() = default;
+    ~HttpServer();
+
+    HttpServer(const HttpServer&) = delete;
+    HttpServer& operator=(const HttpServer&) = delete;
+
+    // TCP "host:port" or "port" (host defaults to 127.0.0.1). Returns false if it cannot be bound
+    bool listen(const std::string& address);
+
+    // serve until stop(); threads = 0 means one worker per core
+    void run(const Handler& handler, std::size_t threads = 0);
+
+    // let run() return, closing every connection (callable from any thread)
+    void stop();
+
+    const std::string& address() const { return bound_address; }
+
+    // "a+b%2Fc" -> "a b/c"
+    static std::string url_decode(const std::string& text);
+
+private:
+    int listener = -1;
+    int wakeup = -1;  // eventfd: workers finished a request, or stop() was called
+    std::string bound_address;
+    std::atomic<bool> stopping{false};
+
+    void close_sockets();
+};
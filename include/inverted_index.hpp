@@ -2,21 +2,119 @@
 #include <iostream>
 #include <unordered_map>
 #include "forward_index.hpp"
+#include "mapped_file.hpp"
+#include "posting_list.hpp"
 #include <string>
+#include <cstdint>
+#include <future>
+#include <list>
+#include <memory>
+#include <mutex>
 #include<unordered_set>
 
+//counters of the lazy barrel cache
+struct BarrelCacheStats {
+    size_t hits = 0;
+    size_t misses = 0;
+    size_t evictions = 0;
+    size_t resident_barrels = 0;
+    size_t resident_bytes = 0;
+};
+
 class InvertedIndex {
 
+public:
+//one directory entry of a barrel: where the compressed posting list of word_id starts in the postings blob
+struct DirEntry {
+    uint32_t word_id;
+    uint32_t count;
+    uint64_t offset;
+};
+
+//header of a binary barrel file (_barrelN.bin), followed by
+//word_count DirEntry records sorted by word_id and then postings_bytes of compressed posting lists.
+//Integers are stored in native byte order.
+struct BarrelHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t word_count;
+    uint64_t postings_bytes;
+};
+
 private:
 //each barrel has 30k words
 static const size_t BARREL_SIZE = 30000;
 
-//(barrel_id -> (word_id -> vector of (doc_ids))
-std::unordered_map<size_t, std::unordered_map<size_t, std::vector<size_t>>> barrels;
+static const uint32_t BARREL_VERSION = 4;
+
+//a barrel is a sorted word_id directory + one contiguous postings blob.
+//The arrays either live in owned vectors (built / parsed from csv) or in a mapped .bin file
+struct Barrel {
+    std::vector<DirEntry> owned_dir;
+    std::vector<uint8_t> owned_postings;
+    MappedFile file;
+
+    const DirEntry* dir = nullptr;
+    size_t word_count = 0;
+    const uint8_t* postings = nullptr;
+    size_t postings_bytes = 0;
+
+    size_t memory_bytes() const { return word_count * sizeof(DirEntry) + postings_bytes; }
+};
 
+//(barrel_id -> barrel). Posting lists handed out keep their barrel alive,
+//so an evicted barrel is only freed once no query uses it anymore.
+//In lazy mode this is the cache and is guarded by cache_mutex.
+mutable std::unordered_map<size_t, std::shared_ptr<Barrel>> barrels;
 
+//barrels that exist on disk (lazy mode)
 std::unordered_set<size_t> barrel_ids;
 
+//lazy mode: barrels are faulted in by fetch_doc_ids
+bool lazy = false;
+std::string lazy_base_path;
+size_t memory_budget = 0;
+
+//least recently used barrel at the back
+mutable std::list<size_t> lru;
+mutable std::unordered_map<size_t, std::list<size_t>::iterator> lru_pos;
+mutable BarrelCacheStats stats;
+mutable std::mutex cache_mutex;
+
+//barrels being read by one query right now (without cache_mutex held), other queries
+//missing the same barrel wait on its future instead of reading it again
+mutable std::unordered_map<size_t, std::shared_future<std::shared_ptr<Barrel>>> loading;
+
+std::shared_ptr<Barrel> acquire_barrel(size_t barrel_id) const;
+
+void cache_barrel(size_t barrel_id, const std::shared_ptr<Barrel>& barrel) const;
+
+std::vector<std::pair<size_t, std::shared_ptr<Barrel>>> loaded_barrels() const;
+
+void reset_barrels();
+
+//read one barrel, .bin (mapped) if present, otherwise .csv
+static std::shared_ptr<Barrel> read_barrel(size_t barrel_id, const std::string& basePath,
+                                           const std::vector<uint32_t>& doc_lengths);
+
+//number of indexed tokens per doc_id (basePath_doclens.bin), for BM25 length normalization
+std::vector<uint32_t> doc_lengths;
+double avg_doc_length = 0.0;
+
+bool save_doc_lengths(const std::string& basePath) const;
+
+bool load_doc_lengths(const std::string& basePath);
+
+//turn (word_id -> postings) lists into the flat layout of a barrel
+//(doc lengths are needed for the ranking bounds stored with every block)
+static void build_barrel(Barrel& barrel, std::vector<std::pair<size_t, std::vector<Posting>>>& lists,
+                         const std::vector<uint32_t>& doc_lengths);
+
+static bool map_barrel(Barrel& barrel, const std::string& file_name);
+
+static bool parse_csv_barrel(Barrel& barrel, const std::string& file_name,
+                             const std::vector<uint32_t>& doc_lengths);
+
 public:
 
 size_t get_barrel_id(size_t word_id) const {
@@ -25,18 +123,38 @@ size_t get_barrel_id(size_t word_id) const {
 
 void add_from_forward(const ForwardIndex&);
 
-bool load_from_file(std::string basePath); 
+bool load_from_file(std::string basePath);
 
 bool load_barrel(size_t barrel_id, const std::string& basePath);
 
-const std::vector<size_t>* fetch_doc_ids(size_t word_id) const;
+//lazy mode: only discover the barrel files, load each barrel on first access and
+//evict least recently used barrels once they take more than memory_budget bytes (0 = no limit)
+bool open_lazy(const std::string& basePath, size_t memory_budget = 0);
+
+BarrelCacheStats cache_stats() const;
+
+PostingList fetch_doc_ids(size_t word_id) const;
 
 void save_to_file(std::string path);
 
-size_t size();
+//binary barrels (basePath_barrelN.bin), mapped into memory without parsing
+bool save_binary(const std::string& basePath) const;
+
+bool map_from_file(const std::string& basePath);
+
+//rewrite existing csv barrels as binary barrels
+static bool convert_csv_to_binary(const std::string& basePath);
+
+//number of words with a posting list (resident barrels only in lazy mode)
+size_t size() const;
+
+//document statistics for ranking; without a doclens file every document counts as average length
+size_t total_documents() const { return doc_lengths.size(); }
+
+double average_doc_length() const { return avg_doc_length; }
 
-const std::unordered_map<size_t, std::unordered_map<size_t, std::vector<size_t>>> &get_inv_index() const {
-    return barrels;
+double doc_length(size_t doc_id) const {
+    return doc_id < doc_lengths.size() ? doc_lengths[doc_id] : avg_doc_length;
 }
 
-};
\ No newline at end of file
+};
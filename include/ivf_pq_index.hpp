@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+#include "embedding_matrix.hpp"
+
+// IVF-PQ training parameters
+struct IvfPqParams {
+    std::size_t nlist = 0;          // coarse clusters (0 = 4 * sqrt(rows))
+    std::size_t m = 50;             // sub-quantizers = code bytes per document, must divide the dimension
+    std::size_t iterations = 20;    // k-means iterations for the coarse and the sub-quantizers
+    std::size_t max_train = 100000; // rows sampled for training
+    std::uint32_t seed = 42;
+};
+
+// Inverted file + product quantization over normalized document embeddings.
+// Every document is assigned to its nearest coarse centroid and the residual
+// (embedding - centroid) is split into m sub-vectors, each stored as one byte:
+// the index of the nearest of 256 sub-centroids. A 300-d embedding shrinks
+// from 1200 bytes to m code bytes + row/doc_id.
+//
+// Queries only scan the nprobe closest lists. Similarities are approximated with
+// one lookup table per query: q.x ~ q.centroid + sum_j table[j][code_j], where
+// table[j][c] = q_j . sub_centroid_j[c].
+class IvfPqIndex {
+public:
+    //header of an index file, followed by the coarse centroids (nlist * dim floats),
+    //the sub-quantizer codebooks (m * 256 * dim/m floats), the doc_id of every row (rows uint32)
+    //and every list as uint64 count, count row numbers (uint32) and count * m code bytes.
+    //Integers are stored in native byte order.
+    struct FileHeader {
+        char magic[4];
+        std::uint32_t version;
+        std::uint64_t rows;
+        std::uint32_t dim;
+        std::uint32_t nlist;
+        std::uint32_t m;
+        std::uint32_t ksub;
+    };
+
+    // train the quantizers on (a sample of) the matrix and encode every row
+    bool train(const EmbeddingMatrix& matrix, const IvfPqParams& params = IvfPqParams());
+
+    // up to k (approximate similarity, row) pairs, best first.
+    // Rows are the row numbers of the matrix the index was trained on
+    std::vector<std::pair<float, std::uint32_t>> search(const float* query, std::size_t k,
+                                                        std::size_t nprobe) const;
+
+    bool save(const std::string& path) const;
+
+    bool load(const std::string& path);
+
+    void clear();
+
+    bool empty() const { return doc_ids.empty(); }
+    std::size_t size() const { return doc_ids.size(); }
+    std::size_t dim() const { return dimension; }
+    std::size_t list_count() const { return nlist; }
+    std::size_t code_size() const { return m; }
+    std::size_t doc_id(std::uint32_t row) const { return doc_ids[row]; }
+
+    std::size_t memory_bytes() const;
+
+private:
+    static constexpr std::uint32_t FILE_VERSION = 1;
+    static constexpr std::size_t KSUB = 256;
+    static constexpr std::size_t PQ_TRAIN_POINTS = 64 * KSUB;
+
+    std::size_t dimension = 0;
+    std::size_t nlist = 0;
+    std::size_t m = 0;
+    std::size_t dsub = 0;
+
+    //coarse centroids, one padded row each
+    EmbeddingMatrix centroids;
+    //squared norms of the centroids, for L2 list selection with dot products
+    std::vector<float> centroid_norms;
+    //m codebooks of KSUB sub-centroids with dsub floats each
+    std::vector<float> codebooks;
+
+    std::vector<std::uint32_t> doc_ids;
+
+    struct InvertedList {
+        std::vector<std::uint32_t> rows;
+        std::vector<std::uint8_t> codes;
+    };
+    std::vector<InvertedList> lists;
+
+    // nearest coarse centroid of every vector (rows of stride floats)
+    void assign(const float* vectors, std::size_t stride, std::size_t count, std::vector<std::uint32_t>& out) const;
+
+    void encode(const float* residual, std::uint8_t* code) const;
+
+    void update_centroid_norms();
+};
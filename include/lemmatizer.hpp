@@ -1,8 +1,12 @@
 #pragma once
-#include <unordered_map>
 #include <string>
+#include <string_view>
 
-extern std::unordered_map<std::string, std::string> lemma_dict;
-
+//Loads "word lemma" pairs; can be called several times, later files override earlier entries
 void load_lemmatizer(const std::string& filename);
+
 std::string lemmatize(const std::string& word);
+
+//Lemma of word without copying: a view of the interned lemma, or word itself if it has none.
+//Lemma views stay valid until the next load_lemmatizer
+std::string_view lemmatize_view(std::string_view word);
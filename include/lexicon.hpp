@@ -1,34 +1,136 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <unordered_map>
+#include <vector>
+#include <cstdint>
+#include "mapped_file.hpp"
 
 class Lexicon {
+public:
+    //header of a binary lexicon file (lexicon.bin), followed by
+    //offsets (word_count + 1 uint32), ids (word_count uint32), frequencies (word_count uint32),
+    //the hash slots (slot_count uint32) and arena_bytes of word bytes.
+    //Integers are stored in native byte order.
+    struct FileHeader {
+        char magic[4];
+        uint32_t version;
+        uint64_t word_count;
+        uint64_t slot_count;
+        uint64_t arena_bytes;
+        uint64_t next_id;
+    };
+
 private:
-    //Mapping word -> wordID + frequency(in all docs)
+    static constexpr uint32_t FILE_VERSION = 1;
+
+    //Build mode (add): mapping word -> wordID + frequency(in all docs)
     std::unordered_map<std::string, std::pair<size_t,size_t>> data;
     size_t next_id = 0;
 
+    //Frozen mode (freeze / load / map_from_file): read-only and compact.
+    //Words sorted, all their bytes in one arena; entry i is arena[offsets[i], offsets[i+1])
+    //with ids[i] and freqs[i]. slots is an open addressing table of entry index + 1 (0 = empty)
+    //so lookups are one hash and usually one comparison.
+    //The arrays either live in the owned members or in a mapped lexicon.bin
+    bool frozen = false;
+    std::string owned_arena;
+    std::vector<uint32_t> owned_offsets;
+    std::vector<uint32_t> owned_ids;
+    std::vector<uint32_t> owned_freqs;
+    std::vector<uint32_t> owned_slots;
+    MappedFile file;
+
+    const char* arena = nullptr;
+    const uint32_t* offsets = nullptr;
+    const uint32_t* ids = nullptr;
+    const uint32_t* freqs = nullptr;
+    const uint32_t* slots = nullptr;
+    size_t word_count = 0;
+    size_t slot_count = 0;
+
+    static uint64_t hash_word(std::string_view word);
+
+    //entry index of word in the frozen arrays, or npos
+    static constexpr size_t npos = static_cast<size_t>(-1);
+    size_t find_entry(std::string_view word) const;
+
+    std::string_view entry_word(size_t i) const {
+        return std::string_view(arena + offsets[i], offsets[i + 1] - offsets[i]);
+    }
+
+    //back to build mode so words can be added again
+    void thaw();
+
+    void release_frozen();
+
 public:
     size_t add(const std::string& word, size_t count = 1);
 
-    bool present_in(const std::string& word) const;
+    bool present_in(std::string_view word) const;
+
+    //static_cast<size_t>(-1) if the word is not in the lexicon
+    size_t getID(std::string_view word) const;
+
+    size_t getFrequency(std::string_view word) const;
 
-    size_t getID(const std::string& word) const;
+    size_t size() const { return frozen ? word_count : data.size(); }
 
-    size_t getFrequency(const std::string& word) const;
+    //switch to the compact read-only layout (load does this already); add() still works afterwards
+    void freeze();
 
-    size_t size() const { return data.size(); }
+    bool is_frozen() const { return frozen; }
 
+    //heap bytes (a mapped lexicon.bin lives in the page cache and is not counted)
+    size_t memory_bytes() const;
+
+    //csv: word,id,frequency per line, most frequent first
     void save(const std::string& path) const;
 
     bool load(const std::string& path);
 
+    //binary lexicon, mapped into memory without parsing or rehashing
+    bool save_binary(const std::string& path) const;
+
+    bool map_from_file(const std::string& path);
+
+    //rewrite a csv lexicon as a binary lexicon
+    static bool convert_csv_to_binary(const std::string& csv_path, const std::string& bin_path);
+
     void show_statistics() const;
 
     void clear_lex();
 
-    const std::unordered_map<std::string, std::pair<size_t,size_t>>& get_data() const {
-         return data; 
+    //calls f(word, word_id, frequency) for every word (sorted by word once frozen)
+    template <typename F>
+    void for_each_word(F&& f) const {
+        if (frozen) {
+            for (size_t i = 0; i < word_count; ++i) f(entry_word(i), size_t(ids[i]), size_t(freqs[i]));
+        } else {
+            for (const auto& entry : data) f(std::string_view(entry.first), entry.second.first, entry.second.second);
+        }
+    }
+
+    //calls f(word, word_id, frequency) for every word starting with prefix
+    //(a binary searched range of the sorted words once frozen)
+    template <typename F>
+    void for_each_prefix(std::string_view prefix, F&& f) const {
+        if (!frozen) {
+            for_each_word([&](std::string_view word, size_t id, size_t freq) {
+                if (word.substr(0, prefix.size()) == prefix) f(word, id, freq);
+            });
+            return;
+        }
+        size_t lo = 0, hi = word_count;
+        while (lo < hi) {
+            size_t mid = (lo + hi) / 2;
+            if (entry_word(mid) < prefix) lo = mid + 1; else hi = mid;
+        }
+        for (size_t i = lo; i < word_count; ++i) {
+            std::string_view word = entry_word(i);
+            if (word.substr(0, prefix.size()) != prefix) break;
+            f(word, size_t(ids[i]), size_t(freqs[i]));
+        }
     }
-};
\ No newline at end of file
+};
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iosfwd>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Line protocol server: a client sends one command per line and gets one
+// response line per command. Every connection has a reader thread; the commands
+// themselves run on a fixed pool of worker threads, so at most that many queries
+// use the CPU at once however many clients are connected.
+// Plain lines are answered in order, one at a time. A line starting with '#'
+// (a request id, "#42 SEARCH ...") does not wait: the reader moves on to the next
+// line and the response is written whenever it is ready, so tagged responses can
+// come back in any order and the handler has to repeat the id in them. A connection
+// has at most 4 tagged commands per worker thread in flight, then reading pauses.
+// A command whose handler throws is answered with {"error":"Internal error"} (and its
+// "id" when tagged) and the connection goes on.
+// "EXIT" closes the connection that sent it, after the tagged commands in flight.
+// At most max_connections clients are served at once, further ones wait in the listen backlog.
+class LineServer {
+public:
+    // command line (no '\n') -> response line (no '\n'), called from several workers at once
+    using Handler = std::function<std::string(const std::string&)>;
+
+    LineServer() = default;
+    ~LineServer();
+
+    LineServer(const LineServer&) = delete;
+    LineServer& operator=(const LineServer&) = delete;
+
+    // "unix:/path" for a Unix domain socket, otherwise a TCP "host:port" or "port"
+    // (host defaults to 127.0.0.1). Returns false if the address cannot be bound
+    bool listen(const std::string& address);
+
+    // accept and serve connections until stop(); threads = 0 means one worker per core
+    void run(const Handler& handler, std::size_t threads = 0);
+
+    // stop accepting, disconnect every client and let run() return (callable from any thread)
+    void stop();
+
+    // clients served at the same time (one reader thread each), set before run()
+    void set_max_connections(std::size_t n) { max_connections = n ? n : 1; }
+
+    const std::string& address() const { return bound_address; }
+
+    // the same protocol on a stream pair (stdin / stdout) until EXIT or the end of input
+    static void serve_stream(std::istream& in, std::ostream& out, const Handler& handler, std::size_t threads = 0);
+
+private:
+    // socket handles are ints on POSIX and SOCKET (an unsigned integer) on Windows
+    using Socket = std::intptr_t;
+
+    Socket listener = -1;
+    std::string bound_address;
+    std::string unix_path;
+    std::atomic<bool> stopping{false};
+
+    std::size_t max_connections = 256;
+
+    // open client sockets; reader threads by id, the ids of the ones that finished
+    // (joined by run(), which owns the threads)
+    std::mutex clients_mutex;
+    std::condition_variable clients_done;
+    std::unordered_set<Socket> clients;
+    std::unordered_map<std::size_t, std::thread> readers;
+    std::vector<std::size_t> finished_readers;
+    std::size_t next_reader = 0;
+
+    void join_finished_readers();
+
+    void close_listener();
+};
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <string>
+#include <cstddef>
+
+// Read-only memory mapping of a whole file.
+// Pages are shared through the OS page cache, so several processes mapping
+// the same index file only keep one physical copy in memory.
+class MappedFile {
+private:
+    const char* ptr = nullptr;
+    std::size_t length = 0;
+
+#ifdef _WIN32
+    void* file_handle = nullptr;
+    void* mapping_handle = nullptr;
+#else
+    int fd = -1;
+#endif
+
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+
+    // Map the file read-only, returns false if it cannot be opened or is empty
+    bool open(const std::string& path);
+
+    void close();
+
+    bool is_open() const { return ptr != nullptr; }
+
+    const char* data() const { return ptr; }
+
+    std::size_t size() const { return length; }
+
+    // Move a fully written tmp_path over path. Files that are mapped are never rewritten
+    // in place: a process mapping the old file keeps reading its pages until it reopens.
+    // On failure tmp_path is removed and path is left as it was
+    static bool replace(const std::string& tmp_path, const std::string& path);
+};
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+//one entry of a posting list: document and how often the word occurs in it
+struct Posting {
+    uint32_t doc;
+    uint32_t freq;
+};
+
+//ranking bounds of a list or block: largest term frequency and shortest document in it.
+//A BM25 term score grows with tf and shrinks with length, so (max_tf, min_len) gives an upper bound
+struct PostingBounds {
+    uint32_t max_tf;
+    uint32_t min_len;
+};
+
+//skip header of one block: last doc_id in the block, where its payload ends and its bounds
+struct PostingBlockHeader {
+    uint32_t last_doc;
+    uint32_t end;
+    PostingBounds bounds;
+};
+
+//Compressed posting list (sorted doc_ids with term frequencies).
+//Postings are cut into blocks of BLOCK_SIZE, every block is delta + variable-byte
+//encoded and gets a skip header, so a cursor can jump over whole blocks.
+//
+//Layout of one list: [PostingBounds][block_count x PostingBlockHeader][block payloads]
+//Block payload: [doc_id gaps][term frequencies], both variable-byte.
+//The first gap of a block is taken from the last doc_id of the previous block.
+class PostingList {
+public:
+    static constexpr size_t BLOCK_SIZE = 128;
+
+    PostingList() = default;
+    //owner keeps the memory behind data alive (e.g. a barrel that may be evicted)
+    PostingList(const uint8_t* data, size_t count, std::shared_ptr<const void> owner = nullptr)
+        : data(data), count(count), owner(std::move(owner)) {}
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    size_t block_count() const { return (count + BLOCK_SIZE - 1) / BLOCK_SIZE; }
+
+    PostingBlockHeader block_header(size_t block) const;
+
+    //bounds over the whole list
+    PostingBounds bounds() const;
+
+    //decode the whole list (used by csv export and tools, not by queries)
+    std::vector<Posting> decode() const;
+
+    //check a list of count postings read from a file: its skip headers and every block end
+    //lie within the available bytes at data and each block has room for its postings
+    //(at least one gap and one frequency byte each). The payload itself is not decoded
+    static bool fits(const uint8_t* data, size_t count, size_t available);
+
+    //append the encoding of postings sorted by unique doc_id to out.
+    //doc_lengths (indexed by doc_id, may be empty) feed the min_len bounds
+    static void encode(const std::vector<Posting>& postings, const std::vector<uint32_t>& doc_lengths,
+                       std::vector<uint8_t>& out);
+
+private:
+    const uint8_t* data = nullptr;
+    size_t count = 0;
+    std::shared_ptr<const void> owner;
+
+    friend class PostingCursor;
+};
+
+//Forward iterator over a PostingList, decodes one block at a time
+class PostingCursor {
+public:
+    explicit PostingCursor(const PostingList& list);
+
+    bool at_end() const { return block >= block_total; }
+
+    uint32_t doc() const { return buffer[pos]; }
+
+    uint32_t freq() const { return freqs[pos]; }
+
+    void next();
+
+    //move to the first doc_id >= target, skipping blocks with the skip headers
+    void next_geq(uint32_t target);
+
+    //header of the block holding the first doc_id >= target, read from the skip
+    //headers only (nothing is decoded and the cursor does not move).
+    //Past the end of the list a header with last_doc UINT32_MAX and zero bounds is returned
+    PostingBlockHeader block_for(uint32_t target) const;
+
+private:
+    PostingList list;
+    const uint8_t* payload = nullptr;
+    size_t block_total = 0;
+    size_t block = 0;
+    size_t pos = 0;
+    size_t block_len = 0;
+    uint32_t buffer[PostingList::BLOCK_SIZE];
+    uint32_t freqs[PostingList::BLOCK_SIZE];
+
+    void load_block(size_t b);
+};
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "embedding_matrix.hpp"
+
+// Storage precision of an embedding table
+enum class VectorPrecision {
+    Float32,  // 4 bytes per value (EmbeddingMatrix, no QuantizedMatrix)
+    Float16,  // IEEE half float, 2 bytes per value
+    Int8      // int8 with one float scale per row, 1 byte per value
+};
+
+// "f32", "f16", "i8"
+const char* precision_name(VectorPrecision precision);
+
+// accepts the names above, false for anything else
+bool parse_precision(const std::string& name, VectorPrecision& precision);
+
+// Embedding rows in reduced precision, one id (doc_id or word_id) per row.
+// Float16 rows are rounded to the nearest half; Int8 rows store round(x / scale)
+// with scale = max |x| / 127 of the row. Rows are zero padded to 64 bytes like
+// EmbeddingMatrix rows. Int8 queries are quantized the same way and scored with
+// integer dot products, so both sides lose about 1 / 254 of their largest value.
+class QuantizedMatrix {
+public:
+    // drop all rows, Float32 is not a valid precision here
+    void reset(std::size_t dim, VectorPrecision precision);
+
+    void reserve(std::size_t rows);
+
+    // append a row (dim floats), returns its row index
+    std::size_t add_row(std::size_t id, const float* values);
+
+    // all rows of matrix, with its doc_ids
+    void assign(const EmbeddingMatrix& matrix, VectorPrecision precision);
+
+    // out[i] ~ dot(query, row first + i) for i in [0, count)
+    void score_rows(const float* query, std::size_t first, std::size_t count, float* out) const;
+
+    // acc[0, dim) += w * row r
+    void add_row_to(std::size_t r, float* acc, float w) const;
+
+    // dim floats of row r
+    void decode_row(std::size_t r, float* out) const;
+
+    std::size_t rows() const { return row_ids.size(); }
+    std::size_t dim() const { return dimension; }
+    VectorPrecision precision() const { return mode; }
+    bool empty() const { return row_ids.empty(); }
+
+    std::size_t id(std::size_t r) const { return row_ids[r]; }
+    const std::vector<std::size_t>& ids() const { return row_ids; }
+
+    std::size_t memory_bytes() const {
+        return data.capacity() + scales.capacity() * sizeof(float) + row_ids.capacity() * sizeof(std::size_t);
+    }
+
+    void clear();
+
+private:
+    std::size_t dimension = 0;
+    std::size_t row_bytes = 0;
+    VectorPrecision mode = VectorPrecision::Float16;
+    std::vector<std::uint8_t, AlignedAllocator<std::uint8_t>> data;
+    std::vector<float> scales;  // Int8 only
+    std::vector<std::size_t> row_ids;
+
+    const std::uint16_t* half_row(std::size_t r) const {
+        return reinterpret_cast<const std::uint16_t*>(data.data() + r * row_bytes);
+    }
+    const std::int8_t* int8_row(std::size_t r) const {
+        return reinterpret_cast<const std::int8_t*>(data.data() + r * row_bytes);
+    }
+};
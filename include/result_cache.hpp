@@ -0,0 +1,169 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "lexicon.hpp"
+
+// Counters of a ResultCache, summed over its shards
+struct CacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;    // dropped to make room (least recently used first)
+    uint64_t expirations = 0;  // found older than the time to live
+    std::size_t entries = 0;
+    std::size_t capacity = 0;
+
+    double hit_rate() const {
+        uint64_t lookups = hits + misses;
+        return lookups ? static_cast<double>(hits) / static_cast<double>(lookups) : 0.0;
+    }
+};
+
+// Thread-safe query result cache with LRU eviction and an optional time to live.
+// Keys are spread over shards with their own lock and LRU list, so concurrent
+// queries rarely wait on each other. Values are shared immutable snapshots:
+// a hit only copies a pointer under the lock. Capacity 0 disables the cache.
+template <typename Value>
+class ResultCache {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit ResultCache(std::size_t capacity = 0, std::chrono::seconds ttl = std::chrono::seconds(0),
+                         std::size_t shard_count = 16)
+        : shards(shard_count ? shard_count : 1) {
+        configure(capacity, ttl);
+    }
+
+    ResultCache(const ResultCache&) = delete;
+    ResultCache& operator=(const ResultCache&) = delete;
+
+    // drops every entry and the counters; ttl 0 = entries never expire
+    void configure(std::size_t capacity, std::chrono::seconds ttl = std::chrono::seconds(0)) {
+        // a small cache uses fewer shards, each shard holds at least one entry
+        active_shards = std::max<std::size_t>(1, std::min(capacity, shards.size()));
+        for (std::size_t i = 0; i < shards.size(); ++i) {
+            Shard& shard = shards[i];
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            shard.lru.clear();
+            shard.index.clear();
+            shard.stats = CacheStats();
+            // the shards share capacity exactly, the first ones take the remainder
+            shard.capacity = i < active_shards ? capacity / active_shards + (i < capacity % active_shards) : 0;
+        }
+        time_to_live = ttl;
+        total_capacity = capacity;
+    }
+
+    bool enabled() const { return total_capacity > 0; }
+
+    // nullptr on a miss (or when disabled)
+    std::shared_ptr<const Value> get(const std::string& key) {
+        if (!enabled()) return nullptr;
+        Shard& shard = shard_for(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+
+        auto it = shard.index.find(key);
+        if (it == shard.index.end()) {
+            ++shard.stats.misses;
+            return nullptr;
+        }
+        if (time_to_live.count() > 0 && Clock::now() >= it->second->expires) {
+            shard.lru.erase(it->second);
+            shard.index.erase(it);
+            ++shard.stats.expirations;
+            ++shard.stats.misses;
+            return nullptr;
+        }
+        // most recently used goes to the front
+        shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+        ++shard.stats.hits;
+        return it->second->value;
+    }
+
+    void put(const std::string& key, Value value) {
+        if (!enabled()) return;
+        auto shared = std::make_shared<const Value>(std::move(value));
+        Clock::time_point expires = Clock::now() + time_to_live;
+
+        Shard& shard = shard_for(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.index.find(key);
+        if (it != shard.index.end()) {
+            it->second->value = std::move(shared);
+            it->second->expires = expires;
+            shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+            return;
+        }
+
+        while (shard.lru.size() >= shard.capacity && !shard.lru.empty()) {
+            shard.index.erase(shard.lru.back().key);
+            shard.lru.pop_back();
+            ++shard.stats.evictions;
+        }
+        shard.lru.push_front({key, std::move(shared), expires});
+        shard.index.emplace(key, shard.lru.begin());
+    }
+
+    // invalidate everything (the indexes behind the cached results changed), counters are kept
+    void clear() {
+        for (auto& shard : shards) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            shard.lru.clear();
+            shard.index.clear();
+        }
+    }
+
+    CacheStats stats() const {
+        CacheStats total;
+        for (auto& shard : shards) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            total.hits += shard.stats.hits;
+            total.misses += shard.stats.misses;
+            total.evictions += shard.stats.evictions;
+            total.expirations += shard.stats.expirations;
+            total.entries += shard.lru.size();
+        }
+        total.capacity = total_capacity;
+        return total;
+    }
+
+private:
+    struct Entry {
+        std::string key;
+        std::shared_ptr<const Value> value;
+        Clock::time_point expires;
+    };
+
+    struct Shard {
+        mutable std::mutex mutex;
+        std::list<Entry> lru;  // front = most recently used
+        std::unordered_map<std::string, typename std::list<Entry>::iterator> index;
+        std::size_t capacity = 0;
+        CacheStats stats;
+    };
+
+    std::vector<Shard> shards;
+    std::chrono::seconds time_to_live{0};
+    std::size_t total_capacity = 0;
+    std::size_t active_shards = 1;
+
+    Shard& shard_for(const std::string& key) {
+        return shards[std::hash<std::string>()(key) % active_shards];
+    }
+};
+
+// Cache key of a query: its tokens after tokenize_text normalization (lowercase,
+// stopwords dropped, lemmatized), as lexicon ids where known, sorted so that word
+// order does not matter, plus the search mode and top_k.
+// "Spread of VIRUSES!" and "viruses spread" give the same key.
+std::string query_cache_key(std::string_view raw_query, const Lexicon& lex, char mode, std::size_t top_k);
@@ -6,6 +6,9 @@
 #include "lexicon.hpp"
 #include "forward_index.hpp"
 #include "inverted_index.hpp"
+#include "top_k.hpp"
+#include "spell_corrector.hpp"
+#include "result_cache.hpp"
 
 //result of a query
 struct SearchResult {
@@ -26,13 +29,21 @@ struct DocMeta {
 
 
 
+// BM25 parameters: k1 saturates term frequency, b sets how much document length matters
+struct BM25Params {
+    double k1 = 1.2;
+    double b = 0.75;
+};
+
+
 class SearchEngine {
 public:
     //load cord_uid -> url mapping from metadata.csv
     bool load_metadata_urls(const std::string& metadata_csv_path);
 
 
-    // AND logic with OR fallback, ranked by term frequency
+    // AND logic with OR fallback, ranked by BM25.
+    // The OR fallback runs Block-Max WAND, so most postings are skipped unscored
     std::vector<SearchResult> search(
         const std::string& raw_query,
         const Lexicon& lex,
@@ -41,32 +52,78 @@ public:
         std::size_t top_k = 20
     ) const;
 
+    // BM25 top_k (score, doc_id) of the OR query over word_ids, by Block-Max WAND:
+    // the ranking search() falls back to when no document has every term
+    std::vector<std::pair<double, std::size_t>> or_top_k(
+        const std::vector<std::size_t>& word_ids,
+        const ForwardIndex& fwd,
+        const InvertedIndex& inv,
+        std::size_t top_k = 20
+    ) const;
+
+    void set_bm25_params(const BM25Params& params) { bm25 = params; results_cache.clear(); }
+
+    // Query terms missing from the lexicon are replaced by their closest correction (nullptr = off)
+    void set_spell_corrector(const SpellCorrector* corrector) { speller = corrector; results_cache.clear(); }
+
+    // Cache of query results keyed on the normalized query (capacity 0 = off, the default).
+    // The indexes are passed to search(), so whoever reloads them has to call clear_result_cache()
+    void set_result_cache(std::size_t capacity, std::chrono::seconds ttl = std::chrono::seconds(0)) {
+        results_cache.configure(capacity, ttl);
+    }
+    void clear_result_cache() { results_cache.clear(); }
+    CacheStats result_cache_stats() const { return results_cache.stats(); }
+
 private:
+    BM25Params bm25;
+    const SpellCorrector* speller = nullptr;
+
+    // search() is const but fills the cache (it locks internally)
+    mutable ResultCache<std::vector<SearchResult>> results_cache;
+
     // cord_uid -> (title, url) (resolved at query time)
     std::unordered_map<std::string, DocMeta> corduid_to_meta;
 
-    // Posting list set operations (inputs are sorted)
-    static std::vector<std::size_t> intersect_sorted(
-        const std::vector<std::size_t>& a,
-        const std::vector<std::size_t>& b
+    // Non-empty posting lists of word_ids and the idf of each
+    static void fetch_postings(
+        const std::vector<std::size_t>& word_ids,
+        const ForwardIndex& fwd,
+        const InvertedIndex& inv,
+        std::vector<PostingList>& postings,
+        std::vector<double>& idf
     );
 
-    static std::vector<std::size_t> union_sorted(
-        const std::vector<std::size_t>& a,
-        const std::vector<std::size_t>& b
+    // Posting list set operations, decoding the compressed lists on the fly
+    static std::vector<std::size_t> intersect_sorted(
+        std::vector<PostingList> lists
     );
 
-    // Term frequency lookup inside a document
-    static std::size_t term_freq_doc(
+    // Top-k OR query with Block-Max WAND: a document is only scored when the
+    // score bounds of its terms (whole list, then current block) can beat the k-th best
+    void wand_top_k(
+        const std::vector<PostingList>& lists,
+        const std::vector<double>& idf,
+        const InvertedIndex& inv,
         const ForwardIndex& fwd,
-        std::size_t doc_id,
-        std::size_t word_id
-    );
+        TopK<std::size_t>& best
+    ) const;
 
-    // Simple ranking: sum of TFs of query terms
-    static double score_by_tf_sum(
-        const ForwardIndex& fwd,
+    // Inverse document frequency of a term found in df of total_docs documents
+    static double bm25_idf(std::size_t df, std::size_t total_docs);
+
+    // BM25 contribution of one term (tf occurrences in a document of the given length)
+    double bm25_term(double idf, double tf, double length, double avg_length) const;
+
+    // Upper bound of bm25_term over postings with these bounds
+    double bm25_bound(double idf, const PostingBounds& bounds, double avg_length) const;
+
+    // BM25 score of one document. Term frequencies come from the postings
+    // (cursors advance monotonically, so candidates must be scored in doc_id order)
+    // and lengths from the inverted index, the forward index is never touched.
+    double score_bm25(
         std::size_t doc_id,
-        const std::vector<std::size_t>& query_word_ids
-    );
+        std::vector<PostingCursor>& cursors,
+        const std::vector<double>& idf,
+        const InvertedIndex& inv
+    ) const;
 };
\ No newline at end of file
@@ -1,11 +1,20 @@
 #pragma once
 
+#include <functional>
+#include <memory>
 #include <string>
 #include <vector>
 #include <unordered_map>
 #include "lexicon.hpp"
 #include "forward_index.hpp"
 #include "inverted_index.hpp"
+#include "embedding_matrix.hpp"
+#include "hnsw_index.hpp"
+#include "ivf_pq_index.hpp"
+#include "result_cache.hpp"
+#include "thread_pool.hpp"
+#include "quantized_matrix.hpp"
+#include "word_embeddings.hpp"
 
 // Result of a semantic search query
 struct SemanticResult {
@@ -24,14 +33,23 @@ public:
     // Load GloVe embeddings from file (glove.6B.300d.txt)
     bool load_glove_embeddings(const std::string& glove_file_path);
 
-    // Save word embeddings to binary file (fast loading later)
+    // Save word embeddings to binary file, in the mapped WordEmbeddings layout
     bool save_embeddings_binary(const std::string& binary_file_path) const;
 
-    // Load word embeddings from binary file (much faster!)
+    // Load word embeddings from binary file: a WordEmbeddings file is mapped read-only
+    // (shared by every process using it), a file of the old word-by-word format is read into memory
     bool load_embeddings_binary(const std::string& binary_file_path);
 
-    // Build document embeddings from ForwardIndex and Lexicon
-    void build_document_embeddings(const ForwardIndex& fwd, const Lexicon& lex);
+    // Build document embeddings from ForwardIndex and Lexicon, on threads
+    // worker threads (0 = one per core); the result does not depend on the thread count
+    void build_document_embeddings(const ForwardIndex& fwd, const Lexicon& lex, std::size_t threads = 0);
+
+    // Keep only the vectors of lexicon words, looked up by word_id from now on (queries too,
+    // so query words outside the lexicon no longer count). Mapped word embeddings stay mapped
+    // and only the rows of lexicon words are touched; loaded ones are copied and the rest freed.
+    // Float16 / Int8 always copy the kept vectors in that precision and free the word table.
+    // Has to be redone when the lexicon or the word embeddings change
+    bool prune_embeddings(const Lexicon& lex, VectorPrecision precision = VectorPrecision::Float32);
 
     // Save document embeddings to binary file
     bool save_document_embeddings(const std::string& binary_file_path) const;
@@ -39,19 +57,74 @@ public:
     // Load document embeddings from binary file
     bool load_document_embeddings(const std::string& binary_file_path);
 
+    // Store the document embeddings as half floats or int8 (2x / 4x less memory to scan).
+    // The float32 matrix is released, so exact search scans the reduced rows and the HNSW
+    // graph is dropped; building, training or saving needs the float32 embeddings loaded again
+    bool set_document_precision(VectorPrecision precision);
+
+    // Build the HNSW graph over the document embeddings (approximate search)
+    void build_ann_index(std::size_t M = 16, std::size_t ef_construction = 200);
+
+    // Save / load the HNSW graph (kept next to doc_embeddings.bin,
+    // only valid for the document embeddings it was built from)
+    bool save_ann_index(const std::string& binary_file_path) const;
+    bool load_ann_index(const std::string& binary_file_path);
+
+    // Candidate list size of HNSW queries: higher = better recall, slower
+    void set_ef_search(std::size_t ef) { ef_search = ef; invalidate_results(); }
+    std::size_t get_ef_search() const { return ef_search; }
+
+    // Use the HNSW graph when it is loaded (true) or always scan every document (false)
+    void set_use_ann(bool use) { use_ann = use; invalidate_results(); }
+    bool has_ann_index() const { return !ann_index.empty(); }
+
+    // Train the IVF-PQ index from the document embeddings (compressed search)
+    bool train_pq_index(const IvfPqParams& params = IvfPqParams());
+
+    // Save / load the IVF-PQ index. When it is loaded instead of the document
+    // embeddings, semantic search runs on the compressed codes only
+    bool save_pq_index(const std::string& binary_file_path) const;
+    bool load_pq_index(const std::string& binary_file_path);
+
+    // Map doc_embeddings.bin so the best IVF-PQ candidates can be re-scored exactly
+    bool open_rerank_vectors(const std::string& binary_file_path);
+
+    // IVF-PQ query knobs: lists scanned per query, and candidates re-scored
+    // from the full vectors (0 = keep the approximate scores)
+    void set_nprobe(std::size_t n) { nprobe = n; invalidate_results(); }
+    void set_rerank_candidates(std::size_t n) { rerank_candidates = n; invalidate_results(); }
+
+    // Threads sharing the full scan of one query (1 = the calling thread alone, the default):
+    // the rows are split into parts, each keeping its own top_k, merged at the end. More threads
+    // answer a query sooner, fewer leave more cores to concurrent queries; results are the same.
+    // Not to be called while queries are running
+    void set_scan_threads(std::size_t threads);
+    std::size_t get_scan_threads() const { return scan_threads; }
+
     // Perform semantic search using cosine similarity
+    // (read-only, may run on several threads at once)
     std::vector<SemanticResult> semantic_search(
         const std::string& raw_query,
         const Lexicon& lex,
         const ForwardIndex& fwd,
         std::size_t top_k = 20
-    );
+    ) const;
+
+    // Cache of query results keyed on the normalized query (capacity 0 = off, the default).
+    // Loading or building anything and changing a search setting empties it
+    void set_result_cache(std::size_t capacity, std::chrono::seconds ttl = std::chrono::seconds(0)) {
+        results_cache.configure(capacity, ttl);
+    }
+    void clear_result_cache() { results_cache.clear(); }
+    CacheStats result_cache_stats() const { return results_cache.stats(); }
 
     // Load metadata (title, url) for display
     bool load_metadata(const std::string& metadata_csv_path);
 
-    // Get embedding vector for a word (if it exists)
-    const std::vector<float>* get_word_embedding(const std::string& word) const;
+    // Get embedding vector for a word into out (dim floats), false if it has none or was pruned away
+    bool get_word_embedding(std::string_view word, const Lexicon& lex, float* out) const;
+
+    const WordEmbeddings& word_vectors() const { return word_embeddings; }
 
     // Check if embeddings are loaded
     bool is_loaded() const { return embeddings_loaded; }
@@ -59,12 +132,47 @@ public:
     // Get embedding dimension
     std::size_t get_dimension() const { return embedding_dim; }
 
+    // Document embedding matrix and its HNSW graph (for benchmarks and tools)
+    const EmbeddingMatrix& document_embeddings() const { return doc_embeddings; }
+    const QuantizedMatrix& quantized_document_embeddings() const { return quantized_docs; }
+    const HnswIndex& ann() const { return ann_index; }
+    const IvfPqIndex& pq() const { return pq_index; }
+
 private:
-    // GloVe word embeddings: word -> 300D vector
-    std::unordered_map<std::string, std::vector<float>> word_embeddings;
+    // GloVe word embeddings: word -> 300D vector (normalized)
+    WordEmbeddings word_embeddings;
+
+    // word_id -> vector, once prune_embeddings was called
+    LexiconEmbeddings vocab_embeddings;
     
-    // Document embeddings: doc_id -> averaged embedding vector
-    std::unordered_map<std::size_t, std::vector<float>> doc_embeddings;
+    // Document embeddings: one averaged, normalized embedding per row
+    // (contiguous and 64-byte aligned, doc_ids in a parallel array)
+    EmbeddingMatrix doc_embeddings;
+
+    // The same rows in half / int8 precision after set_document_precision (doc_embeddings is empty then)
+    QuantizedMatrix quantized_docs;
+
+    // Approximate nearest neighbour graph over doc_embeddings rows (empty = exact search)
+    HnswIndex ann_index;
+    std::size_t ef_search = 64;
+    bool use_ann = true;
+
+    // Quantized index used when doc_embeddings is not loaded, and the
+    // mapped full vectors for re-ranking its candidates
+    IvfPqIndex pq_index;
+    EmbeddingFile rerank_vectors;
+    std::size_t nprobe = 16;
+    std::size_t rerank_candidates = 0;
+
+    // helpers of the full scan (scan_threads - 1 of them, the querying thread scans one part itself)
+    std::size_t scan_threads = 1;
+    std::unique_ptr<ThreadPool> scan_pool;
+
+    // semantic_search() is const but fills the cache (it locks internally)
+    mutable ResultCache<std::vector<SemanticResult>> results_cache;
+
+    // called by every loader, builder and search setting: cached results came from the old data
+    void invalidate_results() { results_cache.clear(); }
     
     // Metadata: cord_uid -> (title, url)
     struct DocMeta {
@@ -78,10 +186,21 @@ private:
     bool embeddings_loaded = false;
 
     // Helper functions
+
+    // Best top_k (similarity, doc_id) of a full scan over rows [0, doc_ids.size()) with positive
+    // similarity and a cord_uid; score(first, count, out) fills the similarities of rows
+    // [first, first + count)
+    std::vector<std::pair<double, std::size_t>> scan_top_k(
+        const std::vector<std::size_t>& doc_ids,
+        const std::function<void(std::size_t, std::size_t, float*)>& score,
+        const ForwardIndex& fwd,
+        std::size_t top_k
+    ) const;
     
     // Compute average embedding for a list of words
     std::vector<float> compute_average_embedding(
-        const std::vector<std::string>& words
+        const std::vector<std::string>& words,
+        const Lexicon& lex
     ) const;
     
     // Compute cosine similarity between two vectors
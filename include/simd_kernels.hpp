@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Vectorized kernels for embedding scoring and text classification.
+// The widest instruction set supported by the CPU is picked once at runtime
+// (AVX-512, AVX2 + FMA, or a portable scalar fallback; AVX2 / SSE2 / scalar for text).
+
+// dot product of two float vectors of length n
+float dot_product(const float* a, const float* b, std::size_t n);
+
+// out[r] = dot(query, rows + r * stride) for r in [0, count)
+// rows are scored several at a time so each query chunk is loaded once per pass.
+// stride is the distance between rows in floats (>= dim)
+void dot_product_rows(const float* query, const float* rows, std::size_t stride,
+                      std::size_t dim, std::size_t count, float* out);
+
+// acc[i] += w * x[i] for i in [0, n) (one fused multiply-add per float where available)
+void add_scaled(float* acc, const float* x, float w, std::size_t n);
+
+// name of the kernel chosen for this CPU ("avx512", "avx2", "scalar")
+const char* simd_kernel_name();
+
+// IEEE half precision <-> float, rounding to the nearest half (ties to even)
+std::uint16_t float_to_half(float value);
+float half_to_float(std::uint16_t value);
+
+// dot_product_rows over rows of half floats (F16C widens them to floats).
+// stride has to be a multiple of 16 halves with zeros between dim and stride
+void dot_product_rows_f16(const float* query, const std::uint16_t* rows, std::size_t stride,
+                          std::size_t dim, std::size_t count, float* out);
+
+// out[r] = exact integer dot(query, rows + r * stride) of int8 vectors (AVX-512 VNNI or AVX2)
+void dot_product_rows_i8(const std::int8_t* query, const std::int8_t* rows, std::size_t stride,
+                         std::size_t dim, std::size_t count, std::int32_t* out);
+
+// acc[i] += w * x[i] for half float / int8 x
+void add_scaled_f16(float* acc, const std::uint16_t* x, float w, std::size_t n);
+void add_scaled_i8(float* acc, const std::int8_t* x, float w, std::size_t n);
+
+// names of the half float and int8 kernels chosen for this CPU
+const char* f16_kernel_name();
+const char* i8_kernel_name();
+
+// Tokenizer front end over n bytes of text: writes the bytes to lower with ASCII letters
+// lowercased (everything else unchanged) and sets bit i % 64 of letters[i / 64] for every
+// ASCII letter (the bytes std::isalpha accepts in the "C" locale). Bits past n are cleared,
+// letters needs (n + 63) / 64 words
+void classify_letters(const char* text, std::size_t n, char* lower, std::uint64_t* letters);
+
+// name of the text kernel chosen for this CPU ("avx2", "sse2", "scalar")
+const char* text_kernel_name();
+
+// classify_letters with one named text kernel instead of the chosen one (for parity checks),
+// false if it does not exist or this CPU cannot run it
+bool classify_letters_with(const std::string& kernel, const char* text, std::size_t n, char* lower,
+                           std::uint64_t* letters);
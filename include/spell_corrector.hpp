@@ -0,0 +1,71 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include "lexicon.hpp"
+
+//one correction candidate
+struct SpellSuggestion {
+    std::string word;
+    std::size_t distance;   // edit distance to the looked up term (adjacent swaps count as one edit)
+    std::size_t frequency;
+};
+
+//Typo correction over the lexicon with a SymSpell deletion index:
+//every word is indexed under all strings obtained by deleting up to max_distance
+//characters from its first prefix_length characters. A term then only generates its
+//own deletes and looks them up, instead of comparing against the whole vocabulary.
+//Keys are 32 bit hashes, so collisions only add candidates that fail the distance check.
+class SpellCorrector {
+public:
+    //words rarer than min_frequency are not indexed (keeps the index small on noisy vocabularies)
+    void build(const Lexicon& lex, std::size_t max_distance = 2, std::size_t prefix_length = 7,
+               std::size_t min_frequency = 1);
+
+    bool empty() const { return freqs.empty(); }
+
+    std::size_t memory_bytes() const;
+
+    //indexed words within max_distance of term (capped at the build distance),
+    //closest first, then most frequent
+    std::vector<SpellSuggestion> lookup(std::string_view term, std::size_t max_distance) const;
+
+    //best replacement for a term that is not in the lexicon, empty if there is none
+    //(terms of 3 characters or less are never corrected)
+    std::string correct(std::string_view term, const Lexicon& lex) const;
+
+    //the query with every unknown term replaced by its correction,
+    //unchanged if nothing was corrected
+    std::string correct_query(const std::string& raw_query, const Lexicon& lex) const;
+
+    //edits tolerated for a term of this length: none up to 3 characters, 1 up to 7, then 2
+    static std::size_t distance_for_length(std::size_t length);
+
+    //optimal string alignment distance, or limit + 1 as soon as it must exceed limit
+    static std::size_t edit_distance(std::string_view a, std::string_view b, std::size_t limit);
+
+private:
+    std::size_t max_distance = 0;
+    std::size_t prefix_length = 0;
+
+    //indexed words, bytes in one arena
+    std::string arena;
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> freqs;
+
+    //(delete hash << 32 | word index), sorted
+    std::vector<uint64_t> deletes;
+
+    std::string_view word(uint32_t i) const {
+        return std::string_view(arena.data() + offsets[i], offsets[i + 1] - offsets[i]);
+    }
+
+    static uint32_t hash_key(std::string_view key);
+
+    //calls f(delete) for key and every string made by deleting 1..distance characters from it
+    //(duplicates included)
+    template <typename F>
+    static void for_each_delete(std::string& key, std::size_t distance, std::size_t from, F& f);
+};
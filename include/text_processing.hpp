@@ -1,5 +1,85 @@
 #pragma once
+#include <algorithm>
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <vector>
+#include "lemmatizer.hpp"
+#include "simd_kernels.hpp"
 
-std::vector<std::string> tokenize_text(const std::string& text);
\ No newline at end of file
+//true for the common words that are never stored in the lexicon
+bool is_stopword(std::string_view word);
+
+//bytes classified per call of the SIMD front end
+constexpr size_t TOKEN_BLOCK = 4096;
+
+//index of the first bit >= from (and < n) that is set (set = true) or clear (set = false), n if none
+inline size_t next_letter_bit(const uint64_t* bits, size_t from, size_t n, bool set)
+{
+    while (from < n) {
+        size_t w = from / 64;
+        uint64_t x = (set ? bits[w] : ~bits[w]) & (~uint64_t(0) << (from % 64));
+        if (x) {
+            size_t pos = w * 64 + static_cast<size_t>(__builtin_ctzll(x));
+            return pos < n ? pos : n;
+        }
+        from = (w + 1) * 64;
+    }
+    return n;
+}
+
+//Streaming tokenizer: walks the text once, lowercases ASCII letters and splits on everything else,
+//drops words shorter than 3 letters and common words, and calls on_token(std::string_view) with the
+//lemma of every remaining word. The view points into a scratch block or the lemma table,
+//so it is only valid during the call (copy it to keep it).
+//The text is classified TOKEN_BLOCK bytes at a time by classify_letters (vectorized); words are then
+//found by scanning the letter bitmask, and only a word crossing a block boundary is copied.
+template <typename OnToken>
+void for_each_token(std::string_view text, OnToken&& on_token)
+{
+    alignas(64) char lower[TOKEN_BLOCK];
+    uint64_t letters[TOKEN_BLOCK / 64];
+
+    //a word continued from the previous block, reused by every call on this thread
+    thread_local std::string word;
+    bool carrying = false;
+
+    auto emit = [&](std::string_view w) {
+        if (w.size() < 3) return;              //filter tiny words
+        if (is_stopword(w)) return;            //filter common words
+        on_token(lemmatize_view(w));
+    };
+
+    for (size_t base = 0; base < text.size(); base += TOKEN_BLOCK) {
+        size_t n = std::min(TOKEN_BLOCK, text.size() - base);
+        bool last_block = base + n == text.size();
+        classify_letters(text.data() + base, n, lower, letters);
+
+        size_t pos = 0;
+        if (carrying) {
+            size_t end = next_letter_bit(letters, 0, n, false);
+            word.append(lower, end);
+            if (end == n && !last_block) continue;
+            emit(word);
+            carrying = false;
+            pos = end;
+        }
+
+        while (pos < n) {
+            size_t start = next_letter_bit(letters, pos, n, true);
+            if (start == n) break;
+            size_t end = next_letter_bit(letters, start, n, false);
+
+            if (end == n && !last_block) {
+                word.assign(lower + start, end - start);
+                carrying = true;
+                break;
+            }
+            emit(std::string_view(lower + start, end - start));
+            pos = end;
+        }
+    }
+}
+
+//all tokens of the text as strings (for callers that keep them)
+std::vector<std::string> tokenize_text(const std::string& text);
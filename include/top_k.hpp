@@ -0,0 +1,61 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+// Bounded top-k selection over (score, id) pairs.
+// Keeps the k best pairs seen so far in a min-heap, so selecting from n
+// candidates costs O(n log k) and only k entries are ever stored.
+// Equal scores are ordered by smaller id first, which keeps results deterministic.
+template <typename Id = std::size_t>
+class TopK {
+public:
+    using Entry = std::pair<double, Id>;
+
+    explicit TopK(std::size_t k) : k(k) { heap.reserve(k); }
+
+    std::size_t size() const { return heap.size(); }
+    bool full() const { return heap.size() >= k; }
+
+    // lowest score still kept once the heap is full
+    double threshold() const { return heap.empty() ? 0.0 : heap.front().first; }
+
+    // cheap pre-check so callers can skip work for candidates that cannot make it
+    bool would_accept(double score, Id id) const {
+        if (k == 0) return false;
+        if (!full()) return true;
+        return better(Entry(score, id), heap.front());
+    }
+
+    void push(double score, Id id) {
+        if (!would_accept(score, id)) return;
+
+        if (full()) {
+            std::pop_heap(heap.begin(), heap.end(), better);
+            heap.back() = Entry(score, id);
+        } else {
+            heap.emplace_back(score, id);
+        }
+        std::push_heap(heap.begin(), heap.end(), better);
+    }
+
+    // best entries first; the selector is empty afterwards
+    std::vector<Entry> take_sorted() {
+        std::vector<Entry> sorted = std::move(heap);
+        heap.clear();
+        std::sort(sorted.begin(), sorted.end(), better);
+        return sorted;
+    }
+
+private:
+    std::size_t k;
+    std::vector<Entry> heap;
+
+    // heap ordered with better() keeps the worst kept entry at the front
+    static bool better(const Entry& a, const Entry& b) {
+        if (a.first != b.first) return a.first > b.first;
+        return a.second < b.second;
+    }
+};
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "embedding_matrix.hpp"
+#include "lexicon.hpp"
+#include "mapped_file.hpp"
+#include "quantized_matrix.hpp"
+
+// GloVe word -> vector table in one flat layout that can be written to disk and mapped back.
+// Words are sorted, their bytes in one arena (word i is arena[offsets[i], offsets[i+1])),
+// slots is an open addressing table of word index + 1 (0 = empty) for string_view lookups,
+// and vector i is row i of a float matrix whose rows are padded to 64 bytes.
+// The arrays either live in the owned members (built with add + freeze) or in a mapped file,
+// which is shared through the page cache by every process mapping it.
+class WordEmbeddings {
+public:
+    //header of a mapped embedding file, followed by offsets (word_count + 1 uint32),
+    //slots (slot_count uint32) and arena_bytes of word bytes, then zero padding up to
+    //matrix_offset (a multiple of 64) and word_count rows of stride floats.
+    //Integers and floats are stored in native byte order.
+    struct FileHeader {
+        char magic[4];
+        uint32_t version;
+        uint64_t word_count;
+        uint64_t dim;
+        uint64_t stride;
+        uint64_t slot_count;
+        uint64_t arena_bytes;
+        uint64_t matrix_offset;
+    };
+
+    WordEmbeddings() = default;
+
+    WordEmbeddings(const WordEmbeddings&) = delete;
+    WordEmbeddings& operator=(const WordEmbeddings&) = delete;
+
+    //drop everything and start collecting vectors of dim floats
+    void reset(std::size_t dim);
+
+    void reserve(std::size_t words);
+
+    //add a word (before freeze); adding a word again replaces its vector
+    void add(std::string_view word, const float* values);
+
+    //sort the words and build the lookup table, find() works from here on
+    void freeze();
+
+    //dim floats of the word's vector, nullptr if it has none
+    const float* find(std::string_view word) const;
+
+    std::size_t size() const { return word_count; }
+    std::size_t dim() const { return dimension; }
+    std::size_t stride() const { return row_stride; }
+    bool empty() const { return word_count == 0; }
+    bool is_mapped() const { return file.is_open(); }
+
+    std::string_view word(std::size_t i) const {
+        return std::string_view(arena + offsets[i], offsets[i + 1] - offsets[i]);
+    }
+    const float* row(std::size_t i) const { return matrix + i * row_stride; }
+
+    //heap bytes (a mapped file lives in the page cache and is not counted)
+    std::size_t memory_bytes() const;
+
+    //written next to the old file and renamed over it, so a process mapping the old one is not disturbed
+    bool save(const std::string& path) const;
+
+    //false without a message if the file is missing or not in this format (check is_file first)
+    bool map_from_file(const std::string& path);
+
+    //true if the file starts with the magic of this format
+    static bool is_file(const std::string& path);
+
+    void clear();
+
+private:
+    static constexpr uint32_t FILE_VERSION = 1;
+
+    std::size_t dimension = 0;
+    std::size_t row_stride = 0;
+
+    //build mode: words and rows in insertion order
+    std::vector<std::string> pending_words;
+    std::vector<float, AlignedAllocator<float>> pending_rows;
+
+    //frozen arrays, owned or pointing into file
+    std::string owned_arena;
+    std::vector<uint32_t> owned_offsets;
+    std::vector<uint32_t> owned_slots;
+    std::vector<float, AlignedAllocator<float>> owned_matrix;
+    MappedFile file;
+
+    const char* arena = nullptr;
+    const uint32_t* offsets = nullptr;
+    const uint32_t* slots = nullptr;
+    const float* matrix = nullptr;
+    std::size_t word_count = 0;
+    std::size_t slot_count = 0;
+};
+
+// Word vectors of the lexicon words only, looked up by word_id instead of by string.
+// id_to_row is dense over word ids (MISSING = the word has no vector); the rows are
+// either copied into one compact matrix (float32, or half / int8 in a QuantizedMatrix)
+// or point into the WordEmbeddings they came from, which then has to outlive this table
+// (only the rows of lexicon words are ever touched).
+class LexiconEmbeddings {
+public:
+    static constexpr uint32_t MISSING = UINT32_MAX;
+
+    //copy = false keeps pointing into words (float32 only, reduced precision always copies)
+    void build(const WordEmbeddings& words, const Lexicon& lex, bool copy,
+               VectorPrecision precision = VectorPrecision::Float32);
+
+    bool contains(std::size_t word_id) const {
+        return word_id < id_to_row.size() && id_to_row[word_id] != MISSING;
+    }
+
+    //acc[0, dim) += weight * vector of word_id, false if the word has no vector
+    bool add_to(std::size_t word_id, float* acc, float weight) const;
+
+    //dim floats of word_id's vector, false if the word has none
+    bool decode(std::size_t word_id, float* out) const;
+
+    std::size_t size() const { return row_count; }
+    bool empty() const { return row_count == 0; }
+    VectorPrecision precision() const { return mode; }
+
+    //heap bytes: the id index, plus the rows when they were copied
+    std::size_t memory_bytes() const {
+        return id_to_row.capacity() * sizeof(uint32_t) + owned_rows.capacity() * sizeof(float) +
+               quantized_rows.memory_bytes();
+    }
+
+    void clear();
+
+private:
+    std::vector<uint32_t> id_to_row;
+    std::vector<float, AlignedAllocator<float>> owned_rows;
+    QuantizedMatrix quantized_rows;
+    VectorPrecision mode = VectorPrecision::Float32;
+    const float* base = nullptr;
+    std::size_t dimension = 0;
+    std::size_t row_stride = 0;
+    std::size_t row_count = 0;
+
+    const float* float_row(std::size_t word_id) const {
+        return base + static_cast<std::size_t>(id_to_row[word_id]) * row_stride;
+    }
+};
@@ -9,8 +9,12 @@
 #include <filesystem>
 #include <fstream>
 #include <sstream>
+#include <atomic>
+#include <deque>
+#include <string_view>
+#include "thread_pool.hpp"
 
-void MetadataParser::parse_line(const std::string& l, std::vector<std::string>& split_line)
+void MetadataParser::parse_line(const std::string& l, std::vector<std::string>& split_line) const
 {
     std::string unique_field;
     split_line.clear();
@@ -42,7 +46,6 @@ std::string MetadataParser::extract_first_sha(const std::string& sha) const {
 
 std::string MetadataParser::get_file_path(const std::string& pmcid, const std::string& sha) const
 {
-    const std::string data_path = "D:/searchEngine/data/2020-04-10";
         // Try SHA-based PDF JSON
     std::string first_sha = extract_first_sha(sha);
     if (!first_sha.empty()) {
@@ -103,12 +106,59 @@ std::string MetadataParser::extract_text_from_json(const std::string& file_path)
 }
 
 
-int MetadataParser::metadata_parse(Lexicon& lex,
-                                   ForwardIndex& fwd,
-                                   InvertedIndex& inv,
-                                   size_t max_docs) 
+MetadataParser::ParsedDocument MetadataParser::parse_document(const std::string& line) const
 {
-    std::ifstream csv("D:/searchEngine/data/2020-04-10/metadata.csv");
+    ParsedDocument doc;
+
+    std::vector<std::string> cols;
+    parse_line(line, cols);
+
+    if (cols.size() < 18) return doc;
+
+    const std::string& cord_uid = cols[0];
+    const std::string& sha_raw  = cols[1];
+    const std::string& title    = cols[3];
+    const std::string& pmcid    = cols[5];
+    const std::string& abstract = cols[8];
+
+    // Build complete text
+    std::string full_text = title + "\n" + abstract + "\n";
+
+    std::string json_path = get_file_path(pmcid, sha_raw);
+    if (!json_path.empty()) {
+        full_text += extract_text_from_json(json_path);
+    }
+
+    //Size too small meaning we couldnt get the doc
+    if (full_text.size() < 50) return doc;
+
+
+    //freq of words for this doc, in order of first occurrence. Only a new word is copied;
+    //the keys view the strings in doc.terms, which a deque never moves
+    std::unordered_map<std::string_view, size_t> term_pos;
+    for_each_token(full_text, [&](std::string_view token) {
+        auto it = term_pos.find(token);
+        if (it != term_pos.end()) {
+            doc.terms[it->second].second++;
+            return;
+        }
+        doc.terms.emplace_back(std::string(token), 1);
+        term_pos.emplace(doc.terms.back().first, doc.terms.size() - 1);
+    });
+
+    doc.valid = true;
+    doc.cord_uid = cord_uid;
+    return doc;
+}
+
+
+size_t MetadataParser::metadata_parse(Lexicon& lex,
+                                      ForwardIndex& fwd,
+                                      InvertedIndex& inv,
+                                      size_t max_docs,
+                                      size_t threads) 
+{
+    std::ifstream csv(data_path + "/metadata.csv");
     if (!csv.is_open()) {
         std::cerr << "Error: Cannot open metadata.csv\n";
         return 0;
@@ -117,57 +167,78 @@ int MetadataParser::metadata_parse(Lexicon& lex,
     std::string line;
     std::getline(csv, line);  // skip header
 
-    int processed_count = 0;
+    size_t processed_count = 0;
 
-    while (std::getline(csv, line)) 
-    {
-        if (processed_count >= max_docs) break;
+    //merge stage: runs on this thread only, in file order
+    auto merge = [&](const std::vector<ParsedDocument>& docs) {
+        for (const auto& doc : docs) {
+            if (processed_count >= max_docs) return;
+            if (!doc.valid) continue;
 
-        std::vector<std::string> cols;
-        parse_line(line, cols);
+            //Pushing words in word_map for forward_index
+            //At the same time, pushing in lexicon
+            std::unordered_map<std::string, std::pair<size_t,size_t>> word_map;
 
-        if (cols.size() < 18) continue;
-
-        const std::string& cord_uid = cols[0];
-        const std::string& sha_raw  = cols[1];
-        const std::string& title    = cols[3];
-        const std::string& pmcid    = cols[5];
-        const std::string& abstract = cols[8];
-
-        // Build complete text
-        std::string full_text = title + "\n" + abstract + "\n";
+            for (const auto& entry : doc.terms) {
+                size_t word_id = lex.add(entry.first, entry.second);
+                word_map[entry.first] = {word_id, entry.second};
+            }
 
-        std::string json_path = get_file_path(pmcid, sha_raw);
-        if (!json_path.empty()) {
-            full_text += extract_text_from_json(json_path);
+            // Register document in ForwardIndex
+            fwd.register_document(doc.cord_uid, word_map);
+            processed_count++;
         }
+    };
 
-        //Size too small meaning we couldnt get the doc
-        if (full_text.size() < 50) continue;
+    if (threads == 0) threads = ThreadPool::default_threads();
 
-
-        std::vector<std::string> tokens = tokenize_text(full_text);
-
-        //for storing freq of words for a specific doc, changes every iteration
-        std::unordered_map<std::string, size_t> local_freq;
-        for (const auto& token : tokens) {
-            local_freq[token]++;
+    if (threads == 1) {
+        std::vector<ParsedDocument> docs(1);
+        while (processed_count < max_docs && std::getline(csv, line)) {
+            docs[0] = parse_document(line);
+            merge(docs);
         }
+    } else {
+        //reader stage (this thread) hands batches of lines to the workers and merges finished
+        //batches oldest first; at most 4 batches per worker are in flight to bound memory
+        std::atomic<bool> finished(false);
+        ThreadPool pool(threads);
+        std::deque<std::future<std::vector<ParsedDocument>>> pending;
+        const size_t max_pending = threads * 4;
+        bool more_lines = true;
+
+        while (true) {
+            while (more_lines && pending.size() < max_pending) {
+                std::vector<std::string> batch;
+                batch.reserve(BATCH_LINES);
+                while (batch.size() < BATCH_LINES && std::getline(csv, line)) {
+                    batch.push_back(std::move(line));
+                }
+                if (batch.size() < BATCH_LINES) more_lines = false;
+                if (batch.empty()) break;
+
+                pending.push_back(pool.submit([this, &finished, batch = std::move(batch)]() {
+                    std::vector<ParsedDocument> docs;
+                    if (finished) return docs;  // max_docs reached, nothing will be merged
+                    docs.reserve(batch.size());
+                    for (const auto& l : batch) docs.push_back(parse_document(l));
+                    return docs;
+                }));
+            }
+            if (pending.empty()) break;
 
-       
-        //Pushing words in word_map (changes every iteration) for forward_index
-        //At the same time, pushing in lexicon
-        std::unordered_map<std::string, std::pair<size_t,size_t>> word_map;
+            merge(pending.front().get());
+            pending.pop_front();
 
-        for (const auto& entry : local_freq) {
-            size_t word_id = lex.add(entry.first, entry.second);
-            word_map[entry.first] = {word_id, entry.second};
+            if (processed_count >= max_docs) {
+                more_lines = false;
+                finished = true;
+            }
         }
-
-        // Register document in ForwardIndex
-        fwd.register_document(cord_uid, word_map);
-        processed_count++;
     }
+
     inv.add_from_forward(fwd);
+    //indexing is done, the rest of the run only reads the lexicon
+    lex.freeze();
     return processed_count;
 }
\ No newline at end of file
@@ -1,42 +1,325 @@
 #include "auto_complete.hpp"
 #include "text_processing.hpp"
+#include "spell_corrector.hpp"
 #include <algorithm>
 #include <cctype>
 
-std::vector<std::string>
-AutoComplete::suggest(const std::string& raw_prefix, const Lexicon& lex, std::size_t top_k) const
+void AutoComplete::build(const Lexicon& lex, std::size_t k)
 {
-    std::vector<std::string> results;
+    cached_k = k;
+    arena.clear();
+    offsets.clear();
+    freqs.clear();
+    nodes.clear();
+    first_bytes.clear();
+    top_words.clear();
 
-    //normalize prefix
+    //a frozen lexicon already hands the words out sorted, a lexicon in build mode does not
+    std::vector<std::pair<std::string_view, std::size_t>> words;
+    words.reserve(lex.size());
+    lex.for_each_word([&](std::string_view w, std::size_t, std::size_t freq) {
+        words.emplace_back(w, freq);
+    });
+    if (!lex.is_frozen()) std::sort(words.begin(), words.end());
+    if (words.empty()) return;
+
+    offsets.reserve(words.size() + 1);
+    offsets.push_back(0);
+    freqs.reserve(words.size());
+    for (const auto& w : words) {
+        arena += w.first;
+        offsets.push_back(static_cast<uint32_t>(arena.size()));
+        freqs.push_back(static_cast<uint32_t>(std::min<std::size_t>(w.second, UINT32_MAX)));
+    }
+
+    nodes.emplace_back();
+    build_node(0, 0, static_cast<uint32_t>(words.size()), 0);
+
+    first_bytes.resize(nodes.size());
+    for (std::size_t n = 0; n < nodes.size(); ++n) {
+        first_bytes[n] = nodes[n].label_length ? arena[nodes[n].label_offset] : '\0';
+    }
+}
+
+void AutoComplete::build_node(uint32_t node, uint32_t lo, uint32_t hi, std::size_t depth)
+{
+    //sorted words: the common prefix of the range is the common prefix of its first and last word
+    std::string_view first = word(lo), last = word(hi - 1);
+    std::size_t lcp = depth;
+    while (lcp < first.size() && lcp < last.size() && first[lcp] == last[lcp]) ++lcp;
+
+    nodes[node].label_offset = offsets[lo] + static_cast<uint32_t>(depth);
+    nodes[node].label_length = static_cast<uint32_t>(lcp - depth);
+    nodes[node].lo = lo;
+    nodes[node].hi = hi;
+    nodes[node].top_begin = 0;
+    nodes[node].top_count = 0;
+
+    //a word equal to the path sorts first and ends here, the rest is grouped by their next byte
+    uint32_t rest = (first.size() == lcp) ? lo + 1 : lo;
+    std::vector<std::pair<uint32_t, uint32_t>> groups;
+    for (uint32_t i = rest; i < hi;) {
+        char c = word(i)[lcp];
+        uint32_t j = i + 1;
+        while (j < hi && word(j)[lcp] == c) ++j;
+        groups.emplace_back(i, j);
+        i = j;
+    }
+
+    uint32_t first_child = static_cast<uint32_t>(nodes.size());
+    nodes[node].first_child = first_child;
+    nodes[node].child_count = static_cast<uint32_t>(groups.size());
+    nodes.resize(nodes.size() + groups.size());
+    for (std::size_t g = 0; g < groups.size(); ++g) {
+        build_node(first_child + static_cast<uint32_t>(g), groups[g].first, groups[g].second, lcp);
+    }
+
+    if (hi - lo <= cached_k) return;
+
+    //top words of this node come from the word ending here and the top words of every child
+    std::vector<uint32_t> candidates;
+    if (rest != lo) candidates.push_back(lo);
+    for (std::size_t g = 0; g < groups.size(); ++g) {
+        const Node& child = nodes[first_child + g];
+        if (child.top_count) {
+            candidates.insert(candidates.end(), top_words.begin() + child.top_begin,
+                              top_words.begin() + child.top_begin + child.top_count);
+        } else {
+            for (uint32_t i = child.lo; i < child.hi; ++i) candidates.push_back(i);
+        }
+    }
+    std::size_t keep = std::min(cached_k, candidates.size());
+    std::partial_sort(candidates.begin(), candidates.begin() + keep, candidates.end(),
+                      [this](uint32_t a, uint32_t b) { return ranks_before(a, b); });
+
+    nodes[node].top_begin = static_cast<uint32_t>(top_words.size());
+    nodes[node].top_count = static_cast<uint32_t>(keep);
+    top_words.insert(top_words.end(), candidates.begin(), candidates.begin() + keep);
+}
+
+long AutoComplete::find_node(const std::string& prefix) const
+{
+    uint32_t n = 0;
+    std::size_t pos = 0;
+    while (true) {
+        const Node& node = nodes[n];
+        std::size_t len = std::min<std::size_t>(node.label_length, prefix.size() - pos);
+        if (arena.compare(node.label_offset, len, prefix, pos, len) != 0) return -1;
+        pos += len;
+        if (pos == prefix.size()) return n;
+
+        //label used up, go on with the child starting with the next prefix byte
+        auto begin = first_bytes.begin() + node.first_child;
+        auto end = begin + node.child_count;
+        auto child = std::lower_bound(begin, end, prefix[pos]);
+        if (child == end || *child != prefix[pos]) return -1;
+        n = static_cast<uint32_t>(child - first_bytes.begin());
+    }
+}
+
+std::size_t AutoComplete::memory_bytes() const
+{
+    return arena.capacity() + (offsets.capacity() + freqs.capacity() + top_words.capacity()) * sizeof(uint32_t)
+         + nodes.capacity() * sizeof(Node) + first_bytes.capacity();
+}
+
+std::string AutoComplete::normalize_prefix(const std::string& raw_prefix)
+{
     std::string prefix;
     for (char c : raw_prefix) {
         if (std::isalpha(static_cast<unsigned char>(c)))
             prefix += std::tolower(static_cast<unsigned char>(c));
     }
+    return prefix;
+}
+
+void AutoComplete::top_of_node(const Node& node, std::size_t k, std::vector<uint32_t>& out) const
+{
+    //cached list, unless more words are asked for than were cached
+    if (node.top_count && k <= cached_k) {
+        for (std::size_t i = 0; i < k && i < node.top_count; ++i) {
+            out.push_back(top_words[node.top_begin + i]);
+        }
+        return;
+    }
+
+    //small subtree (or large k): rank its word range directly
+    std::vector<uint32_t> matches;
+    for (uint32_t i = node.lo; i < node.hi; ++i) matches.push_back(i);
+    std::size_t keep = std::min(k, matches.size());
+    std::partial_sort(matches.begin(), matches.begin() + keep, matches.end(),
+                      [this](uint32_t a, uint32_t b) { return ranks_before(a, b); });
+    out.insert(out.end(), matches.begin(), matches.begin() + keep);
+}
+
+std::vector<std::string>
+AutoComplete::suggest(const std::string& raw_prefix, const Lexicon& lex, std::size_t top_k) const
+{
+    std::vector<std::string> results;
+
+    //normalize prefix
+    std::string prefix = normalize_prefix(raw_prefix);
 
     if (prefix.empty())
         return results;
 
-    //collect matches: (word, frequency)
-    std::vector<std::pair<std::string, std::size_t>> matches;
+    if (nodes.empty()) {
+        //no trie: collect matches: (word, frequency)
+        std::vector<std::pair<std::string, std::size_t>> matches;
+
+        lex.for_each_prefix(prefix, [&](std::string_view word, std::size_t, std::size_t freq) {
+            matches.emplace_back(std::string(word), freq);
+        });
 
-    for (const auto& [word, info] : lex.get_data()) {
-        if (word.rfind(prefix, 0) == 0) {  // starts_with
-            matches.emplace_back(word, info.second);
+        // Sort by global frequency (descending), equal frequencies stay in word order
+        std::stable_sort(matches.begin(), matches.end(),
+                  [](const auto& a, const auto& b) {
+                      return a.second > b.second;
+                  });
+
+        // Extract top-k
+        for (std::size_t i = 0; i < matches.size() && i < top_k; ++i) {
+            results.push_back(matches[i].first);
         }
+        return results;
     }
 
-    // Sort by global frequency (descending)
-    std::sort(matches.begin(), matches.end(),
-              [](const auto& a, const auto& b) {
-                  return a.second > b.second;
-              });
+    long n = find_node(prefix);
+    if (n < 0) {
+        //nothing starts with the prefix, maybe it has a typo
+        return suggest_fuzzy(prefix, top_k, SpellCorrector::distance_for_length(prefix.size()));
+    }
+
+    std::vector<uint32_t> best;
+    top_of_node(nodes[n], top_k, best);
+    for (uint32_t i : best) {
+        results.emplace_back(word(i));
+    }
+    return results;
+}
+
+std::size_t AutoComplete::fuzzy_step(FuzzyState& state, std::size_t depth, char c) const
+{
+    const std::string& prefix = state.prefix;
+    std::size_t m = prefix.size();
+    std::size_t width = m + 1;
+
+    //row of path length depth + 1, the rows of the two shorter paths are right before it
+    if (state.rows.size() < (depth + 2) * width) state.rows.resize((depth + 2) * width);
+    if (state.path.size() <= depth) state.path.resize(depth + 1);
+    const std::size_t* prev = &state.rows[depth * width];
+    const std::size_t* prev2 = depth ? &state.rows[(depth - 1) * width] : nullptr;
+    std::size_t* row = &state.rows[(depth + 1) * width];
+    char prev_char = depth ? state.path[depth - 1] : '\0';
+    state.path[depth] = c;
+
+    row[0] = prev[0] + 1;
+    std::size_t row_min = row[0];
+    for (std::size_t j = 1; j <= m; ++j) {
+        std::size_t cost = (prefix[j - 1] == c) ? 0 : 1;
+        std::size_t d = std::min({ prev[j] + 1, row[j - 1] + 1, prev[j - 1] + cost });
+        //adjacent swap
+        if (prev2 && j > 1 && prefix[j - 1] == prev_char && prefix[j - 2] == c)
+            d = std::min(d, prev2[j - 2] + 1);
+        row[j] = d;
+        row_min = std::min(row_min, d);
+    }
+    return row_min;
+}
+
+void AutoComplete::fuzzy_walk(uint32_t n, uint32_t from, std::size_t depth, std::size_t covered, std::size_t best,
+                              FuzzyState& state) const
+{
+    const Node& node = nodes[n];
+    std::size_t width = state.prefix.size() + 1;
+
+    for (uint32_t l = from; l < node.label_length; ++l, ++depth) {
+        std::size_t row_min = fuzzy_step(state, depth, arena[node.label_offset + l]);
+        best = std::min(best, state.rows[(depth + 1) * width + width - 1]);
+        //a longer path never gets below the row minimum: stop once that cannot beat
+        //what this subtree already has
+        if (row_min > state.max_distance || row_min >= best) {
+            if (best < covered) state.hits.emplace_back(n, best);
+            return;
+        }
+    }
+
+    //the whole subtree matches with distance best, only worth keeping if an ancestor did not match better
+    if (best < covered) state.hits.emplace_back(n, best);
+
+    //the first byte of every child is stepped here, so children cut off right away
+    //are never loaded (they are far apart in nodes, their first bytes are not)
+    for (uint32_t child = node.first_child; child < node.first_child + node.child_count; ++child) {
+        char c = first_bytes[child];
+        //the first letter is taken as typed: typos there are rare and tolerating them
+        //would make every query visit the whole top of the trie
+        if (depth == 0 && c != state.prefix[0]) continue;
+
+        std::size_t row_min = fuzzy_step(state, depth, c);
+        std::size_t child_best = std::min(best, state.rows[(depth + 1) * width + width - 1]);
+        if (row_min > state.max_distance || row_min >= child_best) {
+            if (child_best < best) state.hits.emplace_back(child, child_best);
+            continue;
+        }
+        fuzzy_walk(child, 1, depth + 1, best, child_best, state);
+    }
+}
+
+std::vector<std::string>
+AutoComplete::suggest_fuzzy(const std::string& raw_prefix, std::size_t top_k, std::size_t max_distance) const
+{
+    std::vector<std::string> results;
+    std::string prefix = normalize_prefix(raw_prefix);
+    if (prefix.empty() || nodes.empty() || top_k == 0)
+        return results;
+
+    //the root label is empty unless all words share a prefix
+    if (nodes[0].label_length && first_bytes[0] != prefix[0])
+        return results;
+
+    //closer words always rank first, so the cheap walk with fewer edits runs first
+    //and the tolerance only grows while top_k is not filled
+    std::vector<std::pair<std::size_t, uint32_t>> candidates;
+    for (std::size_t limit = std::min<std::size_t>(1, max_distance);; ++limit) {
+        //row of the empty path: prefix[0, j) needs j deletions
+        FuzzyState state{ prefix, limit, {}, {}, {} };
+        state.rows.resize(prefix.size() + 1);
+        for (std::size_t j = 0; j <= prefix.size(); ++j) state.rows[j] = j;
+        fuzzy_walk(0, 0, 0, limit + 1, limit + 1, state);
+        auto& hits = state.hits;
+
+        //best words of every matching subtree, closest subtrees first, until a distance level fills top_k.
+        //A word under several matching nodes keeps its smallest distance
+        std::stable_sort(hits.begin(), hits.end(), [](const auto& a, const auto& b) { return a.second < b.second; });
+        candidates.clear();
+        std::vector<uint32_t> best;
+        for (std::size_t h = 0; h < hits.size();) {
+            std::size_t level = hits[h].second;
+            for (; h < hits.size() && hits[h].second == level; ++h) {
+                best.clear();
+                top_of_node(nodes[hits[h].first], top_k, best);
+                for (uint32_t i : best) candidates.emplace_back(level, i);
+            }
+            std::sort(candidates.begin(), candidates.end(), [](const auto& a, const auto& b) {
+                if (a.second != b.second) return a.second < b.second;
+                return a.first < b.first;
+            });
+            candidates.erase(std::unique(candidates.begin(), candidates.end(),
+                                         [](const auto& a, const auto& b) { return a.second == b.second; }),
+                             candidates.end());
+            if (candidates.size() >= top_k) break;
+        }
+        if (candidates.size() >= top_k || limit >= max_distance) break;
+    }
 
-    // Extract top-k
-    for (std::size_t i = 0; i < matches.size() && i < top_k; ++i) {
-        results.push_back(matches[i].first);
+    std::size_t keep = std::min(top_k, candidates.size());
+    std::partial_sort(candidates.begin(), candidates.begin() + keep, candidates.end(),
+                      [this](const auto& a, const auto& b) {
+                          if (a.first != b.first) return a.first < b.first;
+                          return ranks_before(a.second, b.second);
+                      });
+    for (std::size_t i = 0; i < keep; ++i) {
+        results.emplace_back(word(candidates[i].second));
     }
-    
     return results;
-}
\ No newline at end of file
+}
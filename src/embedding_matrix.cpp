@@ -0,0 +1,76 @@
+#include "embedding_matrix.hpp"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+void EmbeddingMatrix::reset(std::size_t dim)
+{
+    dimension = dim;
+    row_stride = (dim + 15) / 16 * 16;
+    data.clear();
+    doc_ids.clear();
+}
+
+void EmbeddingMatrix::reserve(std::size_t rows)
+{
+    data.reserve(rows * row_stride);
+    doc_ids.reserve(rows);
+}
+
+std::size_t EmbeddingMatrix::add_row(std::size_t doc_id, const float* values)
+{
+    std::size_t r = doc_ids.size();
+    data.resize(data.size() + row_stride, 0.0f);
+    std::copy(values, values + dimension, data.begin() + r * row_stride);
+    doc_ids.push_back(doc_id);
+    return r;
+}
+
+void EmbeddingMatrix::resize(std::size_t rows)
+{
+    data.resize(rows * row_stride, 0.0f);
+    doc_ids.resize(rows, 0);
+}
+
+bool EmbeddingFile::open(const std::string& path)
+{
+    close();
+    if (!file.open(path)) {
+        std::cerr << "Error: cannot open " << path << std::endl;
+        return false;
+    }
+
+    if (file.size() < HEADER_BYTES) {
+        std::cerr << "Error: " << path << " is truncated" << std::endl;
+        close();
+        return false;
+    }
+    std::size_t header[2];
+    std::memcpy(header, file.data(), HEADER_BYTES);
+
+    record_bytes = sizeof(std::size_t) + header[1] * sizeof(float);
+    if (header[1] == 0 || (file.size() - HEADER_BYTES) / record_bytes < header[0]) {
+        std::cerr << "Error: " << path << " is truncated" << std::endl;
+        close();
+        return false;
+    }
+
+    count = header[0];
+    dimension = header[1];
+    return true;
+}
+
+void EmbeddingFile::close()
+{
+    file.close();
+    count = 0;
+    dimension = 0;
+    record_bytes = 0;
+}
+
+std::size_t EmbeddingFile::doc_id(std::size_t r) const
+{
+    std::size_t id;
+    std::memcpy(&id, file.data() + HEADER_BYTES + r * record_bytes, sizeof(id));
+    return id;
+}
@@ -0,0 +1,407 @@
+#include "hnsw_index.hpp"
+#include "simd_kernels.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <queue>
+#include <random>
+
+namespace {
+
+//priority_queue orders: closest candidate on top / farthest candidate on top
+template <typename C>
+struct CloserFirst {
+    bool operator()(const C& a, const C& b) const { return a.dist > b.dist; }
+};
+
+template <typename C>
+struct FartherFirst {
+    bool operator()(const C& a, const C& b) const { return a.dist < b.dist; }
+};
+
+//visited set reused across queries of one thread: a node is visited when its tag equals the current epoch
+struct VisitedMarks {
+    std::vector<uint32_t> tags;
+    uint32_t epoch = 0;
+
+    void start(size_t node_count) {
+        if (tags.size() < node_count) tags.resize(node_count, 0);
+        if (++epoch == 0) {
+            std::fill(tags.begin(), tags.end(), 0);
+            epoch = 1;
+        }
+    }
+
+    //true if the node was already visited, marks it otherwise
+    bool test_and_mark(uint32_t node) {
+        if (tags[node] == epoch) return true;
+        tags[node] = epoch;
+        return false;
+    }
+};
+
+thread_local VisitedMarks visited_marks;
+
+//rows are normalized: the larger the dot product the closer, and -dot keeps the similarity exact
+inline float distance(const EmbeddingMatrix& matrix, const float* query, uint32_t node)
+{
+    return -dot_product(query, matrix.row(node), matrix.dim());
+}
+
+}
+
+uint32_t* HnswIndex::links(uint32_t node, int level)
+{
+    if (level == 0) return links0.data() + node * (M0 + 1);
+    return upper_links[node].data() + (level - 1) * (M + 1);
+}
+
+const uint32_t* HnswIndex::links(uint32_t node, int level) const
+{
+    if (level == 0) return links0.data() + node * (M0 + 1);
+    return upper_links[node].data() + (level - 1) * (M + 1);
+}
+
+void HnswIndex::clear()
+{
+    M = M0 = 0;
+    node_count = 0;
+    max_level = -1;
+    entry_point = 0;
+    levels.clear();
+    links0.clear();
+    upper_links.clear();
+}
+
+size_t HnswIndex::memory_bytes() const
+{
+    size_t bytes = levels.capacity() + links0.capacity() * sizeof(uint32_t);
+    for (const auto& node_links : upper_links) bytes += node_links.capacity() * sizeof(uint32_t);
+    return bytes;
+}
+
+void HnswIndex::build(const EmbeddingMatrix& matrix, const HnswParams& params)
+{
+    clear();
+    if (matrix.empty()) return;
+
+    M = std::max<size_t>(params.M, 2);
+    M0 = 2 * M;
+    node_count = matrix.rows();
+
+    //level of every node: floor(-ln(U) / ln(M)), so each layer keeps about 1/M of the nodes below it
+    std::mt19937 rng(params.seed);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    double level_mult = 1.0 / std::log(static_cast<double>(M));
+
+    levels.resize(node_count);
+    links0.assign(node_count * (M0 + 1), 0);
+    upper_links.resize(node_count);
+    for (size_t node = 0; node < node_count; ++node) {
+        double u = 1.0 - uniform(rng);
+        int level = std::min(static_cast<int>(-std::log(u) * level_mult), MAX_LEVEL);
+        levels[node] = static_cast<uint8_t>(level);
+        if (level > 0) upper_links[node].assign(level * (M + 1), 0);
+    }
+
+    size_t ef_construction = std::max(params.ef_construction, M);
+    for (size_t node = 0; node < node_count; ++node) {
+        insert(matrix, static_cast<uint32_t>(node), ef_construction);
+    }
+}
+
+uint32_t HnswIndex::greedy_descent(const EmbeddingMatrix& matrix, const float* query, int target_level) const
+{
+    uint32_t current = entry_point;
+    float current_dist = distance(matrix, query, current);
+
+    for (int level = max_level; level > target_level; --level) {
+        bool moved = true;
+        while (moved) {
+            moved = false;
+            const uint32_t* nb = links(current, level);
+            for (uint32_t i = 1; i <= nb[0]; ++i) {
+                float d = distance(matrix, query, nb[i]);
+                if (d < current_dist) {
+                    current_dist = d;
+                    current = nb[i];
+                    moved = true;
+                }
+            }
+        }
+    }
+    return current;
+}
+
+std::vector<HnswIndex::Candidate> HnswIndex::search_layer(const EmbeddingMatrix& matrix, const float* query,
+                                                          uint32_t entry, size_t ef, int level) const
+{
+    VisitedMarks& visited = visited_marks;
+    visited.start(node_count);
+
+    std::priority_queue<Candidate, std::vector<Candidate>, CloserFirst<Candidate>> candidates;
+    std::priority_queue<Candidate, std::vector<Candidate>, FartherFirst<Candidate>> found;
+
+    Candidate start{distance(matrix, query, entry), entry};
+    visited.test_and_mark(entry);
+    candidates.push(start);
+    found.push(start);
+
+    while (!candidates.empty()) {
+        Candidate current = candidates.top();
+        //every remaining candidate is farther than the worst result
+        if (current.dist > found.top().dist && found.size() >= ef) break;
+        candidates.pop();
+
+        const uint32_t* nb = links(current.node, level);
+        for (uint32_t i = 1; i <= nb[0]; ++i) {
+            __builtin_prefetch(matrix.row(nb[i]));
+        }
+
+        for (uint32_t i = 1; i <= nb[0]; ++i) {
+            uint32_t next = nb[i];
+            if (visited.test_and_mark(next)) continue;
+
+            float d = distance(matrix, query, next);
+            if (found.size() < ef || d < found.top().dist) {
+                candidates.push({d, next});
+                found.push({d, next});
+                if (found.size() > ef) found.pop();
+            }
+        }
+    }
+
+    std::vector<Candidate> result;
+    result.reserve(found.size());
+    while (!found.empty()) {
+        result.push_back(found.top());
+        found.pop();
+    }
+    return result;
+}
+
+void HnswIndex::select_neighbours(const EmbeddingMatrix& matrix, std::vector<Candidate>& candidates,
+                                  size_t max_links)
+{
+    if (candidates.size() <= max_links) return;
+
+    //a candidate closer to an already selected neighbour than to the base node is reachable through it,
+    //skipping it spreads the links in different directions
+    std::vector<Candidate> selected;
+    selected.reserve(max_links);
+    for (const Candidate& c : candidates) {
+        if (selected.size() >= max_links) break;
+
+        bool keep = true;
+        for (const Candidate& s : selected) {
+            if (distance(matrix, matrix.row(c.node), s.node) < c.dist) {
+                keep = false;
+                break;
+            }
+        }
+        if (keep) selected.push_back(c);
+    }
+    candidates.swap(selected);
+}
+
+void HnswIndex::insert(const EmbeddingMatrix& matrix, uint32_t node, size_t ef_construction)
+{
+    int level = levels[node];
+
+    if (max_level < 0) {
+        entry_point = node;
+        max_level = level;
+        return;
+    }
+
+    const float* query = matrix.row(node);
+    uint32_t current = greedy_descent(matrix, query, level);
+
+    for (int l = std::min(level, max_level); l >= 0; --l) {
+        std::vector<Candidate> found = search_layer(matrix, query, current, ef_construction, l);
+        std::sort(found.begin(), found.end(), [](const Candidate& a, const Candidate& b) {
+            return a.dist < b.dist;
+        });
+        current = found.front().node;
+
+        select_neighbours(matrix, found, M);
+
+        uint32_t* own = links(node, l);
+        own[0] = static_cast<uint32_t>(found.size());
+        for (size_t i = 0; i < found.size(); ++i) own[i + 1] = found[i].node;
+
+        //link back, re-selecting the neighbour's links when it is full
+        size_t max_links = l == 0 ? M0 : M;
+        for (const Candidate& c : found) {
+            uint32_t* nb = links(c.node, l);
+            if (nb[0] < max_links) {
+                nb[++nb[0]] = node;
+                continue;
+            }
+
+            const float* base = matrix.row(c.node);
+            std::vector<Candidate> pool;
+            pool.reserve(max_links + 1);
+            pool.push_back({c.dist, node});
+            for (uint32_t i = 1; i <= nb[0]; ++i) {
+                pool.push_back({distance(matrix, base, nb[i]), nb[i]});
+            }
+            std::sort(pool.begin(), pool.end(), [](const Candidate& a, const Candidate& b) {
+                return a.dist < b.dist;
+            });
+            select_neighbours(matrix, pool, max_links);
+
+            nb[0] = static_cast<uint32_t>(pool.size());
+            for (size_t i = 0; i < pool.size(); ++i) nb[i + 1] = pool[i].node;
+        }
+    }
+
+    if (level > max_level) {
+        entry_point = node;
+        max_level = level;
+    }
+}
+
+std::vector<std::pair<float, uint32_t>> HnswIndex::search(const EmbeddingMatrix& matrix, const float* query,
+                                                          size_t k, size_t ef) const
+{
+    std::vector<std::pair<float, uint32_t>> results;
+    if (empty() || k == 0) return results;
+
+    uint32_t entry = greedy_descent(matrix, query, 0);
+    std::vector<Candidate> found = search_layer(matrix, query, entry, std::max(ef, k), 0);
+
+    std::sort(found.begin(), found.end(), [](const Candidate& a, const Candidate& b) {
+        return a.dist < b.dist || (a.dist == b.dist && a.node < b.node);
+    });
+    if (found.size() > k) found.resize(k);
+
+    results.reserve(found.size());
+    for (const Candidate& c : found) results.emplace_back(-c.dist, c.node);
+    return results;
+}
+
+uint64_t HnswIndex::hash_ids(const EmbeddingMatrix& matrix)
+{
+    //FNV-1a over the dimension and the doc_id of every row
+    uint64_t hash = 1469598103934665603ULL;
+    auto mix = [&hash](uint64_t value) {
+        for (int i = 0; i < 8; ++i) {
+            hash ^= (value >> (i * 8)) & 0xff;
+            hash *= 1099511628211ULL;
+        }
+    };
+    mix(matrix.dim());
+    for (size_t doc_id : matrix.ids()) mix(doc_id);
+    return hash;
+}
+
+bool HnswIndex::save(const std::string& path, const EmbeddingMatrix& matrix) const
+{
+    if (empty() || matrix.rows() != node_count) {
+        std::cerr << "Error: HNSW graph does not match the document embeddings" << std::endl;
+        return false;
+    }
+
+    std::ofstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Error: cannot create " << path << std::endl;
+        return false;
+    }
+
+    FileHeader header;
+    std::memcpy(header.magic, "HNSW", 4);
+    header.version = FILE_VERSION;
+    header.node_count = node_count;
+    header.dim = static_cast<uint32_t>(matrix.dim());
+    header.M = static_cast<uint32_t>(M);
+    header.max_level = max_level;
+    header.entry_point = entry_point;
+    header.ids_hash = hash_ids(matrix);
+
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(levels.data()), levels.size());
+    file.write(reinterpret_cast<const char*>(links0.data()), links0.size() * sizeof(uint32_t));
+    for (const auto& node_links : upper_links) {
+        if (node_links.empty()) continue;
+        file.write(reinterpret_cast<const char*>(node_links.data()), node_links.size() * sizeof(uint32_t));
+    }
+
+    return static_cast<bool>(file);
+}
+
+bool HnswIndex::load(const std::string& path, const EmbeddingMatrix& matrix)
+{
+    clear();
+
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Error: cannot open " << path << std::endl;
+        return false;
+    }
+
+    FileHeader header;
+    file.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!file || std::memcmp(header.magic, "HNSW", 4) != 0 || header.version != FILE_VERSION) {
+        std::cerr << "Error: " << path << " is not a version " << FILE_VERSION << " HNSW graph" << std::endl;
+        return false;
+    }
+    if (header.node_count != matrix.rows() || header.dim != matrix.dim() || header.ids_hash != hash_ids(matrix)) {
+        std::cerr << "Error: " << path << " was built for different document embeddings" << std::endl;
+        return false;
+    }
+    if (header.M < 2 || header.max_level > MAX_LEVEL || header.entry_point >= header.node_count) {
+        std::cerr << "Error: " << path << " has an invalid header" << std::endl;
+        return false;
+    }
+
+    M = header.M;
+    M0 = 2 * M;
+    node_count = header.node_count;
+    max_level = header.max_level;
+    entry_point = header.entry_point;
+
+    levels.resize(node_count);
+    links0.resize(node_count * (M0 + 1));
+    upper_links.resize(node_count);
+    file.read(reinterpret_cast<char*>(levels.data()), levels.size());
+    bool levels_valid = static_cast<bool>(file) && levels[entry_point] == max_level;
+    for (size_t node = 0; levels_valid && node < node_count; ++node) levels_valid = levels[node] <= max_level;
+    if (!levels_valid) {
+        std::cerr << "Error: " << path << " has invalid node levels" << std::endl;
+        clear();
+        return false;
+    }
+
+    file.read(reinterpret_cast<char*>(links0.data()), links0.size() * sizeof(uint32_t));
+    for (size_t node = 0; node < node_count && file; ++node) {
+        if (levels[node] == 0) continue;
+        upper_links[node].resize(levels[node] * (M + 1));
+        file.read(reinterpret_cast<char*>(upper_links[node].data()), upper_links[node].size() * sizeof(uint32_t));
+    }
+
+    if (!file) {
+        std::cerr << "Error: " << path << " is truncated" << std::endl;
+        clear();
+        return false;
+    }
+
+    //reject out of range links so a damaged file cannot make search read outside the matrix
+    for (size_t node = 0; node < node_count; ++node) {
+        for (int l = 0; l <= levels[node]; ++l) {
+            const uint32_t* nb = links(static_cast<uint32_t>(node), l);
+            size_t max_links = l == 0 ? M0 : M;
+            bool valid = nb[0] <= max_links;
+            for (uint32_t i = 1; valid && i <= nb[0]; ++i) valid = nb[i] < node_count && levels[nb[i]] >= l;
+            if (!valid) {
+                std::cerr << "Error: " << path << " has invalid links" << std::endl;
+                clear();
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,540 @@
+#include "http_server.hpp"
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <iostream>
+
+#ifdef __linux__
+#include <cerrno>
+#include <cstring>
+#include <mutex>
+#include <unordered_map>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+const std::string& HttpRequest::param(const std::string& name) const
+{
+    static const std::string none;
+    for (const auto& [key, value] : params) {
+        if (key == name) return value;
+    }
+    return none;
+}
+
+bool HttpRequest::has_param(const std::string& name) const
+{
+    for (const auto& entry : params) {
+        if (entry.first == name) return true;
+    }
+    return false;
+}
+
+std::string HttpServer::url_decode(const std::string& text)
+{
+    auto hex = [](char c) -> int {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    };
+
+    std::string out;
+    out.reserve(text.size());
+    for (std::size_t i = 0; i < text.size(); ++i) {
+        char c = text[i];
+        if (c == '+') {
+            out += ' ';
+        } else if (c == '%' && i + 2 < text.size() && hex(text[i + 1]) >= 0 && hex(text[i + 2]) >= 0) {
+            out += static_cast<char>(hex(text[i + 1]) * 16 + hex(text[i + 2]));
+            i += 2;
+        } else {
+            out += c;
+        }
+    }
+    return out;
+}
+
+HttpServer::~HttpServer()
+{
+    close_sockets();
+}
+
+#ifdef __linux__
+
+namespace {
+
+// request line + headers larger than this are refused (431) and the connection closed
+const std::size_t MAX_HEADER = 64 * 1024;
+
+// epoll keys of the two non-client descriptors, clients count up from FIRST_CLIENT
+const uint64_t LISTENER_KEY = 0;
+const uint64_t WAKEUP_KEY = 1;
+const uint64_t FIRST_CLIENT = 2;
+
+const char* status_text(int status)
+{
+    switch (status) {
+        case 200: return "OK";
+        case 400: return "Bad Request";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 413: return "Payload Too Large";
+        case 431: return "Request Header Fields Too Large";
+        case 500: return "Internal Server Error";
+        case 501: return "Not Implemented";
+        case 505: return "HTTP Version Not Supported";
+        default: return "Unknown";
+    }
+}
+
+std::string format_response(const HttpResponse& response, bool keep_alive)
+{
+    std::string out;
+    out.reserve(response.body.size() + 192);
+    out += "HTTP/1.1 ";
+    out += std::to_string(response.status);
+    out += ' ';
+    out += status_text(response.status);
+    out += "\r\nContent-Type: ";
+    out += response.content_type;
+    out += "\r\nContent-Length: ";
+    out += std::to_string(response.body.size());
+    // the web page may be served from another origin (the node server)
+    out += "\r\nAccess-Control-Allow-Origin: *";
+    if (response.status == 405) out += "\r\nAllow: GET";
+    out += keep_alive ? "\r\nConnection: keep-alive\r\n\r\n" : "\r\nConnection: close\r\n\r\n";
+    out += response.body;
+    return out;
+}
+
+HttpResponse error_response(int status, const std::string& message)
+{
+    HttpResponse response;
+    response.status = status;
+    response.body = "{\"error\":\"" + message + "\"}";
+    return response;
+}
+
+std::string lowercase(std::string text)
+{
+    for (char& c : text) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    return text;
+}
+
+// One request taken off the front of a connection's input
+struct Parsed {
+    enum State { INCOMPLETE, REQUEST, ERROR } state = INCOMPLETE;
+    HttpRequest request;
+    HttpResponse error;       // state == ERROR, the connection is closed after it
+    bool keep_alive = true;
+};
+
+Parsed parse_request(std::string& input)
+{
+    Parsed parsed;
+    std::size_t header_end = input.find("\r\n\r\n");
+    if (header_end == std::string::npos) {
+        if (input.size() > MAX_HEADER) {
+            parsed.state = Parsed::ERROR;
+            parsed.error = error_response(431, "Request header too large");
+        }
+        return parsed;
+    }
+
+    // request line: METHOD TARGET VERSION
+    std::size_t line_end = input.find("\r\n");
+    std::string line = input.substr(0, line_end);
+    std::size_t sp1 = line.find(' ');
+    std::size_t sp2 = sp1 == std::string::npos ? sp1 : line.find(' ', sp1 + 1);
+    if (sp2 == std::string::npos) {
+        parsed.state = Parsed::ERROR;
+        parsed.error = error_response(400, "Malformed request line");
+        return parsed;
+    }
+    std::string target = line.substr(sp1 + 1, sp2 - sp1 - 1);
+    std::string version = line.substr(sp2 + 1);
+    if (version != "HTTP/1.1" && version != "HTTP/1.0") {
+        parsed.state = Parsed::ERROR;
+        parsed.error = error_response(505, "Only HTTP/1.0 and HTTP/1.1 are supported");
+        return parsed;
+    }
+    parsed.request.method = line.substr(0, sp1);
+
+    // HTTP/1.1 keeps the connection open unless told otherwise, HTTP/1.0 only when asked
+    bool keep_alive = version == "HTTP/1.1";
+    std::size_t body_length = 0;
+    std::size_t pos = line_end + 2;
+    while (pos < header_end) {
+        std::size_t end = input.find("\r\n", pos);
+        std::size_t colon = input.find(':', pos);
+        if (colon != std::string::npos && colon < end) {
+            std::string name = lowercase(input.substr(pos, colon - pos));
+            std::size_t value_begin = input.find_first_not_of(" \t", colon + 1);
+            std::string value = value_begin < end ? lowercase(input.substr(value_begin, end - value_begin)) : "";
+            if (name == "connection") {
+                if (value.find("close") != std::string::npos) keep_alive = false;
+                else if (value.find("keep-alive") != std::string::npos) keep_alive = true;
+            } else if (name == "content-length") {
+                body_length = std::strtoull(value.c_str(), nullptr, 10);
+            } else if (name == "transfer-encoding") {
+                // a chunked body cannot be skipped without decoding it
+                parsed.state = Parsed::ERROR;
+                parsed.error = error_response(501, "Request bodies are not supported");
+                return parsed;
+            }
+        }
+        pos = end + 2;
+    }
+
+    // a body is never used, but it has to be skipped to find the next request
+    if (body_length > MAX_HEADER) {
+        parsed.state = Parsed::ERROR;
+        parsed.error = error_response(413, "Request body too large");
+        return parsed;
+    }
+    std::size_t request_end = header_end + 4 + body_length;
+    if (input.size() < request_end) return parsed;
+    input.erase(0, request_end);
+
+    // target: /path?key=value&key=value
+    std::size_t question = target.find('?');
+    parsed.request.path = HttpServer::url_decode(target.substr(0, question));
+    if (question != std::string::npos) {
+        std::size_t begin = question + 1;
+        while (begin <= target.size()) {
+            std::size_t amp = target.find('&', begin);
+            if (amp == std::string::npos) amp = target.size();
+            std::string pair = target.substr(begin, amp - begin);
+            if (!pair.empty()) {
+                std::size_t eq = pair.find('=');
+                parsed.request.params.emplace_back(
+                    HttpServer::url_decode(pair.substr(0, eq)),
+                    eq == std::string::npos ? "" : HttpServer::url_decode(pair.substr(eq + 1)));
+            }
+            begin = amp + 1;
+        }
+    }
+
+    parsed.state = Parsed::REQUEST;
+    parsed.keep_alive = keep_alive;
+    return parsed;
+}
+
+struct Connection {
+    int fd = -1;
+    std::string input;
+    std::string output;         // response bytes not yet written
+    std::size_t output_sent = 0;
+    uint32_t events = 0;        // epoll interest currently registered
+    bool busy = false;          // a worker is handling a request of this connection
+    bool closing = false;       // close once the output is written
+    bool peer_closed = false;   // the client will send nothing more
+};
+
+// response of a worker, handed back to the event loop
+struct Finished {
+    uint64_t key;
+    std::string data;
+    bool keep_alive;
+};
+
+void wake(int fd)
+{
+    uint64_t one = 1;
+    // a full counter already means "wake up", nothing to do if the write fails
+    if (::write(fd, &one, sizeof(one)) < 0) {}
+}
+
+}
+
+bool HttpServer::listen(const std::string& address)
+{
+    close_sockets();
+
+    // "host:port" or just "port"
+    std::string host = "127.0.0.1";
+    std::string port = address;
+    std::size_t colon = address.rfind(':');
+    if (colon != std::string::npos) {
+        if (colon > 0) host = address.substr(0, colon);
+        port = address.substr(colon + 1);
+    }
+
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    addrinfo* found = nullptr;
+    if (::getaddrinfo(host.c_str(), port.c_str(), &hints, &found) != 0 || !found) {
+        std::cerr << "Error: cannot resolve " << address << std::endl;
+        return false;
+    }
+
+    for (addrinfo* ai = found; ai; ai = ai->ai_next) {
+        int s = ::socket(ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, ai->ai_protocol);
+        if (s < 0) continue;
+
+        int on = 1;
+        ::setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        if (::bind(s, ai->ai_addr, ai->ai_addrlen) == 0 && ::listen(s, SOMAXCONN) == 0) {
+            listener = s;
+            break;
+        }
+        ::close(s);
+    }
+    ::freeaddrinfo(found);
+
+    if (listener < 0) {
+        std::cerr << "Error: cannot listen on " << address << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+
+    wakeup = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wakeup < 0) {
+        std::cerr << "Error: cannot create eventfd: " << std::strerror(errno) << std::endl;
+        close_sockets();
+        return false;
+    }
+    bound_address = host + ":" + port;
+    return true;
+}
+
+void HttpServer::close_sockets()
+{
+    if (listener >= 0) ::close(listener);
+    if (wakeup >= 0) ::close(wakeup);
+    listener = -1;
+    wakeup = -1;
+}
+
+void HttpServer::stop()
+{
+    stopping = true;
+    if (wakeup >= 0) wake(wakeup);
+}
+
+void HttpServer::run(const Handler& handler, std::size_t threads)
+{
+    if (listener < 0) return;
+
+    int epoll = ::epoll_create1(EPOLL_CLOEXEC);
+    if (epoll < 0) {
+        std::cerr << "Error: cannot create epoll instance: " << std::strerror(errno) << std::endl;
+        return;
+    }
+
+    auto watch = [epoll](int fd, uint64_t key, uint32_t events, int op) {
+        epoll_event ev{};
+        ev.events = events;
+        ev.data.u64 = key;
+        return ::epoll_ctl(epoll, op, fd, &ev) == 0;
+    };
+    watch(listener, LISTENER_KEY, EPOLLIN, EPOLL_CTL_ADD);
+    watch(wakeup, WAKEUP_KEY, EPOLLIN, EPOLL_CTL_ADD);
+
+    // workers push here and poke the eventfd; declared before the pool, which outlives none of it
+    std::mutex finished_mutex;
+    std::vector<Finished> finished;
+    std::unordered_map<uint64_t, Connection> connections;
+    uint64_t next_key = FIRST_CLIENT;
+    int wakeup_fd = wakeup;
+
+    ThreadPool pool(threads);
+    stopping = false;
+
+    auto close_connection = [&](uint64_t key) {
+        auto it = connections.find(key);
+        if (it == connections.end()) return;
+        ::epoll_ctl(epoll, EPOLL_CTL_DEL, it->second.fd, nullptr);
+        ::close(it->second.fd);
+        connections.erase(it);
+    };
+
+    // write what the socket takes; false if the connection had to be closed
+    auto flush = [&](Connection& c) {
+        while (c.output_sent < c.output.size()) {
+            ssize_t n = ::send(c.fd, c.output.data() + c.output_sent, c.output.size() - c.output_sent, MSG_NOSIGNAL);
+            if (n > 0) {
+                c.output_sent += static_cast<std::size_t>(n);
+            } else if (n < 0 && errno == EINTR) {
+                continue;
+            } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                return true;
+            } else {
+                return false;
+            }
+        }
+        c.output.clear();
+        c.output_sent = 0;
+        return true;
+    };
+
+    // start the next buffered request, flush, then close or re-arm epoll as the state requires
+    auto settle = [&](uint64_t key) {
+        Connection& c = connections.at(key);
+
+        if (!c.busy && !c.closing) {
+            Parsed parsed = parse_request(c.input);
+            if (parsed.state == Parsed::ERROR) {
+                c.output += format_response(parsed.error, false);
+                c.closing = true;
+            } else if (parsed.state == Parsed::REQUEST) {
+                c.busy = true;
+                bool keep_alive = parsed.keep_alive;
+                pool.submit([&, key, keep_alive, request = std::move(parsed.request)] {
+                    HttpResponse response;
+                    if (request.method != "GET") {
+                        response = error_response(405, "Only GET is supported");
+                    } else {
+                        try {
+                            response = handler(request);
+                        } catch (const std::exception& e) {
+                            std::cerr << "Error: request " << request.path << " failed: " << e.what() << std::endl;
+                            response = error_response(500, "Internal error");
+                        }
+                    }
+                    std::string data = format_response(response, keep_alive);
+                    {
+                        std::lock_guard<std::mutex> lock(finished_mutex);
+                        finished.push_back({key, std::move(data), keep_alive});
+                    }
+                    wake(wakeup_fd);
+                });
+            }
+        }
+
+        if (!flush(c)) {
+            close_connection(key);
+            return;
+        }
+        bool idle = !c.busy && c.output.empty();
+        if (idle && (c.closing || c.peer_closed)) {
+            close_connection(key);
+            return;
+        }
+
+        // stop reading while the input already holds more than a request can be
+        uint32_t events = 0;
+        if (!c.closing && !c.peer_closed && c.input.size() <= MAX_HEADER * 2) events |= EPOLLIN;
+        if (!c.output.empty()) events |= EPOLLOUT;
+        if (events != c.events) {
+            watch(c.fd, key, events, EPOLL_CTL_MOD);
+            c.events = events;
+        }
+    };
+
+    std::vector<epoll_event> events(256);
+    while (!stopping) {
+        int n = ::epoll_wait(epoll, events.data(), static_cast<int>(events.size()), -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            std::cerr << "Error: epoll_wait failed: " << std::strerror(errno) << std::endl;
+            break;
+        }
+
+        for (int i = 0; i < n && !stopping; ++i) {
+            uint64_t key = events[i].data.u64;
+
+            if (key == LISTENER_KEY) {
+                while (true) {
+                    int fd = ::accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+                    if (fd < 0) break;
+                    int on = 1;
+                    ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+                    uint64_t client = next_key++;
+                    Connection& c = connections[client];
+                    c.fd = fd;
+                    c.events = EPOLLIN;
+                    if (!watch(fd, client, EPOLLIN, EPOLL_CTL_ADD)) close_connection(client);
+                }
+                continue;
+            }
+
+            if (key == WAKEUP_KEY) {
+                uint64_t count;
+                while (::read(wakeup, &count, sizeof(count)) > 0) {}
+
+                std::vector<Finished> done;
+                {
+                    std::lock_guard<std::mutex> lock(finished_mutex);
+                    done.swap(finished);
+                }
+                for (Finished& f : done) {
+                    auto it = connections.find(f.key);
+                    if (it == connections.end()) continue;  // the client left meanwhile
+                    Connection& c = it->second;
+                    c.busy = false;
+                    c.output += f.data;
+                    if (!f.keep_alive) c.closing = true;
+                    settle(f.key);
+                }
+                continue;
+            }
+
+            auto it = connections.find(key);
+            if (it == connections.end()) continue;
+            Connection& c = it->second;
+
+            // both directions are gone, a response could not be delivered anyway
+            if (events[i].events & (EPOLLHUP | EPOLLERR)) {
+                close_connection(key);
+                continue;
+            }
+
+            if (events[i].events & EPOLLIN) {
+                char chunk[16384];
+                bool failed = false;
+                while (true) {
+                    ssize_t got = ::recv(c.fd, chunk, sizeof(chunk), 0);
+                    if (got > 0) {
+                        c.input.append(chunk, static_cast<std::size_t>(got));
+                        if (c.input.size() > MAX_HEADER * 2) break;
+                    } else if (got == 0) {
+                        c.peer_closed = true;
+                        break;
+                    } else if (errno == EINTR) {
+                        continue;
+                    } else {
+                        failed = errno != EAGAIN && errno != EWOULDBLOCK;
+                        break;
+                    }
+                }
+                if (failed) {
+                    close_connection(key);
+                    continue;
+                }
+            }
+            settle(key);
+        }
+    }
+
+    for (auto& entry : connections) ::close(entry.second.fd);
+    connections.clear();
+    ::close(epoll);
+    // the pool finishes the requests in flight before finished and its mutex go away
+}
+
+#else
+
+bool HttpServer::listen(const std::string& address)
+{
+    std::cerr << "Error: the HTTP server needs epoll and is only available on Linux (" << address << ")" << std::endl;
+    return false;
+}
+
+void HttpServer::close_sockets() {}
+
+void HttpServer::stop() { stopping = true; }
+
+void HttpServer::run(const Handler&, std::size_t) {}
+
+#endif
@@ -5,9 +5,11 @@
 #include <fstream>
 #include <sstream>
 #include <algorithm>
+#include <cstring>
+#include <filesystem>
 
 //comparator for sorting by word_id
-bool sort_by_word_id(const std::pair<size_t, std::vector<size_t>>& a, const std::pair<size_t, std::vector<size_t>>& b)
+bool sort_by_word_id(const std::pair<size_t, std::vector<Posting>>& a, const std::pair<size_t, std::vector<Posting>>& b)
 {
     return a.first < b.first;
 }
@@ -15,116 +17,575 @@ bool sort_by_word_id(const std::pair<size_t, std::vector<size_t>>& a, const std:
 //Making Inverted Index using Forward index
 void InvertedIndex::add_from_forward(const ForwardIndex& forward_index)
 {
+    //(barrel_id -> (word_id -> vector of (doc_id, freq))
+    std::unordered_map<size_t, std::unordered_map<size_t, std::vector<Posting>>> lists;
+
+    reset_barrels();
+    doc_lengths.assign(forward_index.total_documents(), 0);
+
     for(size_t i = 0; i < forward_index.total_documents(); i++) {
         const auto* terms = forward_index.fetch_terms(i);
         if (terms) {
             for (size_t j = 0; j < terms->size(); j++) {
                 size_t wordID = (*terms)[j].first;
+                uint32_t freq = static_cast<uint32_t>((*terms)[j].second);
                 size_t barrelID = get_barrel_id(wordID);
-                auto &barrel = barrels[barrelID];
-                if (barrel[wordID].empty() || barrel[wordID].back() != i) {
-                    barrel[wordID].push_back(i);
+                auto &docs = lists[barrelID][wordID];
+                if (docs.empty() || docs.back().doc != i) {
+                    docs.push_back({static_cast<uint32_t>(i), freq});
                 }
+                doc_lengths[i] += freq;
             }
         }
     }
-    //After making inv_index, sort its documents list and remove suplicates
-    for (auto& barrelPair : barrels){
-        for (auto& [word_id, doc_list] : barrelPair.second) {
-            std::sort(doc_list.begin(), doc_list.end());
-            doc_list.erase(std::unique(doc_list.begin(), doc_list.end()), doc_list.end());
+
+    double total_length = 0.0;
+    for (uint32_t length : doc_lengths) total_length += length;
+    avg_doc_length = doc_lengths.empty() ? 0.0 : total_length / doc_lengths.size();
+
+    for (auto& barrelPair : lists) {
+        std::vector<std::pair<size_t, std::vector<Posting>>> vec;
+        vec.reserve(barrelPair.second.size());
+        for (auto& word : barrelPair.second) {
+            vec.emplace_back(word.first, std::move(word.second));
+        }
+        auto barrel = std::make_shared<Barrel>();
+        build_barrel(*barrel, vec, doc_lengths);
+        barrels[barrelPair.first] = std::move(barrel);
+    }
+}
+
+
+//flatten posting lists into a sorted directory + compressed postings blob.
+//Lists are sorted and de-duplicated here so every barrel source gives the same layout
+void InvertedIndex::build_barrel(Barrel& barrel, std::vector<std::pair<size_t, std::vector<Posting>>>& lists,
+                                 const std::vector<uint32_t>& doc_lengths)
+{
+    std::sort(lists.begin(), lists.end(), sort_by_word_id);
+
+    barrel.owned_dir.clear();
+    barrel.owned_postings.clear();
+    barrel.owned_dir.reserve(lists.size());
+
+    for (auto& [word_id, docs] : lists) {
+        std::sort(docs.begin(), docs.end(),
+                  [](const Posting& a, const Posting& b) { return a.doc < b.doc; });
+        docs.erase(std::unique(docs.begin(), docs.end(),
+                               [](const Posting& a, const Posting& b) { return a.doc == b.doc; }),
+                   docs.end());
+
+        DirEntry entry;
+        entry.word_id = static_cast<uint32_t>(word_id);
+        entry.count = static_cast<uint32_t>(docs.size());
+        entry.offset = barrel.owned_postings.size();
+        barrel.owned_dir.push_back(entry);
+        PostingList::encode(docs, doc_lengths, barrel.owned_postings);
+    }
+
+    barrel.file.close();
+    barrel.dir = barrel.owned_dir.data();
+    barrel.word_count = barrel.owned_dir.size();
+    barrel.owned_postings.shrink_to_fit();
+    barrel.postings = barrel.owned_postings.data();
+    barrel.postings_bytes = barrel.owned_postings.size();
+}
+
+
+PostingList InvertedIndex::fetch_doc_ids(size_t word_id) const
+{
+    size_t barrelID = get_barrel_id(word_id);
+
+    std::shared_ptr<Barrel> barrel;
+    if (lazy) {
+        barrel = acquire_barrel(barrelID);
+    } else {
+        auto barrelTarget = barrels.find(barrelID);
+        if (barrelTarget != barrels.end()) barrel = barrelTarget->second;
+    }
+    if (!barrel) return PostingList();
+
+    //binary search in the sorted directory
+    const DirEntry* first = barrel->dir;
+    const DirEntry* last = barrel->dir + barrel->word_count;
+    const DirEntry* wordTarget = std::lower_bound(first, last, word_id,
+        [](const DirEntry& e, size_t id) { return e.word_id < id; });
+    if (wordTarget == last || wordTarget->word_id != word_id) return PostingList();
+
+    return PostingList(barrel->postings + wordTarget->offset, wordTarget->count, barrel);
+}
+
+
+//lazy mode: return the cached barrel or fault it in, evicting LRU barrels over the budget.
+//The file is read without cache_mutex held, so queries on cached barrels never wait for a cold one
+std::shared_ptr<InvertedIndex::Barrel> InvertedIndex::acquire_barrel(size_t barrel_id) const
+{
+    std::promise<std::shared_ptr<Barrel>> loaded;
+    {
+        std::unique_lock<std::mutex> lock(cache_mutex);
+
+        auto cached = barrels.find(barrel_id);
+        if (cached != barrels.end()) {
+            stats.hits++;
+            lru.splice(lru.begin(), lru, lru_pos[barrel_id]);
+            return cached->second;
+        }
+
+        if (barrel_ids.count(barrel_id) == 0) return nullptr;
+        stats.misses++;
+
+        auto in_flight = loading.find(barrel_id);
+        if (in_flight != loading.end()) {
+            std::shared_future<std::shared_ptr<Barrel>> pending = in_flight->second;
+            lock.unlock();
+            return pending.get();
+        }
+        loading.emplace(barrel_id, loaded.get_future().share());
+    }
+
+    std::shared_ptr<Barrel> barrel;
+    try {
+        barrel = read_barrel(barrel_id, lazy_base_path, doc_lengths);
+    } catch (...) {
+        {
+            std::lock_guard<std::mutex> lock(cache_mutex);
+            loading.erase(barrel_id);
+        }
+        loaded.set_exception(std::current_exception());
+        throw;
     }
+
+    {
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        loading.erase(barrel_id);
+        if (barrel) cache_barrel(barrel_id, barrel);
     }
-    
+    loaded.set_value(barrel);
+    return barrel;
 }
 
 
-const std::vector<size_t>* InvertedIndex::fetch_doc_ids(size_t word_id) const 
+//lazy mode, cache_mutex held: make barrel the most recently used one (replacing a cached
+//barrel with the same id) and evict LRU barrels over the budget
+void InvertedIndex::cache_barrel(size_t barrel_id, const std::shared_ptr<Barrel>& barrel) const
 {
-    size_t barrelID = get_barrel_id(word_id);            
+    auto cached = barrels.find(barrel_id);
+    if (cached != barrels.end()) {
+        stats.resident_bytes -= cached->second->memory_bytes();
+        lru.erase(lru_pos[barrel_id]);
+    }
 
-    auto barrelTarget = barrels.find(barrelID);                 
-    if (barrelTarget == barrels.end()) return nullptr;           
+    barrels[barrel_id] = barrel;
+    lru.push_front(barrel_id);
+    lru_pos[barrel_id] = lru.begin();
+    stats.resident_bytes += barrel->memory_bytes();
 
-    auto wordTarget = barrelTarget->second.find(word_id);             
-    if (wordTarget == barrelTarget->second.end()) return nullptr;      
+    //never evict the barrel we are about to hand out
+    while (memory_budget > 0 && stats.resident_bytes > memory_budget && lru.size() > 1) {
+        size_t victim = lru.back();
+        lru.pop_back();
+        lru_pos.erase(victim);
 
-    return &wordTarget->second;
+        auto target = barrels.find(victim);
+        stats.resident_bytes -= target->second->memory_bytes();
+        barrels.erase(target);
+        stats.evictions++;
+    }
+
+    stats.resident_barrels = barrels.size();
 }
 
 
-void InvertedIndex::save_to_file(std::string basePath) 
+//snapshot of the loaded barrels by barrel_id (in lazy mode the cache changes under running queries)
+std::vector<std::pair<size_t, std::shared_ptr<InvertedIndex::Barrel>>> InvertedIndex::loaded_barrels() const
 {
-    for (const auto &barrel_pair : barrels) {
+    std::vector<std::pair<size_t, std::shared_ptr<Barrel>>> loaded;
+    {
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        loaded.assign(barrels.begin(), barrels.end());
+    }
+    std::sort(loaded.begin(), loaded.end(),
+              [](const auto& a, const auto& b) { return a.first < b.first; });
+    return loaded;
+}
+
+
+BarrelCacheStats InvertedIndex::cache_stats() const
+{
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    BarrelCacheStats current = stats;
+    if (!lazy) {
+        current.resident_barrels = barrels.size();
+        current.resident_bytes = 0;
+        for (const auto& barrel_pair : barrels) {
+            current.resident_bytes += barrel_pair.second->memory_bytes();
+        }
+    }
+    return current;
+}
+
+
+void InvertedIndex::reset_barrels()
+{
+    barrels.clear();
+    barrel_ids.clear();
+    lazy = false;
+    lazy_base_path.clear();
+    memory_budget = 0;
+    lru.clear();
+    lru_pos.clear();
+    loading.clear();
+    stats = BarrelCacheStats();
+    doc_lengths.clear();
+    avg_doc_length = 0.0;
+}
+
+
+size_t InvertedIndex::size() const
+{
+    size_t total = 0;
+    for (const auto& barrel_pair : loaded_barrels()) {
+        total += barrel_pair.second->word_count;
+    }
+    return total;
+}
+
+
+void InvertedIndex::save_to_file(std::string basePath)
+{
+    for (const auto &barrel_pair : loaded_barrels()) {
         size_t barrel_id = barrel_pair.first;
+        const Barrel& barrel = *barrel_pair.second;
         std::string file_name = basePath + "_barrel" + std::to_string(barrel_id) + ".csv";
         std::ofstream file(file_name);
         if (!file.is_open()) continue;
 
-        file << barrel_pair.second.size() << "\n";
-
-        std::vector<std::pair<size_t, std::vector<size_t>>> vec(
-            barrel_pair.second.begin(), barrel_pair.second.end());
-             std::sort(vec.begin(), vec.end(), sort_by_word_id);
+        file << barrel.word_count << "\n";
 
-        for (const auto &p : vec) {
-            file << p.first; 
-            for (const auto &doc_id : p.second) {
-                file << "," << doc_id;
+        //directory is already sorted by word_id
+        for (size_t i = 0; i < barrel.word_count; i++) {
+            const DirEntry& entry = barrel.dir[i];
+            file << entry.word_id;
+            PostingList list(barrel.postings + entry.offset, entry.count);
+            for (const Posting& posting : list.decode()) {
+                file << "," << posting.doc << ":" << posting.freq;
             }
             file << "\n";
         }
     }
+    save_doc_lengths(basePath);
 }
 
 
 
-bool InvertedIndex::load_from_file(std::string basePath) 
+bool InvertedIndex::load_from_file(std::string basePath)
 {
-    barrels.clear();  // Start fresh
+    reset_barrels();  // Start fresh
+
+    // Document lengths first, the barrels need them for their ranking bounds
+    load_doc_lengths(basePath);
 
     // Try loading barrel_0, barrel_1, barrel_2 ... until a file does NOT exist.
     for (size_t barrel_id = 0;; ++barrel_id) {
 
         std::string file_name = basePath + "_barrel" + std::to_string(barrel_id) + ".csv";
-        std::ifstream file(file_name);
+
+        auto barrel = std::make_shared<Barrel>();
 
         // Stop if this barrel file does NOT exist
-        if (!file.is_open())
+        if (!parse_csv_barrel(*barrel, file_name, doc_lengths))
             break;
 
-        std::unordered_map<size_t, std::vector<size_t>> barrel;
+        // Store barrel in main structure
+        barrels[barrel_id] = std::move(barrel);
+    }
+
+    // Return false if no files were loaded
+    return !barrels.empty();
+}
+
+
+bool InvertedIndex::parse_csv_barrel(Barrel& barrel, const std::string& file_name,
+                                     const std::vector<uint32_t>& doc_lengths)
+{
+    std::ifstream file(file_name);
+    if (!file.is_open())
+        return false;
+
+    std::vector<std::pair<size_t, std::vector<Posting>>> lists;
+
+    std::string line;
+
+    // First line contains the number of word entries — we ignore it
+    std::getline(file, line);
+
+    // Each following line contains:
+    // word_id,doc1:freq1,doc2:freq2,...
+    // (older barrels have no ":freq", those postings get freq 1)
+    while (std::getline(file, line)) {
+
+        std::istringstream ss(line);
+        std::string token;
+
+        // First token = word_id
+        std::getline(ss, token, ',');
+        size_t word_id = std::stoull(token);
+
+        // Rest are doc IDs with their term frequency
+        std::vector<Posting> docs;
+        while (std::getline(ss, token, ',')) {
+            Posting posting;
+            size_t colon = token.find(':');
+            posting.doc = static_cast<uint32_t>(std::stoull(token.substr(0, colon)));
+            posting.freq = colon == std::string::npos ? 1 : static_cast<uint32_t>(std::stoull(token.substr(colon + 1)));
+            docs.push_back(posting);
+        }
+
+        // Insert posting list into this barrel
+        lists.emplace_back(word_id, std::move(docs));
+    }
+
+    build_barrel(barrel, lists, doc_lengths);
+    return true;
+}
+
+
+//load a single barrel next to the ones already loaded
+//(in lazy mode it goes through the cache like a faulted in barrel and counts against the budget)
+bool InvertedIndex::load_barrel(size_t barrel_id, const std::string& basePath)
+{
+    std::shared_ptr<Barrel> barrel = read_barrel(barrel_id, basePath, doc_lengths);
+    if (!barrel)
+        return false;
+
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    if (lazy) {
+        barrel_ids.insert(barrel_id);
+        cache_barrel(barrel_id, barrel);
+    } else {
+        barrels[barrel_id] = std::move(barrel);
+    }
+    return true;
+}
+
+
+std::shared_ptr<InvertedIndex::Barrel> InvertedIndex::read_barrel(size_t barrel_id, const std::string& basePath,
+                                                                  const std::vector<uint32_t>& doc_lengths)
+{
+    std::string file_base = basePath + "_barrel" + std::to_string(barrel_id);
+    auto barrel = std::make_shared<Barrel>();
+
+    if (std::filesystem::exists(file_base + ".bin")) {
+        if (map_barrel(*barrel, file_base + ".bin"))
+            return barrel;
+        return nullptr;
+    }
+    if (parse_csv_barrel(*barrel, file_base + ".csv", doc_lengths))
+        return barrel;
+    return nullptr;
+}
+
+
+bool InvertedIndex::open_lazy(const std::string& basePath, size_t budget)
+{
+    reset_barrels();
 
-        std::string line;
+    // Only look for the files, nothing is read until a query needs it
+    for (size_t barrel_id = 0;; ++barrel_id) {
+        std::string file_base = basePath + "_barrel" + std::to_string(barrel_id);
+        if (!std::filesystem::exists(file_base + ".bin") && !std::filesystem::exists(file_base + ".csv"))
+            break;
+        barrel_ids.insert(barrel_id);
+    }
 
-        // First line contains the number of word entries — we ignore it
-        std::getline(file, line);
+    lazy = true;
+    lazy_base_path = basePath;
+    memory_budget = budget;
+    load_doc_lengths(basePath);
+    return !barrel_ids.empty();
+}
 
-        // Each following line contains:
-        // word_id,doc1,doc2,doc3,...
-        while (std::getline(file, line)) {
 
-            std::istringstream ss(line);
-            std::string token;
+bool InvertedIndex::save_binary(const std::string& basePath) const
+{
+    for (const auto &barrel_pair : loaded_barrels()) {
+        const Barrel& barrel = *barrel_pair.second;
+        std::string file_name = basePath + "_barrel" + std::to_string(barrel_pair.first) + ".bin";
+        std::string tmp_name = file_name + ".tmp";
+        {
+            std::ofstream file(tmp_name, std::ios::binary);
+            if (!file.is_open()) {
+                std::cerr << "Error: cannot create barrel file " << tmp_name << std::endl;
+                return false;
+            }
 
-            // First token = word_id
-            std::getline(ss, token, ',');
-            size_t word_id = std::stoull(token);
+            BarrelHeader header;
+            std::memcpy(header.magic, "INVB", 4);
+            header.version = BARREL_VERSION;
+            header.word_count = barrel.word_count;
+            header.postings_bytes = barrel.postings_bytes;
 
-            // Rest are doc IDs
-            std::vector<size_t> docs;
-            while (std::getline(ss, token, ',')) {
-                docs.push_back(std::stoull(token));
+            file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            file.write(reinterpret_cast<const char*>(barrel.dir), barrel.word_count * sizeof(DirEntry));
+            file.write(reinterpret_cast<const char*>(barrel.postings), barrel.postings_bytes);
+            if (!file) {
+                std::cerr << "Error: cannot write barrel file " << tmp_name << std::endl;
+                return false;
             }
+        }
+        //a running server may have the old barrel mapped, it must not be truncated under it
+        if (!MappedFile::replace(tmp_name, file_name)) return false;
+    }
+    return save_doc_lengths(basePath);
+}
 
-            // Insert posting list into this barrel
-            barrel[word_id] = std::move(docs);
+
+bool InvertedIndex::save_doc_lengths(const std::string& basePath) const
+{
+    if (doc_lengths.empty()) return true;
+
+    std::string file_name = basePath + "_doclens.bin";
+    std::string tmp_name = file_name + ".tmp";
+    {
+        std::ofstream file(tmp_name, std::ios::binary);
+        if (!file.is_open()) {
+            std::cerr << "Error: cannot create " << tmp_name << std::endl;
+            return false;
         }
 
-        // Store barrel in main structure
+        // Header: magic, version, number of documents, then one uint32 length per doc_id
+        uint32_t version = 1;
+        uint64_t count = doc_lengths.size();
+        file.write("DLEN", 4);
+        file.write(reinterpret_cast<const char*>(&version), sizeof(version));
+        file.write(reinterpret_cast<const char*>(&count), sizeof(count));
+        file.write(reinterpret_cast<const char*>(doc_lengths.data()), count * sizeof(uint32_t));
+        if (!file) {
+            std::cerr << "Error: cannot write " << tmp_name << std::endl;
+            return false;
+        }
+    }
+    //written next to the old file and renamed, like the barrels
+    return MappedFile::replace(tmp_name, file_name);
+}
+
+
+//document lengths are optional: an index without them ranks as if all docs had average length
+bool InvertedIndex::load_doc_lengths(const std::string& basePath)
+{
+    doc_lengths.clear();
+    avg_doc_length = 0.0;
+
+    std::string file_name = basePath + "_doclens.bin";
+    std::ifstream file(file_name, std::ios::binary);
+    if (!file.is_open()) return false;
+
+    char magic[4];
+    uint32_t version = 0;
+    uint64_t count = 0;
+    file.read(magic, 4);
+    file.read(reinterpret_cast<char*>(&version), sizeof(version));
+    file.read(reinterpret_cast<char*>(&count), sizeof(count));
+    if (!file || std::memcmp(magic, "DLEN", 4) != 0 || version != 1) return false;
+
+    //the count has to match the file before it sizes anything
+    std::error_code error;
+    uintmax_t file_size = std::filesystem::file_size(file_name, error);
+    size_t header_bytes = 4 + sizeof(version) + sizeof(count);
+    if (error || file_size < header_bytes || count != (file_size - header_bytes) / sizeof(uint32_t) ||
+        (file_size - header_bytes) % sizeof(uint32_t) != 0) {
+        std::cerr << "Error: " << file_name << " is truncated or corrupt" << std::endl;
+        return false;
+    }
+
+    doc_lengths.resize(count);
+    file.read(reinterpret_cast<char*>(doc_lengths.data()), count * sizeof(uint32_t));
+    if (!file) {
+        doc_lengths.clear();
+        return false;
+    }
+
+    double total_length = 0.0;
+    for (uint32_t length : doc_lengths) total_length += length;
+    avg_doc_length = doc_lengths.empty() ? 0.0 : total_length / doc_lengths.size();
+    return true;
+}
+
+
+//map one .bin barrel and check it before any query reads from it: the header has to agree
+//with the file size, the directory has to be sorted and every posting list has to fit in the postings blob
+bool InvertedIndex::map_barrel(Barrel& barrel, const std::string& file_name)
+{
+    if (!barrel.file.open(file_name)) return false;
+
+    const char* base = barrel.file.data();
+    size_t file_size = barrel.file.size();
+
+    BarrelHeader header;
+    if (file_size < sizeof(header)) return false;
+    std::memcpy(&header, base, sizeof(header));
+
+    if (std::memcmp(header.magic, "INVB", 4) != 0 || header.version != BARREL_VERSION) {
+        std::cerr << "Error: " << file_name << " is not a version " << BARREL_VERSION << " barrel" << std::endl;
+        return false;
+    }
+
+    //compared by division first so a corrupt word_count cannot overflow the sizes
+    size_t body = file_size - sizeof(header);
+    if (header.word_count > body / sizeof(DirEntry) ||
+        header.postings_bytes != body - header.word_count * sizeof(DirEntry)) {
+        std::cerr << "Error: " << file_name << " is truncated" << std::endl;
+        return false;
+    }
+
+    const DirEntry* dir = reinterpret_cast<const DirEntry*>(base + sizeof(header));
+    const uint8_t* postings = reinterpret_cast<const uint8_t*>(base + sizeof(header) + header.word_count * sizeof(DirEntry));
+    for (size_t i = 0; i < header.word_count; i++) {
+        bool sorted = i == 0 || dir[i - 1].word_id < dir[i].word_id;
+        if (!sorted || dir[i].offset >= header.postings_bytes ||
+            !PostingList::fits(postings + dir[i].offset, dir[i].count, header.postings_bytes - dir[i].offset)) {
+            std::cerr << "Error: " << file_name << " is truncated or corrupt" << std::endl;
+            return false;
+        }
+    }
+
+    barrel.dir = dir;
+    barrel.word_count = header.word_count;
+    barrel.postings = postings;
+    barrel.postings_bytes = header.postings_bytes;
+    return true;
+}
+
+
+bool InvertedIndex::map_from_file(const std::string& basePath)
+{
+    reset_barrels();
+
+    // Same discovery rule as the csv loader: barrel_0, barrel_1, ... until one is missing
+    for (size_t barrel_id = 0;; ++barrel_id) {
+        std::string file_name = basePath + "_barrel" + std::to_string(barrel_id) + ".bin";
+
+        // Stop if this barrel file does NOT exist
+        if (!std::filesystem::exists(file_name))
+            break;
+
+        auto barrel = std::make_shared<Barrel>();
+        if (!map_barrel(*barrel, file_name)) {
+            barrels.clear();
+            return false;
+        }
         barrels[barrel_id] = std::move(barrel);
     }
 
-    // Return false if no files were loaded
+    load_doc_lengths(basePath);
+
     return !barrels.empty();
-}
\ No newline at end of file
+}
+
+
+bool InvertedIndex::convert_csv_to_binary(const std::string& basePath)
+{
+    InvertedIndex index;
+    if (!index.load_from_file(basePath))
+        return false;
+    return index.save_binary(basePath);
+}
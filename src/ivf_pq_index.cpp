@@ -0,0 +1,403 @@
+#include "ivf_pq_index.hpp"
+#include "simd_kernels.hpp"
+#include "top_k.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <numeric>
+#include <random>
+
+namespace {
+
+//Lloyd's k-means over n vectors of dim floats (stride floats apart), k * dim centroids out.
+//Nearest centroid by L2, computed as min(|c|^2 - 2 x.c) so the dot product kernels do the work
+void kmeans(const float* data, size_t n, size_t dim, size_t stride, size_t k, size_t iterations,
+            std::mt19937& rng, std::vector<float>& centroids)
+{
+    std::uniform_int_distribution<size_t> pick(0, n - 1);
+
+    //start from k distinct random points (with repetition only if there are fewer than k)
+    std::vector<size_t> order(n);
+    std::iota(order.begin(), order.end(), 0);
+    std::shuffle(order.begin(), order.end(), rng);
+    centroids.assign(k * dim, 0.0f);
+    for (size_t c = 0; c < k; ++c) {
+        size_t p = c < n ? order[c] : pick(rng);
+        std::copy(data + p * stride, data + p * stride + dim, centroids.begin() + c * dim);
+    }
+
+    std::vector<float> norms(k);
+    std::vector<float> scores(k);
+    std::vector<double> sums(k * dim);
+    std::vector<size_t> counts(k);
+
+    for (size_t it = 0; it < iterations; ++it) {
+        for (size_t c = 0; c < k; ++c) {
+            norms[c] = dot_product(centroids.data() + c * dim, centroids.data() + c * dim, dim);
+        }
+        std::fill(sums.begin(), sums.end(), 0.0);
+        std::fill(counts.begin(), counts.end(), 0);
+
+        for (size_t p = 0; p < n; ++p) {
+            const float* x = data + p * stride;
+            dot_product_rows(x, centroids.data(), dim, dim, k, scores.data());
+
+            size_t best = 0;
+            float best_dist = std::numeric_limits<float>::max();
+            for (size_t c = 0; c < k; ++c) {
+                float d = norms[c] - 2.0f * scores[c];
+                if (d < best_dist) {
+                    best_dist = d;
+                    best = c;
+                }
+            }
+
+            counts[best]++;
+            double* sum = sums.data() + best * dim;
+            for (size_t j = 0; j < dim; ++j) sum[j] += x[j];
+        }
+
+        for (size_t c = 0; c < k; ++c) {
+            float* centroid = centroids.data() + c * dim;
+            if (counts[c] == 0) {
+                //empty cluster: restart it on a random point
+                size_t p = pick(rng);
+                std::copy(data + p * stride, data + p * stride + dim, centroid);
+                continue;
+            }
+            for (size_t j = 0; j < dim; ++j) centroid[j] = static_cast<float>(sums[c * dim + j] / counts[c]);
+        }
+    }
+}
+
+}
+
+void IvfPqIndex::clear()
+{
+    dimension = nlist = m = dsub = 0;
+    centroids.reset(0);
+    centroid_norms.clear();
+    codebooks.clear();
+    doc_ids.clear();
+    lists.clear();
+}
+
+size_t IvfPqIndex::memory_bytes() const
+{
+    size_t bytes = centroids.memory_bytes() + centroid_norms.capacity() * sizeof(float) +
+                   codebooks.capacity() * sizeof(float) + doc_ids.capacity() * sizeof(uint32_t);
+    for (const auto& list : lists) {
+        bytes += list.rows.capacity() * sizeof(uint32_t) + list.codes.capacity();
+    }
+    return bytes;
+}
+
+void IvfPqIndex::update_centroid_norms()
+{
+    centroid_norms.resize(nlist);
+    for (size_t c = 0; c < nlist; ++c) {
+        centroid_norms[c] = dot_product(centroids.row(c), centroids.row(c), dimension);
+    }
+}
+
+void IvfPqIndex::assign(const float* vectors, size_t stride, size_t count, std::vector<uint32_t>& out) const
+{
+    out.resize(count);
+    std::vector<float> scores(nlist);
+    for (size_t i = 0; i < count; ++i) {
+        dot_product_rows(vectors + i * stride, centroids.raw(), centroids.stride(), dimension, nlist, scores.data());
+
+        uint32_t best = 0;
+        float best_dist = std::numeric_limits<float>::max();
+        for (size_t c = 0; c < nlist; ++c) {
+            float d = centroid_norms[c] - 2.0f * scores[c];
+            if (d < best_dist) {
+                best_dist = d;
+                best = static_cast<uint32_t>(c);
+            }
+        }
+        out[i] = best;
+    }
+}
+
+void IvfPqIndex::encode(const float* residual, uint8_t* code) const
+{
+    for (size_t j = 0; j < m; ++j) {
+        const float* sub = residual + j * dsub;
+        const float* book = codebooks.data() + j * KSUB * dsub;
+
+        size_t best = 0;
+        float best_dist = std::numeric_limits<float>::max();
+        for (size_t c = 0; c < KSUB; ++c) {
+            const float* word = book + c * dsub;
+            float d = 0.0f;
+            for (size_t t = 0; t < dsub; ++t) {
+                float diff = sub[t] - word[t];
+                d += diff * diff;
+            }
+            if (d < best_dist) {
+                best_dist = d;
+                best = c;
+            }
+        }
+        code[j] = static_cast<uint8_t>(best);
+    }
+}
+
+bool IvfPqIndex::train(const EmbeddingMatrix& matrix, const IvfPqParams& params)
+{
+    clear();
+
+    size_t rows = matrix.rows();
+    if (rows == 0) {
+        std::cerr << "Error: no document embeddings to train on" << std::endl;
+        return false;
+    }
+    if (rows > std::numeric_limits<uint32_t>::max()) {
+        std::cerr << "Error: too many documents for an IVF-PQ index" << std::endl;
+        return false;
+    }
+    if (params.m == 0 || matrix.dim() % params.m != 0) {
+        std::cerr << "Error: " << params.m << " sub-quantizers do not divide dimension " << matrix.dim() << std::endl;
+        return false;
+    }
+
+    dimension = matrix.dim();
+    m = params.m;
+    dsub = dimension / m;
+    nlist = params.nlist ? params.nlist : static_cast<size_t>(4.0 * std::sqrt(static_cast<double>(rows)));
+    nlist = std::max<size_t>(1, std::min(nlist, rows));
+
+    std::mt19937 rng(params.seed);
+
+    //training sample, copied without the row padding
+    std::vector<size_t> sample(rows);
+    std::iota(sample.begin(), sample.end(), 0);
+    if (params.max_train > 0 && rows > params.max_train) {
+        std::shuffle(sample.begin(), sample.end(), rng);
+        sample.resize(params.max_train);
+    }
+    size_t n = sample.size();
+    std::vector<float> train_data(n * dimension);
+    for (size_t i = 0; i < n; ++i) {
+        std::copy(matrix.row(sample[i]), matrix.row(sample[i]) + dimension, train_data.begin() + i * dimension);
+    }
+
+    //coarse quantizer
+    std::vector<float> coarse;
+    kmeans(train_data.data(), n, dimension, dimension, nlist, params.iterations, rng, coarse);
+    centroids.reset(dimension);
+    centroids.reserve(nlist);
+    for (size_t c = 0; c < nlist; ++c) centroids.add_row(c, coarse.data() + c * dimension);
+    update_centroid_norms();
+
+    //sub-quantizers, trained on the residuals of the sample
+    std::vector<uint32_t> assignment;
+    assign(train_data.data(), dimension, n, assignment);
+    for (size_t i = 0; i < n; ++i) {
+        const float* centroid = centroids.row(assignment[i]);
+        float* x = train_data.data() + i * dimension;
+        for (size_t j = 0; j < dimension; ++j) x[j] -= centroid[j];
+    }
+
+    //a few dimensions per sub-quantizer: PQ_TRAIN_POINTS residuals are plenty for 256 centroids
+    std::vector<size_t> pq_sample(n);
+    std::iota(pq_sample.begin(), pq_sample.end(), 0);
+    if (n > PQ_TRAIN_POINTS) {
+        std::shuffle(pq_sample.begin(), pq_sample.end(), rng);
+        pq_sample.resize(PQ_TRAIN_POINTS);
+    }
+    size_t pq_n = pq_sample.size();
+
+    codebooks.assign(m * KSUB * dsub, 0.0f);
+    std::vector<float> sub_data(pq_n * dsub);
+    std::vector<float> book;
+    for (size_t j = 0; j < m; ++j) {
+        for (size_t i = 0; i < pq_n; ++i) {
+            const float* x = train_data.data() + pq_sample[i] * dimension + j * dsub;
+            std::copy(x, x + dsub, sub_data.begin() + i * dsub);
+        }
+        kmeans(sub_data.data(), pq_n, dsub, dsub, KSUB, params.iterations, rng, book);
+        std::copy(book.begin(), book.end(), codebooks.begin() + j * KSUB * dsub);
+    }
+
+    //encode every document into its list
+    lists.assign(nlist, InvertedList());
+    doc_ids.resize(rows);
+    std::vector<float> residual(dimension);
+    std::vector<uint8_t> code(m);
+    std::vector<uint32_t> nearest;
+    for (size_t row = 0; row < rows; ++row) {
+        doc_ids[row] = static_cast<uint32_t>(matrix.doc_id(row));
+
+        assign(matrix.row(row), matrix.stride(), 1, nearest);
+        const float* centroid = centroids.row(nearest[0]);
+        const float* x = matrix.row(row);
+        for (size_t j = 0; j < dimension; ++j) residual[j] = x[j] - centroid[j];
+        encode(residual.data(), code.data());
+
+        InvertedList& list = lists[nearest[0]];
+        list.rows.push_back(static_cast<uint32_t>(row));
+        list.codes.insert(list.codes.end(), code.begin(), code.end());
+    }
+
+    return true;
+}
+
+std::vector<std::pair<float, uint32_t>> IvfPqIndex::search(const float* query, size_t k, size_t nprobe) const
+{
+    std::vector<std::pair<float, uint32_t>> results;
+    if (empty() || k == 0) return results;
+
+    //lists whose centroids are closest to the query
+    std::vector<float> scores(nlist);
+    dot_product_rows(query, centroids.raw(), centroids.stride(), dimension, nlist, scores.data());
+    TopK<uint32_t> probes(std::max<size_t>(1, std::min(nprobe, nlist)));
+    for (size_t c = 0; c < nlist; ++c) {
+        probes.push(2.0 * scores[c] - centroid_norms[c], static_cast<uint32_t>(c));
+    }
+
+    //table[j * KSUB + c] = query sub-vector j . sub-centroid c of codebook j
+    std::vector<float> table(m * KSUB);
+    for (size_t j = 0; j < m; ++j) {
+        const float* sub = query + j * dsub;
+        const float* book = codebooks.data() + j * KSUB * dsub;
+        for (size_t c = 0; c < KSUB; ++c) {
+            float s = 0.0f;
+            for (size_t t = 0; t < dsub; ++t) s += sub[t] * book[c * dsub + t];
+            table[j * KSUB + c] = s;
+        }
+    }
+
+    TopK<uint32_t> best(k);
+    for (const auto& probe : probes.take_sorted()) {
+        uint32_t c = probe.second;
+        const InvertedList& list = lists[c];
+        float base = scores[c];
+
+        for (size_t i = 0; i < list.rows.size(); ++i) {
+            const uint8_t* code = list.codes.data() + i * m;
+            float s = base;
+            for (size_t j = 0; j < m; ++j) s += table[j * KSUB + code[j]];
+
+            if (best.would_accept(s, list.rows[i])) best.push(s, list.rows[i]);
+        }
+    }
+
+    for (const auto& entry : best.take_sorted()) {
+        results.emplace_back(static_cast<float>(entry.first), entry.second);
+    }
+    return results;
+}
+
+bool IvfPqIndex::save(const std::string& path) const
+{
+    if (empty()) {
+        std::cerr << "Error: no IVF-PQ index to save" << std::endl;
+        return false;
+    }
+
+    std::ofstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Error: cannot create " << path << std::endl;
+        return false;
+    }
+
+    FileHeader header;
+    std::memcpy(header.magic, "IVPQ", 4);
+    header.version = FILE_VERSION;
+    header.rows = doc_ids.size();
+    header.dim = static_cast<uint32_t>(dimension);
+    header.nlist = static_cast<uint32_t>(nlist);
+    header.m = static_cast<uint32_t>(m);
+    header.ksub = static_cast<uint32_t>(KSUB);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    for (size_t c = 0; c < nlist; ++c) {
+        file.write(reinterpret_cast<const char*>(centroids.row(c)), dimension * sizeof(float));
+    }
+    file.write(reinterpret_cast<const char*>(codebooks.data()), codebooks.size() * sizeof(float));
+    file.write(reinterpret_cast<const char*>(doc_ids.data()), doc_ids.size() * sizeof(uint32_t));
+
+    for (const auto& list : lists) {
+        uint64_t count = list.rows.size();
+        file.write(reinterpret_cast<const char*>(&count), sizeof(count));
+        file.write(reinterpret_cast<const char*>(list.rows.data()), count * sizeof(uint32_t));
+        file.write(reinterpret_cast<const char*>(list.codes.data()), list.codes.size());
+    }
+
+    return static_cast<bool>(file);
+}
+
+bool IvfPqIndex::load(const std::string& path)
+{
+    clear();
+
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Error: cannot open " << path << std::endl;
+        return false;
+    }
+
+    FileHeader header;
+    file.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!file || std::memcmp(header.magic, "IVPQ", 4) != 0 || header.version != FILE_VERSION) {
+        std::cerr << "Error: " << path << " is not a version " << FILE_VERSION << " IVF-PQ index" << std::endl;
+        return false;
+    }
+    if (header.ksub != KSUB || header.dim == 0 || header.m == 0 || header.dim % header.m != 0 ||
+        header.nlist == 0 || header.rows == 0 || header.rows > std::numeric_limits<uint32_t>::max()) {
+        std::cerr << "Error: " << path << " has an invalid header" << std::endl;
+        return false;
+    }
+
+    dimension = header.dim;
+    nlist = header.nlist;
+    m = header.m;
+    dsub = dimension / m;
+
+    std::vector<float> centroid(dimension);
+    centroids.reset(dimension);
+    centroids.reserve(nlist);
+    for (size_t c = 0; c < nlist && file; ++c) {
+        file.read(reinterpret_cast<char*>(centroid.data()), dimension * sizeof(float));
+        centroids.add_row(c, centroid.data());
+    }
+    update_centroid_norms();
+
+    codebooks.resize(m * KSUB * dsub);
+    file.read(reinterpret_cast<char*>(codebooks.data()), codebooks.size() * sizeof(float));
+    doc_ids.resize(header.rows);
+    file.read(reinterpret_cast<char*>(doc_ids.data()), doc_ids.size() * sizeof(uint32_t));
+
+    lists.assign(nlist, InvertedList());
+    size_t total = 0;
+    for (size_t c = 0; c < nlist && file; ++c) {
+        uint64_t count = 0;
+        file.read(reinterpret_cast<char*>(&count), sizeof(count));
+        if (!file || count > header.rows - total) {
+            file.setstate(std::ios::failbit);
+            break;
+        }
+        total += count;
+
+        InvertedList& list = lists[c];
+        list.rows.resize(count);
+        list.codes.resize(count * m);
+        file.read(reinterpret_cast<char*>(list.rows.data()), count * sizeof(uint32_t));
+        file.read(reinterpret_cast<char*>(list.codes.data()), list.codes.size());
+        for (uint32_t row : list.rows) {
+            if (row >= header.rows) file.setstate(std::ios::failbit);
+        }
+    }
+
+    if (!file || total != header.rows) {
+        std::cerr << "Error: " << path << " is truncated or corrupt" << std::endl;
+        clear();
+        return false;
+    }
+    return true;
+}
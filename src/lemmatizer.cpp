@@ -2,8 +2,79 @@
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <unordered_map>
+#include <vector>
+#include <cstdint>
 
-std::unordered_map<std::string, std::string> lemma_dict;
+namespace {
+
+//every loaded pair, the lookup table is rebuilt from it after a load
+std::unordered_map<std::string, std::string> lemma_source;
+
+//Frozen lookup table: all words and lemmas in one arena (each distinct lemma stored once),
+//found by open addressing on string_view keys so lookups never build a std::string
+struct LemmaTable {
+    struct Slot {
+        uint32_t word_offset = 0;
+        uint32_t word_length = 0;   // 0 = empty slot
+        uint32_t lemma_offset = 0;
+        uint32_t lemma_length = 0;
+    };
+
+    std::string arena;
+    std::vector<Slot> slots;
+    size_t mask = 0;
+
+    std::string_view word(const Slot& s) const { return std::string_view(arena.data() + s.word_offset, s.word_length); }
+    std::string_view lemma(const Slot& s) const { return std::string_view(arena.data() + s.lemma_offset, s.lemma_length); }
+
+    void build(const std::unordered_map<std::string, std::string>& pairs) {
+        arena.clear();
+        size_t capacity = 16;
+        while (capacity < pairs.size() * 2) capacity *= 2;
+        slots.assign(capacity, Slot());
+        mask = capacity - 1;
+
+        std::unordered_map<std::string_view, uint32_t> lemma_offsets;
+        size_t bytes = 0;
+        for (const auto& entry : pairs) bytes += entry.first.size() + entry.second.size();
+        arena.reserve(bytes);   // no reallocation below, so views into the arena stay valid
+
+        for (const auto& entry : pairs) {
+            Slot slot;
+            slot.word_offset = static_cast<uint32_t>(arena.size());
+            slot.word_length = static_cast<uint32_t>(entry.first.size());
+            arena += entry.first;
+
+            auto it = lemma_offsets.find(entry.second);
+            if (it == lemma_offsets.end()) {
+                uint32_t offset = static_cast<uint32_t>(arena.size());
+                arena += entry.second;
+                it = lemma_offsets.emplace(std::string_view(arena.data() + offset, entry.second.size()), offset).first;
+            }
+            slot.lemma_offset = it->second;
+            slot.lemma_length = static_cast<uint32_t>(entry.second.size());
+
+            size_t i = std::hash<std::string_view>()(entry.first) & mask;
+            while (slots[i].word_length != 0) i = (i + 1) & mask;
+            slots[i] = slot;
+        }
+    }
+
+    const Slot* find(std::string_view w) const {
+        if (slots.empty() || w.empty()) return nullptr;
+        size_t i = std::hash<std::string_view>()(w) & mask;
+        while (slots[i].word_length != 0) {
+            if (word(slots[i]) == w) return &slots[i];
+            i = (i + 1) & mask;
+        }
+        return nullptr;
+    }
+};
+
+LemmaTable lemma_table;
+
+}
 
 void load_lemmatizer(const std::string& filename) {
     std::ifstream file(filename);
@@ -16,15 +87,20 @@ void load_lemmatizer(const std::string& filename) {
     while (std::getline(file, line)) {
         std::istringstream iss(line);
         if (iss >> word >> lemma) {
-            lemma_dict[word] = lemma;
+            lemma_source[word] = lemma;
         }
     }
+    lemma_table.build(lemma_source);
 
-    std::cout << "Lemmatizer loaded. Total entries: " << lemma_dict.size() << "\n";
+    std::cout << "Lemmatizer loaded. Total entries: " << lemma_source.size() << "\n";
 }
 
 std::string lemmatize(const std::string& word) {
-    auto it = lemma_dict.find(word);
-    if (it != lemma_dict.end()) return it->second;
+    return std::string(lemmatize_view(word));
+}
+
+std::string_view lemmatize_view(std::string_view word) {
+    const auto* slot = lemma_table.find(word);
+    if (slot) return lemma_table.lemma(*slot);
     return word; // fallback
 }
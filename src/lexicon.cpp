@@ -1,18 +1,115 @@
 #include "lexicon.hpp"
 
 #include <algorithm>
+#include <cstring>
 #include <fstream>
 #include <iostream>
+#include <limits>
 #include <sstream>
 #include <vector>
 
-//comparator for sorting by frequency, used in savefile
-bool freq_compare(const std::pair<std::string, std::pair<size_t,size_t>>& a,
-                  const std::pair<std::string, std::pair<size_t,size_t>>& b) {
-    return a.second.second > b.second.second;
+//comparator for sorting by frequency, used in savefile (word id breaks ties so the file is reproducible)
+bool freq_compare(const std::pair<std::string_view, std::pair<size_t,size_t>>& a,
+                  const std::pair<std::string_view, std::pair<size_t,size_t>>& b) {
+    if (a.second.second != b.second.second) return a.second.second > b.second.second;
+    return a.second.first < b.second.first;
+}
+
+//FNV-1a, fixed so the table layout does not depend on the standard library
+uint64_t Lexicon::hash_word(std::string_view word) {
+    uint64_t h = 1469598103934665603ULL;
+    for (unsigned char c : word) {
+        h ^= c;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+size_t Lexicon::find_entry(std::string_view word) const {
+    if (slot_count == 0) return npos;
+    size_t mask = slot_count - 1;
+    for (size_t s = hash_word(word) & mask;; s = (s + 1) & mask) {
+        uint32_t entry = slots[s];
+        if (entry == 0) return npos;
+        if (entry_word(entry - 1) == word) return entry - 1;
+    }
+}
+
+void Lexicon::freeze() {
+    if (frozen) return;
+
+    std::vector<const std::pair<const std::string, std::pair<size_t,size_t>>*> entries;
+    entries.reserve(data.size());
+    size_t bytes = 0;
+    for (const auto& entry : data) {
+        entries.push_back(&entry);
+        bytes += entry.first.size();
+    }
+    std::sort(entries.begin(), entries.end(), [](const auto* a, const auto* b) { return a->first < b->first; });
+
+    owned_arena.clear();
+    owned_arena.reserve(bytes);
+    owned_offsets.assign(1, 0);
+    owned_offsets.reserve(entries.size() + 1);
+    owned_ids.clear();
+    owned_ids.reserve(entries.size());
+    owned_freqs.clear();
+    owned_freqs.reserve(entries.size());
+    for (const auto* entry : entries) {
+        owned_arena += entry->first;
+        owned_offsets.push_back(static_cast<uint32_t>(owned_arena.size()));
+        owned_ids.push_back(static_cast<uint32_t>(entry->second.first));
+        //frequencies beyond 32 bits are only ever compared, so saturating is enough
+        owned_freqs.push_back(static_cast<uint32_t>(std::min<size_t>(entry->second.second, std::numeric_limits<uint32_t>::max())));
+    }
+
+    arena = owned_arena.data();
+    offsets = owned_offsets.data();
+    ids = owned_ids.data();
+    freqs = owned_freqs.data();
+    word_count = entries.size();
+
+    //at most half full so probe runs stay short
+    slot_count = 16;
+    while (slot_count < word_count * 2) slot_count <<= 1;
+    owned_slots.assign(slot_count, 0);
+    for (size_t i = 0; i < word_count; ++i) {
+        size_t s = hash_word(entry_word(i)) & (slot_count - 1);
+        while (owned_slots[s] != 0) s = (s + 1) & (slot_count - 1);
+        owned_slots[s] = static_cast<uint32_t>(i + 1);
+    }
+    slots = owned_slots.data();
+    frozen = true;
+
+    data.clear();
+    data.rehash(0);
+}
+
+void Lexicon::release_frozen() {
+    owned_arena = std::string();
+    owned_offsets = std::vector<uint32_t>();
+    owned_ids = std::vector<uint32_t>();
+    owned_freqs = std::vector<uint32_t>();
+    owned_slots = std::vector<uint32_t>();
+    file.close();
+    arena = nullptr;
+    offsets = ids = freqs = slots = nullptr;
+    word_count = slot_count = 0;
+    frozen = false;
+}
+
+void Lexicon::thaw() {
+    if (!frozen) return;
+    data.reserve(word_count);
+    for (size_t i = 0; i < word_count; ++i) {
+        data.emplace(std::string(entry_word(i)), std::make_pair(size_t(ids[i]), size_t(freqs[i])));
+    }
+    release_frozen();
 }
 
 size_t Lexicon::add(const std::string& word, size_t count) {
+    thaw();
+
     auto target = data.find(word);
 
     if (target != data.end()) {
@@ -26,13 +123,18 @@ size_t Lexicon::add(const std::string& word, size_t count) {
 }
 
 //checks if a word is present in the lexicon or not
-bool Lexicon::present_in(const std::string& word) const {
-    return data.find(word) != data.end();
+bool Lexicon::present_in(std::string_view word) const {
+    if (frozen) return find_entry(word) != npos;
+    return data.find(std::string(word)) != data.end();
 }
 
 
-size_t Lexicon::getID(const std::string& word) const {
-    auto target = data.find(word);
+size_t Lexicon::getID(std::string_view word) const {
+    if (frozen) {
+        size_t i = find_entry(word);
+        return i != npos ? ids[i] : static_cast<size_t>(-1);
+    }
+    auto target = data.find(std::string(word));
     if (target != data.end()) {
         return target->second.first;
     }
@@ -40,14 +142,28 @@ size_t Lexicon::getID(const std::string& word) const {
 }
 
 
-size_t Lexicon::getFrequency(const std::string& word) const {
-    auto it = data.find(word);
+size_t Lexicon::getFrequency(std::string_view word) const {
+    if (frozen) {
+        size_t i = find_entry(word);
+        return i != npos ? freqs[i] : 0;
+    }
+    auto it = data.find(std::string(word));
     if (it != data.end()) {
         return it->second.second;
     }
     return 0;   // word not found
 }
 
+size_t Lexicon::memory_bytes() const {
+    size_t bytes = owned_arena.capacity()
+        + (owned_offsets.capacity() + owned_ids.capacity() + owned_freqs.capacity() + owned_slots.capacity()) * sizeof(uint32_t);
+    //rough cost of the build map: node + key + bucket pointer
+    for (const auto& entry : data) {
+        bytes += sizeof(void*) * 2 + sizeof(entry) + (entry.first.capacity() > 15 ? entry.first.capacity() + 1 : 0);
+    }
+    return bytes;
+}
+
 
 void Lexicon::save(const std::string& path) const {
     std::ofstream file(path);
@@ -55,8 +171,12 @@ void Lexicon::save(const std::string& path) const {
         std::cerr << "Error: cannot open file " << path << std::endl;
         return;
     }
-    //we convert hashmap to vector for sorting by frequency.
-    std::vector<std::pair<std::string, std::pair<size_t,size_t>>> vec(data.begin(), data.end());
+    //we collect the words into a vector for sorting by frequency.
+    std::vector<std::pair<std::string_view, std::pair<size_t,size_t>>> vec;
+    vec.reserve(size());
+    for_each_word([&](std::string_view word, size_t id, size_t freq) {
+        vec.push_back({ word, { id, freq } });
+    });
     std::sort(vec.begin(), vec.end(), freq_compare);
 
     for (const auto& entry : vec) {
@@ -96,24 +216,140 @@ bool Lexicon::load(const std::string& path) {
         }
     }
     file.close();
+
+    //a loaded lexicon is only read, keep it in the compact layout
+    freeze();
     return true;
 }
 
+bool Lexicon::save_binary(const std::string& path) const {
+    //the file is the frozen layout, so a lexicon still in build mode is frozen into a copy first
+    if (!frozen) {
+        Lexicon copy;
+        copy.data = data;
+        copy.next_id = next_id;
+        copy.freeze();
+        return copy.save_binary(path);
+    }
+
+    FileHeader header;
+    std::memcpy(header.magic, "LEXB", 4);
+    header.version = FILE_VERSION;
+    header.word_count = word_count;
+    header.slot_count = slot_count;
+    header.arena_bytes = offsets[word_count];
+    header.next_id = next_id;
+
+    //a running server may have lexicon.bin mapped: write next to it and rename over it
+    std::string tmp_path = path + ".tmp";
+    {
+        std::ofstream out(tmp_path, std::ios::binary);
+        if (!out.is_open()) {
+            std::cerr << "Error: cannot create lexicon file " << tmp_path << std::endl;
+            return false;
+        }
+
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(offsets), (word_count + 1) * sizeof(uint32_t));
+        out.write(reinterpret_cast<const char*>(ids), word_count * sizeof(uint32_t));
+        out.write(reinterpret_cast<const char*>(freqs), word_count * sizeof(uint32_t));
+        out.write(reinterpret_cast<const char*>(slots), slot_count * sizeof(uint32_t));
+        out.write(arena, header.arena_bytes);
+        if (!out) {
+            std::cerr << "Error: cannot write lexicon file " << tmp_path << std::endl;
+            return false;
+        }
+    }
+    return MappedFile::replace(tmp_path, path);
+}
+
+//map lexicon.bin and check the header, offsets and hash slots against it;
+//nothing is parsed or hashed, pages are read on first lookup
+bool Lexicon::map_from_file(const std::string& path) {
+    clear_lex();
+
+    //missing file is not reported, callers fall back to the csv lexicon
+    if (!file.open(path)) return false;
+
+    const char* base = file.data();
+    FileHeader header;
+    if (file.size() < sizeof(header)) {
+        std::cerr << "Error: " << path << " is truncated" << std::endl;
+        file.close();
+        return false;
+    }
+    std::memcpy(&header, base, sizeof(header));
+
+    if (std::memcmp(header.magic, "LEXB", 4) != 0 || header.version != FILE_VERSION) {
+        std::cerr << "Error: " << path << " is not a version " << FILE_VERSION << " lexicon" << std::endl;
+        file.close();
+        return false;
+    }
+
+    //counts are bounded by the file size first so the layout arithmetic cannot overflow
+    size_t words_max = file.size() / sizeof(uint32_t);
+    bool slots_ok = header.slot_count > header.word_count && (header.slot_count & (header.slot_count - 1)) == 0 &&
+                    header.slot_count <= words_max && header.arena_bytes <= file.size();
+    size_t arrays = (header.word_count + 1) + 2 * header.word_count + header.slot_count;
+    if (!slots_ok || file.size() != sizeof(header) + arrays * sizeof(uint32_t) + header.arena_bytes) {
+        std::cerr << "Error: " << path << " is truncated or corrupt" << std::endl;
+        file.close();
+        return false;
+    }
+
+    offsets = reinterpret_cast<const uint32_t*>(base + sizeof(header));
+    ids = offsets + header.word_count + 1;
+    freqs = ids + header.word_count;
+    slots = freqs + header.word_count;
+    arena = reinterpret_cast<const char*>(slots + header.slot_count);
+    //entries are read straight from the mapping: every word must lie inside the arena and
+    //every slot must be empty or name an entry, with at least one empty slot to end a probe
+    bool entries_ok = offsets[0] == 0 && offsets[header.word_count] == header.arena_bytes;
+    for (size_t i = 0; entries_ok && i < header.word_count; ++i) {
+        entries_ok = offsets[i] <= offsets[i + 1];
+    }
+    size_t used_slots = 0;
+    for (size_t i = 0; entries_ok && i < header.slot_count; ++i) {
+        if (slots[i] == 0) continue;
+        entries_ok = slots[i] <= header.word_count;
+        ++used_slots;
+    }
+    if (!entries_ok || used_slots > header.word_count) {
+        std::cerr << "Error: " << path << " is truncated or corrupt" << std::endl;
+        release_frozen();
+        return false;
+    }
+
+    word_count = header.word_count;
+    slot_count = header.slot_count;
+    next_id = header.next_id;
+    frozen = true;
+    return true;
+}
+
+bool Lexicon::convert_csv_to_binary(const std::string& csv_path, const std::string& bin_path) {
+    Lexicon lex;
+    if (!lex.load(csv_path)) return false;
+    return lex.save_binary(bin_path);
+}
+
 void Lexicon::show_statistics() const {
-    std::cout << "Total unique words in lexicon: " << data.size() << "\n";
+    std::cout << "Total unique words in lexicon: " << size() << "\n";
 
     size_t total_freq = 0;
-    for (const auto& entry : data)
-        total_freq += entry.second.second;
+    for_each_word([&](std::string_view, size_t, size_t freq) { total_freq += freq; });
 
-    double avg_freq = static_cast<double>(total_freq) / data.size();
+    double avg_freq = static_cast<double>(total_freq) / size();
 
     std::cout << "Total word occurrences (all documents): " << total_freq << "\n";
     std::cout << "Average frequency per word: " << avg_freq << "\n";
+    std::cout << "Memory used: " << memory_bytes() / 1024 << " KB"
+              << (file.is_open() ? " (mapped)" : frozen ? " (frozen)" : "") << "\n";
 }
 
 void Lexicon::clear_lex() 
 {
     data.clear();
+    release_frozen();
     next_id = 0;
-}
\ No newline at end of file
+}
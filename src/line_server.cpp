@@ -0,0 +1,346 @@
+#include "line_server.hpp"
+#include "thread_pool.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// a client line longer than this is not a command, the connection is dropped
+const std::size_t MAX_LINE = 1 << 20;
+
+#ifdef _WIN32
+
+const int SHUTDOWN_BOTH = SD_BOTH;
+
+bool sockets_ready()
+{
+    static bool ready = [] {
+        WSADATA data;
+        return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+    }();
+    return ready;
+}
+
+void close_socket(std::intptr_t s) { closesocket(static_cast<SOCKET>(s)); }
+
+#else
+
+const int SHUTDOWN_BOTH = SHUT_RDWR;
+
+bool sockets_ready() { return true; }
+
+void close_socket(std::intptr_t s) { ::close(static_cast<int>(s)); }
+
+#endif
+
+// send the whole buffer, false once the client is gone
+bool send_all(std::intptr_t s, const std::string& data)
+{
+    std::size_t sent = 0;
+    while (sent < data.size()) {
+#ifdef MSG_NOSIGNAL
+        // a client hanging up must not kill the server with SIGPIPE
+        auto n = ::send(s, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+#else
+        auto n = ::send(s, data.data() + sent, static_cast<int>(data.size() - sent), 0);
+#endif
+        if (n <= 0) return false;
+        sent += static_cast<std::size_t>(n);
+    }
+    return true;
+}
+
+// response for a command whose handler threw, with the request id of a tagged line
+// (like the handler's own responses) so the client waiting for it is not left hanging
+std::string error_response(const std::string& line)
+{
+    std::string response = "{";
+    if (line[0] == '#') {
+        response += "\"id\":\"";
+        for (char c : line.substr(1, line.find(' ') - 1)) {
+            if (c == '"' || c == '\\') response += '\\';
+            if (static_cast<unsigned char>(c) >= 0x20) response += c;
+        }
+        response += "\",";
+    }
+    return response + "\"error\":\"Internal error\"}";
+}
+
+// Reads commands with read_line(std::string&) until it returns false, EXIT or a failed
+// write(const std::string&); returns once every tagged command has been answered.
+// At most 4 tagged commands per pool worker are queued for one connection, reading
+// stops until some finish so a client cannot fill the pool (and memory) on its own.
+template <typename ReadLine, typename Write>
+void serve_lines(ReadLine read_line, Write write, const LineServer::Handler& handler, ThreadPool& pool)
+{
+    std::mutex write_mutex;
+    std::condition_variable idle;
+    std::size_t in_flight = 0;
+    const std::size_t max_in_flight = 4 * pool.size();
+    bool broken = false;  // the output failed, stop reading
+
+    // runs on a worker; responses of concurrent commands must not interleave
+    auto answer = [&](const std::string& line) {
+        std::string response;
+        try {
+            response = handler(line);
+        } catch (const std::exception& e) {
+            std::cerr << "Error: command failed: " << e.what() << std::endl;
+            response = error_response(line);
+        }
+        std::lock_guard<std::mutex> lock(write_mutex);
+        if (!broken && !write(response)) broken = true;
+    };
+
+    std::string line;
+    while (read_line(line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (line.empty()) continue;
+        if (line == "EXIT" || line.rfind("EXIT ", 0) == 0) break;
+
+        if (line[0] == '#') {
+            {
+                std::unique_lock<std::mutex> lock(write_mutex);
+                idle.wait(lock, [&] { return broken || in_flight < max_in_flight; });
+                if (broken) break;
+                ++in_flight;
+            }
+            pool.submit([&, line] {
+                answer(line);
+                std::lock_guard<std::mutex> lock(write_mutex);
+                --in_flight;
+                idle.notify_all();
+            });
+            continue;
+        }
+
+        pool.submit([&] { answer(line); }).get();
+        std::lock_guard<std::mutex> lock(write_mutex);
+        if (broken) break;
+    }
+
+    std::unique_lock<std::mutex> lock(write_mutex);
+    idle.wait(lock, [&] { return in_flight == 0; });
+}
+
+}
+
+LineServer::~LineServer()
+{
+    close_listener();
+}
+
+void LineServer::close_listener()
+{
+    if (listener != -1) {
+        close_socket(listener);
+        listener = -1;
+    }
+#ifndef _WIN32
+    if (!unix_path.empty()) {
+        ::unlink(unix_path.c_str());
+        unix_path.clear();
+    }
+#endif
+}
+
+bool LineServer::listen(const std::string& address)
+{
+    close_listener();
+    if (!sockets_ready()) {
+        std::cerr << "Error: sockets are not available" << std::endl;
+        return false;
+    }
+
+    if (address.rfind("unix:", 0) == 0) {
+#ifdef _WIN32
+        std::cerr << "Error: Unix sockets are not supported on this platform, use a TCP port" << std::endl;
+        return false;
+#else
+        std::string path = address.substr(5);
+        sockaddr_un addr{};
+        if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+            std::cerr << "Error: invalid Unix socket path " << path << std::endl;
+            return false;
+        }
+        addr.sun_family = AF_UNIX;
+        std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+
+        int s = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (s < 0) return false;
+        ::unlink(path.c_str());  // left over from a previous run
+        if (::bind(s, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || ::listen(s, SOMAXCONN) != 0) {
+            std::cerr << "Error: cannot listen on " << path << ": " << std::strerror(errno) << std::endl;
+            ::close(s);
+            return false;
+        }
+        listener = s;
+        unix_path = path;
+        bound_address = address;
+        return true;
+#endif
+    }
+
+    // TCP: "host:port" or just "port"
+    std::string host = "127.0.0.1";
+    std::string port = address;
+    std::size_t colon = address.rfind(':');
+    if (colon != std::string::npos) {
+        if (colon > 0) host = address.substr(0, colon);
+        port = address.substr(colon + 1);
+    }
+
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    addrinfo* found = nullptr;
+    if (::getaddrinfo(host.c_str(), port.c_str(), &hints, &found) != 0 || !found) {
+        std::cerr << "Error: cannot resolve " << address << std::endl;
+        return false;
+    }
+
+    for (addrinfo* ai = found; ai; ai = ai->ai_next) {
+        auto s = ::socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (static_cast<Socket>(s) == -1) continue;
+
+        int on = 1;
+        ::setsockopt(s, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&on), sizeof(on));
+        if (::bind(s, ai->ai_addr, static_cast<int>(ai->ai_addrlen)) == 0 && ::listen(s, SOMAXCONN) == 0) {
+            listener = static_cast<Socket>(s);
+            break;
+        }
+        close_socket(static_cast<Socket>(s));
+    }
+    ::freeaddrinfo(found);
+
+    if (listener == -1) {
+        std::cerr << "Error: cannot listen on " << address << std::endl;
+        return false;
+    }
+    bound_address = host + ":" + port;
+    return true;
+}
+
+void LineServer::join_finished_readers()
+{
+    std::vector<std::thread> done;
+    {
+        std::lock_guard<std::mutex> lock(clients_mutex);
+        for (std::size_t id : finished_readers) {
+            auto it = readers.find(id);
+            done.push_back(std::move(it->second));
+            readers.erase(it);
+        }
+        finished_readers.clear();
+    }
+    for (auto& reader : done) reader.join();
+}
+
+void LineServer::run(const Handler& handler, std::size_t threads)
+{
+    if (listener == -1) return;
+
+    ThreadPool pool(threads);
+    stopping = false;
+
+    while (!stopping) {
+        // leave further clients in the backlog while max_connections are served
+        {
+            std::unique_lock<std::mutex> lock(clients_mutex);
+            clients_done.wait(lock, [this] { return stopping || clients.size() < max_connections; });
+        }
+        join_finished_readers();
+        if (stopping) break;
+
+        auto accepted = ::accept(listener, nullptr, nullptr);
+        Socket client = static_cast<Socket>(accepted);
+        if (client == -1) {
+            if (stopping) break;
+            continue;  // interrupted or a client that already left
+        }
+
+        if (unix_path.empty()) {
+            // answers are single small writes, do not hold them back waiting for more
+            int on = 1;
+            ::setsockopt(accepted, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&on), sizeof(on));
+        }
+
+        // reader: split the stream into lines, tagged commands overlap on the pool
+        std::lock_guard<std::mutex> lock(clients_mutex);
+        clients.insert(client);
+        std::size_t id = next_reader++;
+        readers.emplace(id, std::thread([this, id, client, &handler, &pool] {
+            std::string buffer;
+            auto read_line = [&](std::string& line) {
+                char chunk[4096];
+                std::size_t newline;
+                while ((newline = buffer.find('\n')) == std::string::npos) {
+                    auto n = ::recv(client, chunk, sizeof(chunk), 0);
+                    if (n <= 0 || buffer.size() > MAX_LINE) return false;
+                    buffer.append(chunk, static_cast<std::size_t>(n));
+                }
+                line.assign(buffer, 0, newline);
+                buffer.erase(0, newline + 1);
+                return true;
+            };
+            auto write = [client](const std::string& response) {
+                return send_all(client, response + '\n');
+            };
+            serve_lines(read_line, write, handler, pool);
+
+            std::lock_guard<std::mutex> lock(clients_mutex);
+            clients.erase(client);
+            close_socket(client);
+            finished_readers.push_back(id);
+            clients_done.notify_all();
+        }));
+    }
+
+    // wake the readers blocked in recv and join them before the pool they use goes away
+    std::unordered_map<std::size_t, std::thread> remaining;
+    {
+        std::lock_guard<std::mutex> lock(clients_mutex);
+        for (Socket client : clients) ::shutdown(client, SHUTDOWN_BOTH);
+        remaining.swap(readers);
+        finished_readers.clear();
+    }
+    for (auto& reader : remaining) reader.second.join();
+}
+
+void LineServer::stop()
+{
+    stopping = true;
+    // unblocks accept() in run()
+    if (listener != -1) ::shutdown(listener, SHUTDOWN_BOTH);
+    std::lock_guard<std::mutex> lock(clients_mutex);
+    for (Socket client : clients) ::shutdown(client, SHUTDOWN_BOTH);
+    clients_done.notify_all();  // run() may be waiting for a free connection slot
+}
+
+void LineServer::serve_stream(std::istream& in, std::ostream& out, const Handler& handler, std::size_t threads)
+{
+    ThreadPool pool(threads);
+    auto read_line = [&in](std::string& line) { return static_cast<bool>(std::getline(in, line)); };
+    auto write = [&out](const std::string& response) {
+        out << response << '\n';
+        out.flush();
+        return static_cast<bool>(out);
+    };
+    serve_lines(read_line, write, handler, pool);
+}
@@ -7,6 +7,7 @@
 #include "inverted_index.hpp"
 #include "lemmatizer.hpp"
 #include "semantic_search.hpp"
+#include "spell_corrector.hpp"
 
 int main()
 {
@@ -19,19 +20,26 @@ int main()
     SearchEngine engine;
     AutoComplete autocomplete;
     SemanticSearch semantic_search;
+    SpellCorrector speller;
 
-    // Load indexes
-    if (!lex.load("D:/searchEngine/indices/lexicon.csv")) {
+    // Load indexes (binary lexicon if it was built, csv otherwise)
+    if (!lex.map_from_file("D:/searchEngine/indices/lexicon.bin") &&
+        !lex.load("D:/searchEngine/indices/lexicon.csv")) {
         std::cerr << "Failed to load lexicon\n";
         return 1;
     }
+    autocomplete.build(lex);
+    speller.build(lex, 2, 7, 2);
+    engine.set_spell_corrector(&speller);
 
     if (!fwd.load_from_file("D:/searchEngine/indices/forward_index.txt")) {
         std::cerr << "Failed to load forward index\n";
         return 1;
     }
 
-    if (!inv.load_from_file("D:/searchEngine/indices/inverted_index")) {
+    // Prefer mmap-able binary barrels, fall back to the csv barrels
+    if (!inv.map_from_file("D:/searchEngine/indices/inverted_index") &&
+        !inv.load_from_file("D:/searchEngine/indices/inverted_index")) {
         std::cerr << "Failed to load inverted index\n";
         return 1;
     }
@@ -49,6 +57,7 @@ int main()
         std::cerr << "Make sure you have created this file first!\n";
         return 1;
     }
+    semantic_search.prune_embeddings(lex);
     std::cout << "Loading document embeddings...\n";
     
     if (!semantic_search.load_document_embeddings("D:/searchEngine/embedding/doc_embeddings.bin")) {
@@ -56,6 +65,9 @@ int main()
         std::cerr << "Make sure you have created this file first!\n";
         return 1;
     }
+    if (!semantic_search.load_ann_index("D:/searchEngine/embedding/doc_embeddings_hnsw.bin")) {
+        std::cout << "No HNSW index found, using exact semantic search.\n";
+    }
     
 
 
@@ -94,7 +106,11 @@ int main()
         }
         
         // ---- SEMANTIC SEARCH MODE ----
-        auto semantic_results = semantic_search.semantic_search(input, lex, fwd, 10);
+        std::string corrected = speller.correct_query(input, lex);
+        if (corrected != input) {
+            std::cout << "Showing results for: " << corrected << "\n";
+        }
+        auto semantic_results = semantic_search.semantic_search(corrected, lex, fwd, 10);
         std::cout << "\n=== SEMANTIC SEARCH RESULTS ===\n";
         for (size_t i = 0; i < semantic_results.size(); ++i) {
             std::cout << (i + 1) << ". " << semantic_results[i].title <<"\n";
@@ -1,6 +1,10 @@
 #include <iostream>
 #include <string>
 #include <sstream>
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
 #include "searching.hpp"
 #include "auto_complete.hpp"
 #include "lexicon.hpp"
@@ -8,57 +12,170 @@
 #include "inverted_index.hpp"
 #include "lemmatizer.hpp"
 #include "semantic_search.hpp"
+#include "spell_corrector.hpp"
+#include "line_server.hpp"
+#include "http_server.hpp"
+#include "thread_pool.hpp"
 
-void print_json_error(const std::string& message) {
-    std::cout << "{\"error\":\"" << message << "\"}" << std::endl;
+// Quotes and backslashes escaped, for strings the client sent back to it
+std::string json_escape(const std::string& text) {
+    std::string out;
+    for (char c : text) {
+        if (c == '"') out += "\\\"";
+        else if (c == '\\') out += "\\\\";
+        else out += c;
+    }
+    return out;
+}
+
+// Responses are single JSON lines, built as strings so they can go to stdout or a socket
+std::string format_json_error(const std::string& message) {
+    return "{\"error\":\"" + message + "\"}";
 }
 
-void print_autocomplete_results(const std::vector<std::string>& suggestions) {
-    std::cout << "{\"suggestions\":[";
+std::string format_autocomplete_results(const std::vector<std::string>& suggestions) {
+    std::ostringstream out;
+    out << "{\"suggestions\":[";
     for (size_t i = 0; i < suggestions.size(); ++i) {
-        std::cout << "\"" << suggestions[i] << "\"";
-        if (i < suggestions.size() - 1) std::cout << ",";
+        out << "\"" << suggestions[i] << "\"";
+        if (i < suggestions.size() - 1) out << ",";
     }
-    std::cout << "]}" << std::endl;
-    std::cout.flush();
+    out << "]}";
+    return out.str();
 }
 
-void print_search_results(const std::vector<SemanticResult>& results) {
-    std::cout << "{\"results\":[";
+// {"semantic_cache":{...},"bm25_cache":{...},"barrel_cache":{...}}
+std::string format_cache_stats(const CacheStats& semantic, const CacheStats& bm25, const BarrelCacheStats& barrels) {
+    auto format = [](const CacheStats& stats) {
+        std::ostringstream out;
+        out << "{\"hits\":" << stats.hits << ",\"misses\":" << stats.misses
+            << ",\"hit_rate\":" << stats.hit_rate() << ",\"entries\":" << stats.entries
+            << ",\"capacity\":" << stats.capacity << ",\"evictions\":" << stats.evictions
+            << ",\"expirations\":" << stats.expirations << "}";
+        return out.str();
+    };
+    // barrels loaded on first use with --lazy-barrels (all resident, no hits or misses otherwise)
+    std::ostringstream barrel_cache;
+    barrel_cache << "{\"hits\":" << barrels.hits << ",\"misses\":" << barrels.misses
+                 << ",\"evictions\":" << barrels.evictions << ",\"resident_barrels\":" << barrels.resident_barrels
+                 << ",\"resident_bytes\":" << barrels.resident_bytes << "}";
+    return "{\"semantic_cache\":" + format(semantic) + ",\"bm25_cache\":" + format(bm25)
+        + ",\"barrel_cache\":" + barrel_cache.str() + "}";
+}
+
+// corrected_query: the query that was actually searched, if the spelling of the input was corrected
+std::string format_search_results(const std::vector<SemanticResult>& results, const std::string& corrected_query = "") {
+    std::ostringstream out;
+    out << "{";
+    if (!corrected_query.empty()) {
+        out << "\"corrected_query\":\"" << json_escape(corrected_query) << "\",";
+    }
+    out << "\"results\":[";
     for (size_t i = 0; i < results.size(); ++i) {
         const auto& r = results[i];
-        std::cout << "{";
-        std::cout << "\"title\":\"";
+        out << "{";
+        out << "\"title\":\"";
         // Escape quotes in title
         for (char c : r.title) {
-            if (c == '"') std::cout << "\\\"";
-            else if (c == '\\') std::cout << "\\\\";
-            else if (c == '\n') std::cout << "\\n";
-            else if (c == '\r') std::cout << "\\r";
-            else if (c == '\t') std::cout << "\\t";
-            else std::cout << c;
-        }
-        std::cout << "\",";
-        std::cout << "\"score\":" << r.score << ",";
-        std::cout << "\"url\":\"";
+            if (c == '"') out << "\\\"";
+            else if (c == '\\') out << "\\\\";
+            else if (c == '\n') out << "\\n";
+            else if (c == '\r') out << "\\r";
+            else if (c == '\t') out << "\\t";
+            else out << c;
+        }
+        out << "\",";
+        out << "\"score\":" << r.score << ",";
+        out << "\"url\":\"";
         // Escape quotes in URL
         for (char c : r.url) {
-            if (c == '"') std::cout << "\\\"";
-            else if (c == '\\') std::cout << "\\\\";
-            else std::cout << c;
+            if (c == '"') out << "\\\"";
+            else if (c == '\\') out << "\\\\";
+            else out << c;
         }
-        std::cout << "\"";
-        std::cout << "}";
-        if (i < results.size() - 1) std::cout << ",";
+        out << "\"";
+        out << "}";
+        if (i < results.size() - 1) out << ",";
     }
-    std::cout << "]}" << std::endl;
-    std::cout.flush();
+    out << "]}";
+    return out.str();
 }
 
-int main()
+int main(int argc, char* argv[])
 {
     // Base path for all data files
     const std::string BASE_PATH = "D:/searchEngine/";
+
+    // --lazy-barrels [MB]: load inverted index barrels on first use,
+    // keeping at most MB megabytes of them resident (no limit if omitted)
+    // --ef-search N: HNSW candidate list size for semantic search (recall vs speed)
+    // --exact-semantic: ignore the HNSW graph and score every document
+    // --pq [nprobe]: semantic search on the IVF-PQ index instead of the full document embeddings
+    // --pq-rerank N: re-score the best N IVF-PQ candidates from the mapped doc_embeddings.bin
+    // --listen ADDRESS: serve clients on a socket instead of stdin ("port", "host:port" or "unix:/path")
+    // --http ADDRESS: serve /api/search and /api/autocomplete over HTTP ("port" or "host:port")
+    // --threads N: worker threads answering clients (default one per core)
+    // --max-connections N: --listen clients served at once, the rest wait to be accepted (default 256)
+    // --cache N: cached query results (default 1024, 0 = off)
+    // --cache-ttl SECONDS: age after which a cached result is recomputed (default 300, 0 = never)
+    // --scan-threads N: threads sharing the full semantic scan of one query (default 1, 0 = all cores;
+    //   more lowers the latency of a query, fewer leaves more cores to concurrent queries)
+    // --precision f32|f16|i8: storage of the word and document embeddings (f16 / i8 scan
+    //   2x / 4x fewer bytes per query, without the HNSW graph)
+    bool lazy_barrels = false;
+    size_t barrel_budget_mb = 0;
+    size_t ef_search = 0;
+    bool exact_semantic = false;
+    bool use_pq = false;
+    size_t nprobe = 0;
+    size_t pq_rerank = 0;
+    std::string listen_address;
+    std::string http_address;
+    size_t server_threads = 0;
+    size_t max_connections = 256;
+    size_t cache_entries = 1024;
+    long cache_ttl = 300;
+    VectorPrecision precision = VectorPrecision::Float32;
+    size_t scan_threads = 1;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--lazy-barrels") {
+            lazy_barrels = true;
+            if (i + 1 < argc && std::isdigit(static_cast<unsigned char>(argv[i + 1][0]))) {
+                barrel_budget_mb = std::stoull(argv[++i]);
+            }
+        } else if (arg == "--ef-search" && i + 1 < argc) {
+            ef_search = std::stoull(argv[++i]);
+        } else if (arg == "--exact-semantic") {
+            exact_semantic = true;
+        } else if (arg == "--pq") {
+            use_pq = true;
+            if (i + 1 < argc && std::isdigit(static_cast<unsigned char>(argv[i + 1][0]))) {
+                nprobe = std::stoull(argv[++i]);
+            }
+        } else if (arg == "--pq-rerank" && i + 1 < argc) {
+            pq_rerank = std::stoull(argv[++i]);
+        } else if (arg == "--listen" && i + 1 < argc) {
+            listen_address = argv[++i];
+        } else if (arg == "--http" && i + 1 < argc) {
+            http_address = argv[++i];
+        } else if (arg == "--threads" && i + 1 < argc) {
+            server_threads = std::stoull(argv[++i]);
+        } else if (arg == "--max-connections" && i + 1 < argc) {
+            max_connections = std::stoull(argv[++i]);
+        } else if (arg == "--cache" && i + 1 < argc) {
+            cache_entries = std::stoull(argv[++i]);
+        } else if (arg == "--cache-ttl" && i + 1 < argc) {
+            cache_ttl = std::stol(argv[++i]);
+        } else if (arg == "--scan-threads" && i + 1 < argc) {
+            scan_threads = std::stoull(argv[++i]);
+        } else if (arg == "--precision" && i + 1 < argc) {
+            if (!parse_precision(argv[++i], precision)) {
+                std::cerr << "Unknown precision " << argv[i] << " (f32, f16 or i8)" << std::endl;
+                return 1;
+            }
+        }
+    }
     
     std::cerr << "Starting CORD-19 Search Server..." << std::endl;
     
@@ -72,13 +189,24 @@ int main()
     SearchEngine engine;
     AutoComplete autocomplete;
     SemanticSearch semantic_search;
+    SpellCorrector speller;
 
+    // Prefer the mmap-able binary lexicon, fall back to the csv lexicon
     std::cerr << "Loading lexicon..." << std::endl;
-    if (!lex.load(BASE_PATH + "indices/lexicon.csv")) {
+    if (!lex.map_from_file(BASE_PATH + "indices/lexicon.bin") &&
+        !lex.load(BASE_PATH + "indices/lexicon.csv")) {
         std::cerr << "Failed to load lexicon" << std::endl;
         return 1;
     }
 
+    std::cerr << "Building autocomplete trie..." << std::endl;
+    autocomplete.build(lex);
+
+    // words seen once are mostly typos themselves, they are not offered as corrections
+    std::cerr << "Building spelling index..." << std::endl;
+    speller.build(lex, 2, 7, 2);
+    engine.set_spell_corrector(&speller);
+
     std::cerr << "Loading forward index..." << std::endl;
     if (!fwd.load_from_file(BASE_PATH + "indices/forward_index.txt")) {
         std::cerr << "Failed to load forward index" << std::endl;
@@ -86,7 +214,15 @@ int main()
     }
 
     std::cerr << "Loading inverted index..." << std::endl;
-    if (!inv.load_from_file(BASE_PATH + "indices/inverted_index")) {
+    if (lazy_barrels) {
+        if (!inv.open_lazy(BASE_PATH + "indices/inverted_index", barrel_budget_mb * 1024 * 1024)) {
+            std::cerr << "Failed to find inverted index barrels" << std::endl;
+            return 1;
+        }
+    }
+    // Prefer mmap-able binary barrels, fall back to the csv barrels
+    else if (!inv.map_from_file(BASE_PATH + "indices/inverted_index") &&
+             !inv.load_from_file(BASE_PATH + "indices/inverted_index")) {
         std::cerr << "Failed to load inverted index" << std::endl;
         return 1;
     }
@@ -103,24 +239,60 @@ int main()
         std::cerr << "Cannot load GloVe embeddings" << std::endl;
         return 1;
     }
+    // only lexicon words can match a document, queries look their vectors up by word_id
+    semantic_search.prune_embeddings(lex, precision);
 
-    std::cerr << "Loading document embeddings..." << std::endl;
-    if (!semantic_search.load_document_embeddings(BASE_PATH + "embedding/doc_embeddings.bin")) {
-        std::cerr << "Cannot load document embeddings" << std::endl;
-        return 1;
+    if (use_pq) {
+        std::cerr << "Loading IVF-PQ index..." << std::endl;
+        if (!semantic_search.load_pq_index(BASE_PATH + "embedding/doc_embeddings_ivfpq.bin")) {
+            std::cerr << "Cannot load IVF-PQ index" << std::endl;
+            return 1;
+        }
+        if (nprobe > 0) semantic_search.set_nprobe(nprobe);
+        if (pq_rerank > 0) {
+            if (semantic_search.open_rerank_vectors(BASE_PATH + "embedding/doc_embeddings.bin")) {
+                semantic_search.set_rerank_candidates(pq_rerank);
+            } else {
+                std::cerr << "Cannot map document embeddings, IVF-PQ scores are not re-ranked" << std::endl;
+            }
+        }
+    } else {
+        std::cerr << "Loading document embeddings..." << std::endl;
+        if (!semantic_search.load_document_embeddings(BASE_PATH + "embedding/doc_embeddings.bin")) {
+            std::cerr << "Cannot load document embeddings" << std::endl;
+            return 1;
+        }
+
+        // Approximate semantic search if the HNSW graph was built (main_tools build-hnsw);
+        // reduced precision always scans every document, the graph walks the float32 rows
+        if (precision != VectorPrecision::Float32) {
+            if (!semantic_search.set_document_precision(precision)) return 1;
+        } else if (!exact_semantic && !semantic_search.load_ann_index(BASE_PATH + "embedding/doc_embeddings_hnsw.bin")) {
+            std::cerr << "No HNSW index, semantic search scans all documents" << std::endl;
+        }
+        semantic_search.set_use_ann(!exact_semantic);
+        semantic_search.set_scan_threads(scan_threads);
+        if (ef_search > 0) semantic_search.set_ef_search(ef_search);
     }
 
-    std::cerr << "Server ready! Waiting for queries..." << std::endl;
-    std::cout << "{\"status\":\"ready\"}" << std::endl;
-    std::cout.flush();
+    // Repeated queries skip the search (the indexes are never reloaded while serving)
+    semantic_search.set_result_cache(cache_entries, std::chrono::seconds(cache_ttl));
+    engine.set_result_cache(cache_entries, std::chrono::seconds(cache_ttl));
 
-    // Main server loop - read queries from stdin
-    std::string line;
-    while (std::getline(std::cin, line)) {
-        if (line.empty()) continue;
-        
-        // Parse command: "SEARCH query" or "AUTOCOMPLETE query"
-        std::istringstream iss(line);
+    // Both protocols only read the loaded indexes, so requests can run on several threads at once
+    auto run_search = [&](const std::string& query) -> std::string {
+        // misspelled terms are searched as their correction
+        std::string corrected = speller.correct_query(query, lex);
+        auto semantic_results = semantic_search.semantic_search(corrected, lex, fwd, 10);
+        return format_search_results(semantic_results, corrected != query ? corrected : "");
+    };
+    auto run_autocomplete = [&](const std::string& query) -> std::string {
+        return format_autocomplete_results(autocomplete.suggest(query, lex, 10));
+    };
+
+    // "SEARCH query", "AUTOCOMPLETE query" or "STATS" -> one JSON response
+    auto run_command = [&](const std::string& text) -> std::string {
+        std::istringstream iss(text);
         std::string command;
         iss >> command;
         
@@ -131,21 +303,126 @@ int main()
             query = query.substr(1);
         }
 
-        if (command == "SEARCH") {
-            auto semantic_results = semantic_search.semantic_search(query, lex, fwd, 10);
-            print_search_results(semantic_results);
+        if (command == "SEARCH") return run_search(query);
+        if (command == "AUTOCOMPLETE") return run_autocomplete(query);
+        if (command == "STATS") return format_cache_stats(semantic_search.result_cache_stats(), engine.result_cache_stats(), inv.cache_stats());
+        return format_json_error("Invalid command. Use SEARCH, AUTOCOMPLETE, STATS, BATCH, or EXIT");
+    };
+
+    // One command line -> one response line:
+    //   [#id] SEARCH query | AUTOCOMPLETE query | STATS | BATCH command<TAB>command...
+    // A request id is echoed as the "id" field of the response, LineServer lets
+    // tagged commands run concurrently. BATCH answers its commands in order as
+    // {"responses":[...]}, one round trip for all of them
+    auto handle_command = [&](const std::string& line) -> std::string {
+        std::string id;
+        std::string text = line;
+        if (!text.empty() && text[0] == '#') {
+            std::size_t space = text.find(' ');
+            id = text.substr(1, space == std::string::npos ? std::string::npos : space - 1);
+            text = space == std::string::npos ? "" : text.substr(space + 1);
+        }
+
+        std::string response;
+        if (text.rfind("BATCH", 0) == 0 && (text.size() == 5 || text[5] == ' ')) {
+            response = "{\"responses\":[";
+            std::size_t begin = std::min<std::size_t>(6, text.size());
+            bool first = true;
+            while (begin < text.size()) {
+                std::size_t tab = text.find('\t', begin);
+                if (tab == std::string::npos) tab = text.size();
+                std::string command = text.substr(begin, tab - begin);
+                if (!command.empty()) {
+                    if (!first) response += ",";
+                    response += run_command(command);
+                    first = false;
+                }
+                begin = tab + 1;
+            }
+            response += "]}";
+        } else {
+            response = run_command(text);
+        }
+
+        if (!line.empty() && line[0] == '#') {
+            response = "{\"id\":\"" + json_escape(id) + "\"," + response.substr(1);
+        }
+        return response;
+    };
+
+    // The endpoints of web/server.js, with the same response bodies
+    auto handle_http = [&](const HttpRequest& request) -> HttpResponse {
+        HttpResponse response;
+        if (request.path == "/api/health") {
+            response.body = "{\"status\":\"ready\"}";
+            return response;
+        }
+        if (request.path == "/api/stats") {
+            response.body = format_cache_stats(semantic_search.result_cache_stats(), engine.result_cache_stats(), inv.cache_stats());
+            return response;
+        }
+        if (request.path != "/api/search" && request.path != "/api/autocomplete") {
+            response.status = 404;
+            response.body = format_json_error("Not found");
+            return response;
+        }
+
+        const std::string& query = request.param("q");
+        if (query.empty()) {
+            response.status = 400;
+            response.body = format_json_error("Query parameter \\\"q\\\" is required");
+            return response;
         }
-        else if (command == "AUTOCOMPLETE") {
-            auto suggestions = autocomplete.suggest(query, lex, 10);
-            print_autocomplete_results(suggestions);
+
+        if (request.path == "/api/autocomplete") {
+            response.body = run_autocomplete(query);
+            return response;
         }
-        else if (command == "EXIT") {
-            std::cerr << "Server shutting down..." << std::endl;
-            break;
+
+        auto start = std::chrono::steady_clock::now();
+        response.body = run_search(query);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        char elapsed[32];
+        std::snprintf(elapsed, sizeof(elapsed), "%.3f", ms);
+        response.body.pop_back();  // the closing '}'
+        response.body += ",\"search_time_ms\":\"" + std::string(elapsed) + "\"}";
+        return response;
+    };
+
+    // HTTP mode: main_server answers the web page directly, web/server.js is not needed
+    if (!http_address.empty()) {
+        HttpServer server;
+        if (!server.listen(http_address)) {
+            return 1;
         }
-        else {
-            print_json_error("Invalid command. Use SEARCH, AUTOCOMPLETE, or EXIT");
+        std::cerr << "Serving HTTP on " << server.address() << " with "
+                  << (server_threads ? server_threads : ThreadPool::default_threads()) << " worker threads" << std::endl;
+        std::cout << "{\"status\":\"ready\"}" << std::endl;
+        server.run(handle_http, server_threads);
+        return 0;
+    }
+
+    // Socket mode: every client connection speaks the same line protocol,
+    // commands of all clients run on a pool of worker threads
+    if (!listen_address.empty()) {
+        LineServer server;
+        server.set_max_connections(max_connections);
+        if (!server.listen(listen_address)) {
+            return 1;
         }
+        std::cerr << "Listening on " << server.address() << " with "
+                  << (server_threads ? server_threads : ThreadPool::default_threads()) << " worker threads" << std::endl;
+        std::cout << "{\"status\":\"ready\"}" << std::endl;
+        server.run(handle_command, server_threads);
+        return 0;
     }
+
+    std::cerr << "Server ready! Waiting for queries..." << std::endl;
+    std::cout << "{\"status\":\"ready\"}" << std::endl;
+    std::cout.flush();
+
+    // Main server loop - read queries from stdin, tagged ones run on the worker pool
+    LineServer::serve_stream(std::cin, std::cout, handle_command, server_threads);
+    std::cerr << "Server shutting down..." << std::endl;
     return 0;
-}
\ No newline at end of file
+}
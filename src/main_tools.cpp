@@ -0,0 +1,754 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <cmath>
+#include <cstdint>
+#include <cctype>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <filesystem>
+#include <memory>
+#include "inverted_index.hpp"
+#include "forward_index.hpp"
+#include "semantic_search.hpp"
+#include "searching.hpp"
+#include "simd_kernels.hpp"
+#include "top_k.hpp"
+#include "MetaDataParser.hpp"
+#include "lemmatizer.hpp"
+#include "thread_pool.hpp"
+#include "text_processing.hpp"
+
+// Offline maintenance commands for the index files.
+// Usage: main_tools <command> [args...]
+
+void print_usage()
+{
+    std::cerr << "Usage:\n";
+    std::cerr << "  main_tools index [data_dir] [indices_dir] [max_docs] [--threads N]\n";
+    std::cerr << "      parse metadata.csv + full texts into lexicon, forward index and barrels\n";
+    std::cerr << "      (N worker threads, default all cores; the output does not depend on N)\n";
+    std::cerr << "  main_tools convert-barrels [inverted_index_base]\n";
+    std::cerr << "      rewrite <base>_barrelN.csv as mmap-able <base>_barrelN.bin\n";
+    std::cerr << "  main_tools convert-lexicon [lexicon.csv] [lexicon.bin]\n";
+    std::cerr << "      rewrite the csv lexicon as the mmap-able binary lexicon\n";
+    std::cerr << "  main_tools convert-glove [glove.txt|old glove_embeddings.bin] [glove_embeddings.bin]\n";
+    std::cerr << "      write the word embeddings in the layout main_server maps instead of reading\n";
+    std::cerr << "  main_tools build-embeddings [indices_dir] [glove_embeddings.bin] [doc_embeddings.bin] [--threads N]\n";
+    std::cerr << "      rebuild the document embeddings from the forward index (N threads, default all cores)\n";
+    std::cerr << "  main_tools build-barrels [forward_index.txt] [inverted_index_base]\n";
+    std::cerr << "      rebuild csv + binary barrels (with term frequencies and document lengths)\n";
+    std::cerr << "  main_tools build-hnsw [doc_embeddings.bin] [hnsw.bin] [M] [ef_construction]\n";
+    std::cerr << "      build the HNSW graph used for approximate semantic search\n";
+    std::cerr << "  main_tools bench-hnsw [doc_embeddings.bin] [hnsw.bin] [queries] [k]\n";
+    std::cerr << "      recall@k and query time of HNSW against exact search for several ef_search values\n";
+    std::cerr << "  main_tools build-ivfpq [doc_embeddings.bin] [ivfpq.bin] [nlist] [m]\n";
+    std::cerr << "      train the IVF-PQ index used for compressed semantic search (nlist 0 = 4*sqrt(docs))\n";
+    std::cerr << "  main_tools bench-ivfpq [doc_embeddings.bin] [ivfpq.bin] [queries] [k] [rerank]\n";
+    std::cerr << "      recall@k and query time of IVF-PQ against exact search for several nprobe values\n";
+    std::cerr << "  main_tools bench-precision [doc_embeddings.bin] [queries] [k]\n";
+    std::cerr << "      recall@k, memory and scan time of f16 and i8 document embeddings against f32\n";
+    std::cerr << "  main_tools check-tokenizer [text_file] [max_mb]\n";
+    std::cerr << "      byte for byte parity of the SIMD text kernels and the tokenizer with the per byte\n";
+    std::cerr << "      reference, on generated text and the first max_mb (default 16) of text_file\n";
+    std::cerr << "  main_tools check-wand [queries] [docs]\n";
+    std::cerr << "      Block-Max WAND against exhaustive BM25 OR ranking on a synthetic index (default 2000\n";
+    std::cerr << "      queries, 20000 docs), before and after a save_binary / map_from_file round trip\n";
+}
+
+// Benchmark queries: random documents with gaussian noise added, so they are
+// close to the data but never an exact copy of an indexed row.
+// Also computes the exact top-k rows of every query, returns the full scan time per query in us.
+struct BenchQueries {
+    std::vector<std::vector<float>> vectors;
+    std::vector<std::vector<size_t>> truth;
+    double exact_us = 0.0;
+};
+
+BenchQueries make_bench_queries(const EmbeddingMatrix& docs, size_t num_queries, size_t k)
+{
+    BenchQueries queries;
+    size_t dim = docs.dim();
+    std::mt19937 rng(7);
+    std::uniform_int_distribution<size_t> pick(0, docs.rows() - 1);
+    // noise of about half the length of a (unit) document vector
+    std::normal_distribution<float> noise(0.0f, 0.5f / std::sqrt(static_cast<float>(dim)));
+
+    queries.vectors.assign(num_queries, std::vector<float>(dim));
+    for (auto& q : queries.vectors) {
+        const float* doc = docs.row(pick(rng));
+        double norm = 0.0;
+        for (size_t j = 0; j < dim; ++j) {
+            q[j] = doc[j] + noise(rng);
+            norm += static_cast<double>(q[j]) * q[j];
+        }
+        norm = std::sqrt(norm);
+        if (norm > 1e-10) {
+            for (float& v : q) v /= static_cast<float>(norm);
+        }
+    }
+
+    queries.truth.resize(num_queries);
+    std::vector<float> similarities(docs.rows());
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < num_queries; ++i) {
+        dot_product_rows(queries.vectors[i].data(), docs.raw(), docs.stride(), dim, docs.rows(), similarities.data());
+        TopK<size_t> best(k);
+        for (size_t row = 0; row < docs.rows(); ++row) best.push(similarities[row], row);
+        for (const auto& entry : best.take_sorted()) queries.truth[i].push_back(entry.second);
+    }
+    queries.exact_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() /
+                       num_queries;
+
+    std::cout << docs.rows() << " documents, " << num_queries << " queries, k=" << k
+              << ", kernel " << simd_kernel_name() << "\n";
+    std::cout << "exact: " << queries.exact_us << " us/query\n";
+    return queries;
+}
+
+// fraction of the exact top-k rows found by search(query vector) -> (score, row) list,
+// printed with the time per query
+template <typename Search>
+void report_recall(const BenchQueries& queries, size_t k, const std::string& label, Search search)
+{
+    size_t hits = 0;
+    size_t expected = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < queries.vectors.size(); ++i) {
+        auto found = search(queries.vectors[i].data());
+        for (size_t row : queries.truth[i]) {
+            ++expected;
+            for (const auto& entry : found) {
+                if (entry.second == row) {
+                    ++hits;
+                    break;
+                }
+            }
+        }
+    }
+    double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() /
+                queries.vectors.size();
+
+    std::cout << label << ": recall@" << k << " " << (expected ? static_cast<double>(hits) / expected : 1.0)
+              << ", " << us << " us/query\n";
+}
+
+// recall@k of the HNSW graph against a full scan, for increasing ef_search
+int bench_hnsw(const EmbeddingMatrix& docs, const HnswIndex& graph, size_t num_queries, size_t k)
+{
+    BenchQueries queries = make_bench_queries(docs, num_queries, k);
+
+    for (size_t ef : {10, 20, 40, 80, 160, 320, 640}) {
+        if (ef < k) continue;
+        report_recall(queries, k, "ef_search " + std::to_string(ef), [&](const float* q) {
+            return graph.search(docs, q, k, ef);
+        });
+    }
+    return 0;
+}
+
+// recall@k of the IVF-PQ index against a full scan, for increasing nprobe,
+// with the approximate scores and with the best rerank candidates re-scored exactly
+int bench_ivfpq(const EmbeddingMatrix& docs, const IvfPqIndex& index, size_t num_queries, size_t k, size_t rerank)
+{
+    std::cout << "IVF-PQ: " << index.list_count() << " lists, " << index.code_size() << " bytes per code, "
+              << index.memory_bytes() / 1024 << " KB vs " << docs.rows() * docs.dim() * sizeof(float) / 1024
+              << " KB of float embeddings\n";
+
+    BenchQueries queries = make_bench_queries(docs, num_queries, k);
+    size_t candidates = std::max(rerank, k);
+
+    for (size_t nprobe : {1, 2, 4, 8, 16, 32, 64}) {
+        if (nprobe > index.list_count()) break;
+
+        report_recall(queries, k, "nprobe " + std::to_string(nprobe), [&](const float* q) {
+            return index.search(q, k, nprobe);
+        });
+        if (rerank == 0) continue;
+
+        report_recall(queries, k, "nprobe " + std::to_string(nprobe) + " + rerank " + std::to_string(candidates),
+                      [&](const float* q) {
+            TopK<uint32_t> best(k);
+            for (const auto& entry : index.search(q, candidates, nprobe)) {
+                best.push(dot_product(q, docs.row(entry.second), docs.dim()), entry.second);
+            }
+            return best.take_sorted();
+        });
+    }
+    return 0;
+}
+
+// recall@k, memory and full scan time of the document embeddings stored as half floats
+// and as int8, against the float32 scan
+int bench_precision(const EmbeddingMatrix& docs, size_t num_queries, size_t k)
+{
+    BenchQueries queries = make_bench_queries(docs, num_queries, k);
+    std::cout << "f32: " << docs.memory_bytes() / 1024 << " KB\n";
+
+    for (VectorPrecision precision : {VectorPrecision::Float16, VectorPrecision::Int8}) {
+        QuantizedMatrix reduced;
+        reduced.assign(docs, precision);
+        std::cout << precision_name(precision) << ": " << reduced.memory_bytes() / 1024 << " KB, kernel "
+                  << (precision == VectorPrecision::Float16 ? f16_kernel_name() : i8_kernel_name()) << "\n";
+
+        std::vector<float> similarities(reduced.rows());
+        report_recall(queries, k, precision_name(precision), [&](const float* q) {
+            reduced.score_rows(q, 0, reduced.rows(), similarities.data());
+            TopK<size_t> best(k);
+            for (size_t row = 0; row < reduced.rows(); ++row) best.push(similarities[row], row);
+            return best.take_sorted();
+        });
+    }
+    return 0;
+}
+
+// The tokenizer as it was before the SIMD front end (std::isalpha / std::tolower per byte,
+// split with a stringstream), kept as the reference for check-tokenizer
+std::vector<std::string> reference_tokenize(const std::string& text)
+{
+    std::string clean;
+    clean.reserve(text.size());
+    for (char ch : text) {
+        if (std::isalpha(static_cast<unsigned char>(ch))) {
+            clean += static_cast<char>(std::tolower(static_cast<unsigned char>(ch)));
+        } else {
+            clean += ' ';
+        }
+    }
+    std::stringstream ss(clean);
+    std::string word;
+    std::vector<std::string> tokens;
+    while (ss >> word) {
+        if (word.size() < 3) continue;
+        if (is_stopword(word)) continue;
+        tokens.push_back(lemmatize(word));
+    }
+    return tokens;
+}
+
+// Every text kernel against std::isalpha / std::tolower on n bytes at text,
+// including the letter bits past n (which have to be clear). Returns the number of mismatches
+size_t check_classifiers(const char* text, size_t n)
+{
+    std::vector<char> expected_lower(n);
+    std::vector<uint64_t> expected_bits((n + 63) / 64, 0);
+    for (size_t i = 0; i < n; ++i) {
+        unsigned char ch = static_cast<unsigned char>(text[i]);
+        bool letter = std::isalpha(ch) != 0;
+        expected_lower[i] = letter ? static_cast<char>(std::tolower(ch)) : text[i];
+        if (letter) expected_bits[i / 64] |= uint64_t(1) << (i % 64);
+    }
+
+    size_t mismatches = 0;
+    std::vector<char> lower(n);
+    std::vector<uint64_t> bits((n + 63) / 64);
+    for (const char* kernel : {"scalar", "sse2", "avx2"}) {
+        std::fill(bits.begin(), bits.end(), ~uint64_t(0));
+        if (!classify_letters_with(kernel, text, n, lower.data(), bits.data())) continue;
+        if (lower != expected_lower || bits != expected_bits) {
+            std::cout << "  " << kernel << " differs on " << n << " bytes\n";
+            ++mismatches;
+        }
+    }
+    return mismatches;
+}
+
+// for_each_token against reference_tokenize, returns 1 on a mismatch (printed with label)
+size_t check_tokenizer(const std::string& text, const std::string& label)
+{
+    std::vector<std::string> expected = reference_tokenize(text);
+    std::vector<std::string> tokens;
+    for_each_token(text, [&](std::string_view token) { tokens.emplace_back(token); });
+
+    if (tokens == expected) {
+        if (!label.empty()) std::cout << label << ": " << tokens.size() << " tokens match\n";
+        return 0;
+    }
+    size_t i = 0;
+    while (i < tokens.size() && i < expected.size() && tokens[i] == expected[i]) ++i;
+    std::cout << label << ": token " << i << " differs ("
+              << (i < tokens.size() ? tokens[i] : "<end>") << " vs reference "
+              << (i < expected.size() ? expected[i] : "<end>") << ")\n";
+    return 1;
+}
+
+int check_tokenizer_parity(const std::string& corpus_path, size_t max_bytes)
+{
+    std::cout << "text kernel " << text_kernel_name() << "\n";
+    std::mt19937 rng(11);
+    size_t failures = 0;
+
+    // every byte value, and the bytes next to the letter ranges, at every length and alignment
+    std::string edges;
+    for (int c = 0; c < 256; ++c) edges += static_cast<char>(c);
+    for (int round = 0; round < 4; ++round) {
+        for (char c : std::string("@AZ[`az{\x80\xc1\xda\xe1\xfa\xff 09")) edges += c;
+    }
+    std::string random_bytes(1 << 20, '\0');
+    for (char& c : random_bytes) c = static_cast<char>(rng());
+    for (const std::string* input : {&edges, &random_bytes}) {
+        for (size_t offset = 0; offset < 64; ++offset) {
+            for (size_t n = 0; n + offset <= std::min<size_t>(input->size(), 300); ++n) {
+                failures += check_classifiers(input->data() + offset, n);
+            }
+        }
+    }
+    failures += check_classifiers(random_bytes.data(), random_bytes.size());
+    failures += check_classifiers(random_bytes.data() + 3, random_bytes.size() - 3);
+    std::cout << "classify_letters: " << (failures ? "MISMATCH" : "all kernels match") << "\n";
+
+    // words of mixed case between punctuation and non-ASCII bytes, stopwords, short words,
+    // and words longer than a block, so tokens cross TOKEN_BLOCK boundaries
+    const std::string pieces[] = {"The", "virus", "RESPIRATORY", "infections", "of", "a", "an", "ab",
+                                  "Cells", "however", "don't", "caf\xc3\xa9", "na\xefve", "x-ray",
+                                  "COVID19", "sars-cov-2", "\xff\xfe", "\t", "\n", ", ", ". "};
+    std::string generated;
+    while (generated.size() < (4 << 20)) {
+        if (rng() % 500 == 0) {
+            generated += std::string(TOKEN_BLOCK + rng() % 100, static_cast<char>('a' + rng() % 26));
+        } else {
+            generated += pieces[rng() % (sizeof(pieces) / sizeof(pieces[0]))];
+        }
+        generated += rng() % 3 ? " " : "";
+    }
+    failures += check_tokenizer(generated, "generated text");
+    failures += check_tokenizer(random_bytes, "random bytes");
+
+    std::ifstream corpus(corpus_path, std::ios::binary);
+    if (corpus.is_open()) {
+        std::string sample(max_bytes, '\0');
+        corpus.read(&sample[0], static_cast<std::streamsize>(max_bytes));
+        sample.resize(static_cast<size_t>(corpus.gcount()));
+        failures += check_tokenizer(sample, corpus_path);
+
+        // line by line as well, so every line start is a block start once
+        std::istringstream lines(sample);
+        std::string line;
+        size_t line_failures = 0;
+        while (std::getline(lines, line) && line_failures == 0) {
+            line_failures += check_tokenizer(line, "");
+        }
+        failures += line_failures;
+    } else {
+        std::cout << "no corpus at " << corpus_path << ", corpus sample skipped\n";
+    }
+
+    std::cout << (failures ? "FAILED" : "OK") << "\n";
+    return failures ? 1 : 0;
+}
+
+// Synthetic collection for check-wand: zipf distributed words whose ids span two barrels,
+// documents of a few to a few hundred tokens, so popular lists run over many blocks
+void build_synthetic_index(size_t docs, size_t vocabulary, std::mt19937& rng, ForwardIndex& fwd, InvertedIndex& inv)
+{
+    std::vector<double> weights(vocabulary);
+    for (size_t rank = 0; rank < vocabulary; ++rank) weights[rank] = 1.0 / (rank + 1);
+    std::discrete_distribution<size_t> word(weights.begin(), weights.end());
+    std::uniform_int_distribution<size_t> length(3, 400);
+    std::vector<std::string> names(vocabulary);
+    for (size_t rank = 0; rank < vocabulary; ++rank) names[rank] = "w" + std::to_string(rank * 17);
+
+    for (size_t d = 0; d < docs; ++d) {
+        std::unordered_map<std::string, std::pair<size_t, size_t>> word_map;
+        for (size_t n = length(rng); n > 0; --n) {
+            size_t rank = word(rng);
+            auto& entry = word_map[names[rank]];
+            entry.first = rank * 17;
+            entry.second++;
+        }
+        fwd.register_document("doc" + std::to_string(d), word_map);
+    }
+    inv.add_from_forward(fwd);
+}
+
+// Exhaustive BM25 OR ranking, the reference for check-wand: every posting of every query term
+// is scored with the textbook formula (default BM25Params); scores gets the score of every document
+std::vector<std::pair<double, size_t>> exhaustive_or_top_k(const std::vector<size_t>& word_ids,
+                                                            const std::vector<std::vector<Posting>>& lists,
+                                                            const InvertedIndex& inv, size_t top_k,
+                                                            std::vector<double>& scores)
+{
+    BM25Params bm25;
+    double total_docs = static_cast<double>(inv.total_documents());
+    double avg_length = inv.average_doc_length();
+    std::fill(scores.begin(), scores.end(), 0.0);
+    for (size_t word_id : word_ids) {
+        const std::vector<Posting>& postings = lists[word_id];
+        double df = static_cast<double>(postings.size());
+        double idf = std::log(1.0 + (total_docs - df + 0.5) / (df + 0.5));
+        for (const Posting& posting : postings) {
+            double tf = posting.freq;
+            double norm = bm25.k1 * (1.0 - bm25.b + bm25.b * inv.doc_length(posting.doc) / avg_length);
+            scores[posting.doc] += idf * tf * (bm25.k1 + 1.0) / (tf + norm);
+        }
+    }
+
+    TopK<size_t> best(top_k);
+    for (size_t doc = 0; doc < scores.size(); ++doc) {
+        if (scores[doc] > 0.0) best.push(scores[doc], doc);
+    }
+    return best.take_sorted();
+}
+
+// WAND against the reference: the same score at every rank and the reported score of every
+// returned document equal to its exhaustive score, both within rounding (documents tied on
+// score may come back in another order). Returns 1 on a mismatch (printed with label)
+size_t compare_rankings(const std::vector<std::pair<double, size_t>>& got,
+                        const std::vector<std::pair<double, size_t>>& expected,
+                        const std::vector<double>& scores, const std::string& label)
+{
+    auto close = [](double a, double b) { return std::fabs(a - b) <= 1e-9 * std::max(1.0, std::fabs(b)); };
+    bool same = got.size() == expected.size();
+    for (size_t i = 0; same && i < got.size(); ++i) {
+        same = close(got[i].first, expected[i].first) && close(got[i].first, scores[got[i].second]);
+    }
+    if (same) return 0;
+
+    std::cout << label << ": WAND returned " << got.size() << " documents, exhaustive " << expected.size() << "\n";
+    for (size_t i = 0; i < std::max(got.size(), expected.size()); ++i) {
+        std::cout << "  " << i << ": ";
+        if (i < got.size()) std::cout << got[i].second << " " << got[i].first;
+        std::cout << " vs ";
+        if (i < expected.size()) std::cout << expected[i].second << " " << expected[i].first;
+        std::cout << "\n";
+    }
+    return 1;
+}
+
+int check_wand(size_t num_queries, size_t docs)
+{
+    const size_t VOCABULARY = 3000;
+    std::mt19937 rng(7);
+    ForwardIndex fwd;
+    InvertedIndex inv;
+    build_synthetic_index(docs, VOCABULARY, rng, fwd, inv);
+
+    // decoded once, word_id -> postings (empty for the ids between the synthetic words)
+    std::vector<std::vector<Posting>> lists(VOCABULARY * 17);
+    size_t total_postings = 0;
+    for (size_t word_id = 0; word_id < lists.size(); word_id += 17) {
+        lists[word_id] = inv.fetch_doc_ids(word_id).decode();
+        total_postings += lists[word_id].size();
+    }
+    std::cout << "synthetic index: " << docs << " documents, " << inv.size() << " words, "
+              << total_postings << " postings\n";
+
+    // the same index written as binary barrels and mapped back
+    std::filesystem::path dir = std::filesystem::temp_directory_path() / "main_tools_check_wand";
+    std::filesystem::create_directories(dir);
+    std::string base = (dir / "inverted_index").string();
+    auto mapped = std::make_unique<InvertedIndex>();
+    size_t failures = 0;
+    if (!inv.save_binary(base) || !mapped->map_from_file(base)) {
+        std::cout << "binary barrels could not be written or mapped\n";
+        failures++;
+    } else {
+        size_t round_trip = mapped->size() == inv.size() && mapped->total_documents() == inv.total_documents() ? 0 : 1;
+        for (size_t doc = 0; round_trip == 0 && doc < docs; ++doc) {
+            if (mapped->doc_length(doc) != inv.doc_length(doc)) round_trip = 1;
+        }
+        for (size_t word_id = 0; round_trip == 0 && word_id < lists.size(); word_id += 17) {
+            std::vector<Posting> postings = mapped->fetch_doc_ids(word_id).decode();
+            bool same = postings.size() == lists[word_id].size();
+            for (size_t i = 0; same && i < postings.size(); ++i) {
+                same = postings[i].doc == lists[word_id][i].doc && postings[i].freq == lists[word_id][i].freq;
+            }
+            if (!same) {
+                std::cout << "posting list of word " << word_id << " changed in the round trip\n";
+                round_trip = 1;
+            }
+        }
+        std::cout << "save_binary / map_from_file: " << (round_trip ? "MISMATCH" : "postings and lengths match") << "\n";
+        failures += round_trip;
+    }
+
+    // 1 to 6 terms, rare and common words mixed, top_k from 1 to 100
+    SearchEngine engine;
+    std::vector<double> scores(docs);
+    const size_t top_ks[] = {1, 10, 10, 20, 100};
+    size_t mismatches = 0;
+    for (size_t q = 0; q < num_queries && mismatches < 5; ++q) {
+        std::vector<size_t> word_ids;
+        for (size_t terms = 1 + rng() % 6; terms > 0; --terms) {
+            size_t rank = rng() % 4 ? rng() % VOCABULARY : rng() % 20;
+            word_ids.push_back(rank * 17);
+        }
+        std::sort(word_ids.begin(), word_ids.end());
+        word_ids.erase(std::unique(word_ids.begin(), word_ids.end()), word_ids.end());
+        size_t top_k = top_ks[rng() % (sizeof(top_ks) / sizeof(top_ks[0]))];
+
+        auto expected = exhaustive_or_top_k(word_ids, lists, inv, top_k, scores);
+        std::string label = "query " + std::to_string(q) + " (" + std::to_string(word_ids.size()) +
+                            " terms, top " + std::to_string(top_k) + ")";
+        mismatches += compare_rankings(engine.or_top_k(word_ids, fwd, inv, top_k), expected, scores, label);
+        if (mapped->size() > 0) {
+            mismatches += compare_rankings(engine.or_top_k(word_ids, fwd, *mapped, top_k), expected, scores,
+                                           label + " on the mapped barrels");
+        }
+    }
+    std::cout << "Block-Max WAND: " << (mismatches ? "MISMATCH" : "matches the exhaustive ranking on all queries") << "\n";
+    failures += mismatches;
+
+    mapped.reset();  // unmapped before its files are removed
+    std::error_code ignored;
+    std::filesystem::remove_all(dir, ignored);
+
+    std::cout << (failures ? "FAILED" : "OK") << "\n";
+    return failures ? 1 : 0;
+}
+
+int main(int argc, char* argv[])
+{
+    // Base path for all data files
+    const std::string BASE_PATH = "D:/searchEngine/";
+
+    // --threads N may appear anywhere, the other arguments are positional
+    size_t threads = 0;
+    std::vector<std::string> args;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--threads" && i + 1 < argc) {
+            threads = std::stoull(argv[++i]);
+        } else {
+            args.push_back(arg);
+        }
+    }
+    if (args.empty()) {
+        print_usage();
+        return 1;
+    }
+
+    std::string command = args[0];
+
+    if (command == "index") {
+        std::string data_dir = args.size() > 1 ? args[1] : BASE_PATH + "data/2020-04-10";
+        std::string out_dir = args.size() > 2 ? args[2] : BASE_PATH + "indices";
+        size_t max_docs = args.size() > 3 ? std::stoull(args[3]) : SIZE_MAX;
+
+        load_lemmatizer(BASE_PATH + "lemmatizer/lemmatization-en.txt");
+
+        Lexicon lex;
+        ForwardIndex fwd;
+        InvertedIndex inv;
+        MetadataParser parser;
+        parser.set_data_path(data_dir);
+
+        std::cerr << "Indexing " << data_dir << " on "
+                  << (threads ? threads : ThreadPool::default_threads()) << " threads..." << std::endl;
+        auto start = std::chrono::steady_clock::now();
+        size_t docs = parser.metadata_parse(lex, fwd, inv, max_docs, threads);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (docs == 0) {
+            std::cerr << "No documents indexed" << std::endl;
+            return 1;
+        }
+        std::cerr << "Indexed " << docs << " documents, " << lex.size() << " words in " << seconds << " s" << std::endl;
+
+        lex.save(out_dir + "/lexicon.csv");
+        if (!lex.save_binary(out_dir + "/lexicon.bin")) {
+            std::cerr << "Failed to write binary lexicon" << std::endl;
+            return 1;
+        }
+        fwd.save_to_file(out_dir + "/forward_index.txt");
+        inv.save_to_file(out_dir + "/inverted_index");
+        if (!inv.save_binary(out_dir + "/inverted_index")) {
+            std::cerr << "Failed to write binary barrels" << std::endl;
+            return 1;
+        }
+        std::cerr << "Done!" << std::endl;
+        return 0;
+    }
+
+    if (command == "convert-barrels") {
+        std::string base = args.size() > 1 ? args[1] : BASE_PATH + "indices/inverted_index";
+        std::cerr << "Converting csv barrels at " << base << "..." << std::endl;
+        if (!InvertedIndex::convert_csv_to_binary(base)) {
+            std::cerr << "Failed to convert inverted index" << std::endl;
+            return 1;
+        }
+        std::cerr << "Done!" << std::endl;
+        return 0;
+    }
+
+    if (command == "convert-lexicon") {
+        std::string csv_path = args.size() > 1 ? args[1] : BASE_PATH + "indices/lexicon.csv";
+        std::string bin_path = args.size() > 2 ? args[2] : BASE_PATH + "indices/lexicon.bin";
+        std::cerr << "Converting " << csv_path << "..." << std::endl;
+        if (!Lexicon::convert_csv_to_binary(csv_path, bin_path)) {
+            std::cerr << "Failed to convert lexicon" << std::endl;
+            return 1;
+        }
+        std::cerr << "Done!" << std::endl;
+        return 0;
+    }
+
+    if (command == "convert-glove") {
+        std::string in_path = args.size() > 1 ? args[1] : BASE_PATH + "embedding/glove_embeddings.bin";
+        std::string out_path = args.size() > 2 ? args[2] : in_path;
+        bool text = in_path.size() >= 4 && in_path.compare(in_path.size() - 4, 4, ".txt") == 0;
+
+        SemanticSearch semantic_search;
+        std::cerr << "Converting " << in_path << "..." << std::endl;
+        bool loaded = text ? semantic_search.load_glove_embeddings(in_path)
+                           : semantic_search.load_embeddings_binary(in_path);
+        if (!loaded || !semantic_search.save_embeddings_binary(out_path)) {
+            std::cerr << "Failed to convert word embeddings" << std::endl;
+            return 1;
+        }
+        std::cerr << "Done!" << std::endl;
+        return 0;
+    }
+
+    if (command == "build-embeddings") {
+        std::string indices_dir = args.size() > 1 ? args[1] : BASE_PATH + "indices";
+        std::string glove_path = args.size() > 2 ? args[2] : BASE_PATH + "embedding/glove_embeddings.bin";
+        std::string out_path = args.size() > 3 ? args[3] : BASE_PATH + "embedding/doc_embeddings.bin";
+
+        Lexicon lex;
+        ForwardIndex fwd;
+        SemanticSearch semantic_search;
+        std::cerr << "Loading indices from " << indices_dir << "..." << std::endl;
+        if ((!lex.map_from_file(indices_dir + "/lexicon.bin") && !lex.load(indices_dir + "/lexicon.csv")) ||
+            !fwd.load_from_file(indices_dir + "/forward_index.txt")) {
+            std::cerr << "Failed to load lexicon and forward index" << std::endl;
+            return 1;
+        }
+        if (!semantic_search.load_embeddings_binary(glove_path)) {
+            std::cerr << "Failed to load word embeddings" << std::endl;
+            return 1;
+        }
+        semantic_search.prune_embeddings(lex);
+
+        auto start = std::chrono::steady_clock::now();
+        semantic_search.build_document_embeddings(fwd, lex, threads);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cerr << "Built " << semantic_search.document_embeddings().rows() << " document embeddings on "
+                  << (threads ? threads : ThreadPool::default_threads()) << " threads in " << seconds << " s" << std::endl;
+
+        if (!semantic_search.save_document_embeddings(out_path)) {
+            std::cerr << "Failed to write document embeddings" << std::endl;
+            return 1;
+        }
+        std::cerr << "Done!" << std::endl;
+        return 0;
+    }
+
+    if (command == "build-barrels") {
+        std::string fwd_path = args.size() > 1 ? args[1] : BASE_PATH + "indices/forward_index.txt";
+        std::string base = args.size() > 2 ? args[2] : BASE_PATH + "indices/inverted_index";
+
+        ForwardIndex fwd;
+        std::cerr << "Loading forward index..." << std::endl;
+        if (!fwd.load_from_file(fwd_path)) {
+            std::cerr << "Failed to load forward index" << std::endl;
+            return 1;
+        }
+
+        std::cerr << "Building inverted index..." << std::endl;
+        InvertedIndex inv;
+        inv.add_from_forward(fwd);
+        inv.save_to_file(base);
+        if (!inv.save_binary(base)) {
+            std::cerr << "Failed to write binary barrels" << std::endl;
+            return 1;
+        }
+        std::cerr << "Done! " << inv.size() << " words, " << inv.total_documents() << " documents" << std::endl;
+        return 0;
+    }
+
+    if (command == "build-hnsw" || command == "bench-hnsw") {
+        std::string emb_path = args.size() > 1 ? args[1] : BASE_PATH + "embedding/doc_embeddings.bin";
+        std::string graph_path = args.size() > 2 ? args[2] : BASE_PATH + "embedding/doc_embeddings_hnsw.bin";
+
+        SemanticSearch semantic_search;
+        if (!semantic_search.load_document_embeddings(emb_path) ||
+            semantic_search.document_embeddings().empty()) {
+            std::cerr << "Failed to load document embeddings" << std::endl;
+            return 1;
+        }
+
+        if (command == "build-hnsw") {
+            size_t M = args.size() > 3 ? std::stoull(args[3]) : 16;
+            size_t ef_construction = args.size() > 4 ? std::stoull(args[4]) : 200;
+            semantic_search.build_ann_index(M, ef_construction);
+            if (!semantic_search.save_ann_index(graph_path)) {
+                std::cerr << "Failed to write HNSW index" << std::endl;
+                return 1;
+            }
+            return 0;
+        }
+
+        if (!semantic_search.load_ann_index(graph_path)) {
+            std::cerr << "Failed to load HNSW index" << std::endl;
+            return 1;
+        }
+        size_t queries = args.size() > 3 ? std::stoull(args[3]) : 1000;
+        size_t k = args.size() > 4 ? std::stoull(args[4]) : 10;
+        return bench_hnsw(semantic_search.document_embeddings(), semantic_search.ann(), queries, k);
+    }
+
+    if (command == "build-ivfpq" || command == "bench-ivfpq") {
+        std::string emb_path = args.size() > 1 ? args[1] : BASE_PATH + "embedding/doc_embeddings.bin";
+        std::string index_path = args.size() > 2 ? args[2] : BASE_PATH + "embedding/doc_embeddings_ivfpq.bin";
+
+        SemanticSearch semantic_search;
+        if (!semantic_search.load_document_embeddings(emb_path) ||
+            semantic_search.document_embeddings().empty()) {
+            std::cerr << "Failed to load document embeddings" << std::endl;
+            return 1;
+        }
+
+        if (command == "build-ivfpq") {
+            IvfPqParams params;
+            if (args.size() > 3) params.nlist = std::stoull(args[3]);
+            if (args.size() > 4) params.m = std::stoull(args[4]);
+            if (!semantic_search.train_pq_index(params) || !semantic_search.save_pq_index(index_path)) {
+                std::cerr << "Failed to build IVF-PQ index" << std::endl;
+                return 1;
+            }
+            return 0;
+        }
+
+        if (!semantic_search.load_pq_index(index_path)) {
+            std::cerr << "Failed to load IVF-PQ index" << std::endl;
+            return 1;
+        }
+        size_t queries = args.size() > 3 ? std::stoull(args[3]) : 1000;
+        size_t k = args.size() > 4 ? std::stoull(args[4]) : 10;
+        size_t rerank = args.size() > 5 ? std::stoull(args[5]) : 100;
+        return bench_ivfpq(semantic_search.document_embeddings(), semantic_search.pq(), queries, k, rerank);
+    }
+
+    if (command == "check-tokenizer") {
+        std::string corpus_path = args.size() > 1 ? args[1] : BASE_PATH + "data/2020-04-10/metadata.csv";
+        size_t max_mb = args.size() > 2 ? std::stoull(args[2]) : 16;
+        load_lemmatizer(BASE_PATH + "lemmatizer/lemmatization-en.txt");
+        return check_tokenizer_parity(corpus_path, max_mb * 1024 * 1024);
+    }
+
+    if (command == "check-wand") {
+        size_t queries = args.size() > 1 ? std::stoull(args[1]) : 2000;
+        size_t docs = args.size() > 2 ? std::stoull(args[2]) : 20000;
+        return check_wand(queries, docs);
+    }
+
+    if (command == "bench-precision") {
+        std::string emb_path = args.size() > 1 ? args[1] : BASE_PATH + "embedding/doc_embeddings.bin";
+
+        SemanticSearch semantic_search;
+        if (!semantic_search.load_document_embeddings(emb_path) ||
+            semantic_search.document_embeddings().empty()) {
+            std::cerr << "Failed to load document embeddings" << std::endl;
+            return 1;
+        }
+        size_t queries = args.size() > 2 ? std::stoull(args[2]) : 1000;
+        size_t k = args.size() > 3 ? std::stoull(args[3]) : 10;
+        return bench_precision(semantic_search.document_embeddings(), queries, k);
+    }
+
+    print_usage();
+    return 1;
+}
@@ -0,0 +1,193 @@
+#include "posting_list.hpp"
+#include <algorithm>
+#include <cstring>
+
+//variable-byte: 7 bits per byte, high bit set means more bytes follow
+static void write_vbyte(uint32_t value, std::vector<uint8_t>& out)
+{
+    while (value >= 0x80) {
+        out.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+static const uint8_t* read_vbyte(const uint8_t* in, uint32_t& value)
+{
+    uint32_t result = *in & 0x7F;
+    unsigned shift = 7;
+    while (*in++ & 0x80) {
+        result |= static_cast<uint32_t>(*in & 0x7F) << shift;
+        shift += 7;
+    }
+    value = result;
+    return in;
+}
+
+
+PostingBlockHeader PostingList::block_header(size_t block) const
+{
+    //lists are packed into a byte blob, so headers may be unaligned
+    PostingBlockHeader header;
+    std::memcpy(&header, data + sizeof(PostingBounds) + block * sizeof(PostingBlockHeader), sizeof(header));
+    return header;
+}
+
+
+PostingBounds PostingList::bounds() const
+{
+    PostingBounds list_bounds = {0, 0};
+    if (count > 0) std::memcpy(&list_bounds, data, sizeof(list_bounds));
+    return list_bounds;
+}
+
+
+bool PostingList::fits(const uint8_t* data, size_t count, size_t available)
+{
+    size_t blocks = (count + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    size_t payload_pos = sizeof(PostingBounds) + blocks * sizeof(PostingBlockHeader);
+    if (payload_pos > available) return false;
+
+    PostingList list(data, count);
+    size_t payload_bytes = available - payload_pos;
+    size_t start = 0;
+    for (size_t b = 0; b < blocks; b++) {
+        size_t block_len = std::min(BLOCK_SIZE, count - b * BLOCK_SIZE);
+        size_t end = list.block_header(b).end;
+        if (end > payload_bytes || end < start || end - start < 2 * block_len) return false;
+        start = end;
+    }
+    return true;
+}
+
+
+void PostingList::encode(const std::vector<Posting>& postings, const std::vector<uint32_t>& doc_lengths,
+                         std::vector<uint8_t>& out)
+{
+    size_t blocks = (postings.size() + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    size_t list_pos = out.size();
+    size_t header_pos = list_pos + sizeof(PostingBounds);
+    out.resize(header_pos + blocks * sizeof(PostingBlockHeader));
+    size_t payload_pos = out.size();
+
+    //unknown lengths count as 0, which keeps the bound valid
+    auto length_of = [&](uint32_t doc) -> uint32_t {
+        return doc < doc_lengths.size() ? doc_lengths[doc] : 0;
+    };
+    PostingBounds list_bounds = {0, UINT32_MAX};
+
+    uint32_t prev = 0;
+    for (size_t b = 0; b < blocks; b++) {
+        size_t first = b * BLOCK_SIZE;
+        size_t last = std::min(first + BLOCK_SIZE, postings.size());
+
+        for (size_t i = first; i < last; i++) {
+            write_vbyte(postings[i].doc - prev, out);
+            prev = postings[i].doc;
+        }
+        for (size_t i = first; i < last; i++) {
+            write_vbyte(postings[i].freq, out);
+        }
+
+        PostingBlockHeader header;
+        header.last_doc = prev;
+        header.end = static_cast<uint32_t>(out.size() - payload_pos);
+        header.bounds = {0, UINT32_MAX};
+        for (size_t i = first; i < last; i++) {
+            header.bounds.max_tf = std::max(header.bounds.max_tf, postings[i].freq);
+            header.bounds.min_len = std::min(header.bounds.min_len, length_of(postings[i].doc));
+        }
+        list_bounds.max_tf = std::max(list_bounds.max_tf, header.bounds.max_tf);
+        list_bounds.min_len = std::min(list_bounds.min_len, header.bounds.min_len);
+        std::memcpy(out.data() + header_pos + b * sizeof(header), &header, sizeof(header));
+    }
+
+    if (postings.empty()) list_bounds.min_len = 0;
+    std::memcpy(out.data() + list_pos, &list_bounds, sizeof(list_bounds));
+}
+
+
+std::vector<Posting> PostingList::decode() const
+{
+    std::vector<Posting> postings;
+    postings.reserve(count);
+    for (PostingCursor cursor(*this); !cursor.at_end(); cursor.next()) {
+        postings.push_back({cursor.doc(), cursor.freq()});
+    }
+    return postings;
+}
+
+
+PostingCursor::PostingCursor(const PostingList& list)
+    : list(list), block_total(list.block_count())
+{
+    if (block_total > 0) {
+        payload = list.data + sizeof(PostingBounds) + block_total * sizeof(PostingBlockHeader);
+        load_block(0);
+    }
+}
+
+
+void PostingCursor::load_block(size_t b)
+{
+    block = b;
+    pos = 0;
+    if (block >= block_total) return;
+
+    block_len = std::min(PostingList::BLOCK_SIZE, list.count - block * PostingList::BLOCK_SIZE);
+
+    uint32_t prev = 0;
+    size_t start = 0;
+    if (block > 0) {
+        PostingBlockHeader before = list.block_header(block - 1);
+        prev = before.last_doc;
+        start = before.end;
+    }
+
+    const uint8_t* in = payload + start;
+    for (size_t i = 0; i < block_len; i++) {
+        uint32_t gap;
+        in = read_vbyte(in, gap);
+        prev += gap;
+        buffer[i] = prev;
+    }
+    for (size_t i = 0; i < block_len; i++) {
+        in = read_vbyte(in, freqs[i]);
+    }
+}
+
+
+void PostingCursor::next()
+{
+    if (++pos >= block_len) load_block(block + 1);
+}
+
+
+void PostingCursor::next_geq(uint32_t target)
+{
+    if (at_end() || buffer[pos] >= target) return;
+
+    //skip whole blocks whose last doc_id is still below target
+    if (list.block_header(block).last_doc < target) {
+        size_t b = block + 1;
+        while (b < block_total && list.block_header(b).last_doc < target) b++;
+        load_block(b);
+        if (at_end()) return;
+    }
+
+    while (buffer[pos] < target) pos++;
+}
+
+
+PostingBlockHeader PostingCursor::block_for(uint32_t target) const
+{
+    size_t b = block;
+    while (b < block_total && list.block_header(b).last_doc < target) b++;
+    if (b < block_total) return list.block_header(b);
+
+    PostingBlockHeader past_end;
+    past_end.last_doc = UINT32_MAX;
+    past_end.end = 0;
+    past_end.bounds = {0, 0};
+    return past_end;
+}
@@ -0,0 +1,137 @@
+#include "quantized_matrix.hpp"
+#include "simd_kernels.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+//scale of an int8 vector (max |x| / 127), 0 for an all zero vector
+float int8_scale(const float* values, std::size_t n)
+{
+    float largest = 0.0f;
+    for (std::size_t i = 0; i < n; ++i) largest = std::max(largest, std::fabs(values[i]));
+    return largest / 127.0f;
+}
+
+void quantize_int8(const float* values, std::size_t n, float scale, std::int8_t* out)
+{
+    float inverse = scale > 0.0f ? 1.0f / scale : 0.0f;
+    for (std::size_t i = 0; i < n; ++i) {
+        float q = std::nearbyint(values[i] * inverse);
+        out[i] = static_cast<std::int8_t>(std::min(127.0f, std::max(-127.0f, q)));
+    }
+}
+
+}
+
+const char* precision_name(VectorPrecision precision)
+{
+    switch (precision) {
+    case VectorPrecision::Float16: return "f16";
+    case VectorPrecision::Int8: return "i8";
+    default: return "f32";
+    }
+}
+
+bool parse_precision(const std::string& name, VectorPrecision& precision)
+{
+    if (name == "f32") precision = VectorPrecision::Float32;
+    else if (name == "f16") precision = VectorPrecision::Float16;
+    else if (name == "i8") precision = VectorPrecision::Int8;
+    else return false;
+    return true;
+}
+
+void QuantizedMatrix::reset(std::size_t dim, VectorPrecision precision)
+{
+    dimension = dim;
+    mode = precision;
+    std::size_t value_bytes = precision == VectorPrecision::Float16 ? sizeof(std::uint16_t) : 1;
+    row_bytes = (dim * value_bytes + 63) / 64 * 64;
+    data.clear();
+    scales.clear();
+    row_ids.clear();
+}
+
+void QuantizedMatrix::clear()
+{
+    data = std::vector<std::uint8_t, AlignedAllocator<std::uint8_t>>();
+    scales = std::vector<float>();
+    row_ids = std::vector<std::size_t>();
+}
+
+void QuantizedMatrix::reserve(std::size_t rows)
+{
+    data.reserve(rows * row_bytes);
+    if (mode == VectorPrecision::Int8) scales.reserve(rows);
+    row_ids.reserve(rows);
+}
+
+std::size_t QuantizedMatrix::add_row(std::size_t id, const float* values)
+{
+    std::size_t r = row_ids.size();
+    data.resize(data.size() + row_bytes, 0);
+    if (mode == VectorPrecision::Int8) {
+        float scale = int8_scale(values, dimension);
+        quantize_int8(values, dimension, scale, reinterpret_cast<std::int8_t*>(data.data() + r * row_bytes));
+        scales.push_back(scale);
+    } else {
+        std::uint16_t* row = reinterpret_cast<std::uint16_t*>(data.data() + r * row_bytes);
+        for (std::size_t i = 0; i < dimension; ++i) row[i] = float_to_half(values[i]);
+    }
+    row_ids.push_back(id);
+    return r;
+}
+
+void QuantizedMatrix::assign(const EmbeddingMatrix& matrix, VectorPrecision precision)
+{
+    reset(matrix.dim(), precision);
+    reserve(matrix.rows());
+    for (std::size_t r = 0; r < matrix.rows(); ++r) {
+        add_row(matrix.doc_id(r), matrix.row(r));
+    }
+}
+
+void QuantizedMatrix::score_rows(const float* query, std::size_t first, std::size_t count, float* out) const
+{
+    if (mode == VectorPrecision::Float16) {
+        dot_product_rows_f16(query, half_row(first), row_bytes / sizeof(std::uint16_t), dimension, count, out);
+        return;
+    }
+
+    //the query is quantized like a row, the integer dots are scaled back in blocks
+    float query_scale = int8_scale(query, dimension);
+    std::vector<std::int8_t> codes(dimension);
+    quantize_int8(query, dimension, query_scale, codes.data());
+
+    const std::size_t BLOCK_ROWS = 256;
+    std::int32_t dots[BLOCK_ROWS];
+    for (std::size_t done = 0; done < count; done += BLOCK_ROWS) {
+        std::size_t block = std::min(BLOCK_ROWS, count - done);
+        std::size_t r = first + done;
+        dot_product_rows_i8(codes.data(), int8_row(r), row_bytes, dimension, block, dots);
+        for (std::size_t i = 0; i < block; ++i) {
+            out[done + i] = static_cast<float>(dots[i]) * query_scale * scales[r + i];
+        }
+    }
+}
+
+void QuantizedMatrix::add_row_to(std::size_t r, float* acc, float w) const
+{
+    if (mode == VectorPrecision::Int8) {
+        add_scaled_i8(acc, int8_row(r), w * scales[r], dimension);
+    } else {
+        add_scaled_f16(acc, half_row(r), w, dimension);
+    }
+}
+
+void QuantizedMatrix::decode_row(std::size_t r, float* out) const
+{
+    if (mode == VectorPrecision::Int8) {
+        const std::int8_t* row = int8_row(r);
+        for (std::size_t i = 0; i < dimension; ++i) out[i] = static_cast<float>(row[i]) * scales[r];
+    } else {
+        const std::uint16_t* row = half_row(r);
+        for (std::size_t i = 0; i < dimension; ++i) out[i] = half_to_float(row[i]);
+    }
+}
@@ -0,0 +1,26 @@
+#include "result_cache.hpp"
+#include "text_processing.hpp"
+#include <algorithm>
+
+std::string query_cache_key(std::string_view raw_query, const Lexicon& lex, char mode, std::size_t top_k)
+{
+    //tokens only hold letters, so '#' (lexicon id) and '\'' (word missing from the lexicon)
+    //keep the two kinds apart
+    std::vector<std::string> terms;
+    for_each_token(raw_query, [&](std::string_view token) {
+        std::size_t word_id = lex.getID(token);
+        if (word_id != static_cast<std::size_t>(-1))
+            terms.push_back("#" + std::to_string(word_id));
+        else
+            terms.push_back("'" + std::string(token));
+    });
+    std::sort(terms.begin(), terms.end());
+
+    std::string key(1, mode);
+    key += std::to_string(top_k);
+    for (const auto& term : terms) {
+        key += ' ';
+        key += term;
+    }
+    return key;
+}
@@ -1,11 +1,13 @@
 #include "searching.hpp"         
-#include "MetadataParser.hpp"  
+#include "MetaDataParser.hpp"  
 #include "lemmatizer.hpp"      
 #include "text_processing.hpp"
+#include "top_k.hpp"
 #include <fstream>          
 #include <sstream>             
 #include <algorithm>           
-#include <cctype>     
+#include <cctype>
+#include <cmath>     
 
 
 std::vector<SearchResult> SearchEngine::search(const std::string& raw_query,
@@ -16,66 +18,69 @@ std::vector<SearchResult> SearchEngine::search(const std::string& raw_query,
 {
     std::vector<SearchResult> results;
 
-    //tokenize query
-    std::vector<std::string> query_tokens = tokenize_text(raw_query);
-    if (query_tokens.empty())
-        return results;
+    //popular queries are answered from the cache
+    std::string cache_key;
+    if (results_cache.enabled()) {
+        cache_key = query_cache_key(raw_query, lex, 'B', top_k);
+        if (auto cached = results_cache.get(cache_key)) return *cached;
+    }
 
-    //convert query tokens → word_ids
+    //tokenize query and convert tokens → word_ids (one lookup per token, straight from the token view)
+    //unknown tokens are looked up again as their spelling correction, if there is one
     std::vector<std::size_t> query_word_ids;
-    for (const auto& token : query_tokens) {
-        if (lex.present_in(token)) {
-            query_word_ids.push_back(lex.getID(token));
+    for_each_token(raw_query, [&](std::string_view token) {
+        std::size_t word_id = lex.getID(token);
+        if (word_id == static_cast<std::size_t>(-1) && speller) {
+            std::string corrected = speller->correct(token, lex);
+            if (!corrected.empty()) word_id = lex.getID(corrected);
         }
-    }
+        if (word_id != static_cast<std::size_t>(-1)) {
+            query_word_ids.push_back(word_id);
+        }
+    });
 
     if (query_word_ids.empty())
         return results;
 
-    //fetch posting lists for each query word
-    std::vector<std::vector<std::size_t>> postings;
-    for (std::size_t word_id : query_word_ids) {
-        const auto* docs = inv.fetch_doc_ids(word_id);
-        if (docs && !docs->empty()) {
-            postings.push_back(*docs);
-        }
-    }
+    //fetch posting lists for each query word (still compressed, decoded while merging)
+    std::vector<PostingList> postings;
+    std::vector<double> idf;
+    fetch_postings(query_word_ids, fwd, inv, postings, idf);
 
     if (postings.empty())
         return results;
 
     //AND logic: intersect all posting lists
-    std::vector<std::size_t> candidate_docs = postings[0];
-    for (std::size_t i = 1; i < postings.size(); ++i) {
-        candidate_docs = intersect_sorted(candidate_docs, postings[i]);
-        if (candidate_docs.empty())
-            break;
-    }
+    std::vector<std::size_t> candidate_docs = intersect_sorted(postings);
 
-    //OR fallback if AND result is empty
+    //OR fallback if AND result is empty, only the best top_k are ever kept
+    TopK<std::size_t> best(top_k);
     if (candidate_docs.empty()) {
-        candidate_docs = postings[0];
-        for (std::size_t i = 1; i < postings.size(); ++i) {
-            candidate_docs = union_sorted(candidate_docs, postings[i]);
-        }
+        wand_top_k(postings, idf, inv, fwd, best);
     }
 
-    //Score each candidate document
+    //Score each candidate document, keeping only the best top_k (score, doc_id) pairs
+    std::vector<PostingCursor> cursors(postings.begin(), postings.end());
     for (std::size_t doc_id : candidate_docs) {
-        double score = score_by_tf_sum(fwd, doc_id, query_word_ids);
+        double score = score_bm25(doc_id, cursors, idf, inv);
         if (score == 0.0)
             continue;
 
-        const std::string* cord_uid = fwd.fetch_cord_uid(doc_id);
-        if (!cord_uid)
+        if (!best.would_accept(score, doc_id) || !fwd.fetch_cord_uid(doc_id))
             continue;
 
+        best.push(score, doc_id);
+    }
+
+    //attach cord_uid and metadata (title + url) to the survivors only
+    for (const auto& [score, doc_id] : best.take_sorted()) {
+        const std::string* cord_uid = fwd.fetch_cord_uid(doc_id);
+
         SearchResult r;
         r.doc_id = doc_id;
         r.cord_uid = *cord_uid;
         r.score = score;
 
-        //attach metadata (title + url)
         auto it = corduid_to_meta.find(*cord_uid);
         if (it != corduid_to_meta.end()) {
             r.title = it->second.title;
@@ -85,15 +90,7 @@ std::vector<SearchResult> SearchEngine::search(const std::string& raw_query,
         results.push_back(std::move(r));
     }
 
-    //sort by score (descending)
-    std::sort(results.begin(), results.end(),
-              [](const SearchResult& a, const SearchResult& b) {
-                  return a.score > b.score;
-              });
-
-    //Keep only top-k
-    if (results.size() > top_k)
-        results.resize(top_k);
+    if (results_cache.enabled()) results_cache.put(cache_key, results);
     return results;
 }
 
@@ -106,6 +103,7 @@ bool SearchEngine::load_metadata_urls(const std::string& metadata_csv_path)
 
     // Clear any old data
     corduid_to_meta.clear();
+    results_cache.clear();
 
     MetadataParser parser;          // reuse existing CSV parsing logic
     std::string line;
@@ -134,106 +132,223 @@ bool SearchEngine::load_metadata_urls(const std::string& metadata_csv_path)
 }
 
 
-//for query word present in both docs (AND operation)
-std::vector<std::size_t> SearchEngine::intersect_sorted(const std::vector<std::size_t>& a,
-        const std::vector<std::size_t>& b)
+//for query word present in all docs (AND operation)
+//the shortest list drives, the others jump ahead with next_geq and skip whole blocks
+std::vector<std::size_t> SearchEngine::intersect_sorted(std::vector<PostingList> lists)
 {
     std::vector<std::size_t> result;
-    result.reserve(std::min(a.size(), b.size()));
-
-    std::size_t i = 0;
-    std::size_t j = 0;
+    if (lists.empty())
+        return result;
 
-    while (i < a.size() && j < b.size()) {
-        if (a[i] == b[j]) {
-            result.push_back(a[i]);
-            ++i;
-            ++j;
-        }
-        else if (a[i] < b[j]) {
-            ++i;
+    std::sort(lists.begin(), lists.end(),
+              [](const PostingList& a, const PostingList& b) {
+                  return a.size() < b.size();
+              });
+    result.reserve(lists[0].size());
+
+    std::vector<PostingCursor> cursors(lists.begin(), lists.end());
+    PostingCursor& lead = cursors[0];
+
+    while (!lead.at_end()) {
+        uint32_t doc = lead.doc();
+        bool in_all = true;
+
+        for (std::size_t i = 1; i < cursors.size(); ++i) {
+            cursors[i].next_geq(doc);
+            if (cursors[i].at_end())
+                return result;
+            if (cursors[i].doc() != doc) {
+                lead.next_geq(cursors[i].doc());
+                in_all = false;
+                break;
+            }
         }
-        else {
-            ++j;
+
+        if (in_all) {
+            result.push_back(doc);
+            lead.next();
         }
     }
-    std::sort(result.begin(), result.end());
-
     return result;
 }
 
 
-//for query word present in either docs (OR operation)
-std::vector<std::size_t> SearchEngine::union_sorted(const std::vector<std::size_t>& a,
-                           const std::vector<std::size_t>& b)
+void SearchEngine::fetch_postings(const std::vector<std::size_t>& word_ids,
+                                  const ForwardIndex& fwd,
+                                  const InvertedIndex& inv,
+                                  std::vector<PostingList>& postings,
+                                  std::vector<double>& idf)
 {
-    std::vector<std::size_t> result;
-    result.reserve(a.size() + b.size());
-
-    std::size_t i = 0;
-    std::size_t j = 0;
-
-    while (i < a.size() && j < b.size()) {
-        if (a[i] == b[j]) {
-            result.push_back(a[i]);
-            ++i;
-            ++j;
+    for (std::size_t word_id : word_ids) {
+        PostingList docs = inv.fetch_doc_ids(word_id);
+        if (!docs.empty()) {
+            postings.push_back(docs);
         }
-        else if (a[i] < b[j]) {
-            result.push_back(a[i]);
-            ++i;
-        }
-        else {
-            result.push_back(b[j]);
-            ++j;
-        }
-    }
-
-    // Append remaining elements
-    while (i < a.size()) {
-        result.push_back(a[i++]);
     }
 
-    while (j < b.size()) {
-        result.push_back(b[j++]);
+    //idf of each query term, collection size from the index statistics
+    std::size_t total_docs = inv.total_documents() ? inv.total_documents() : fwd.total_documents();
+    for (const auto& list : postings) {
+        idf.push_back(bm25_idf(list.size(), total_docs));
     }
+}
 
-    //remove duplicates (just in case)
-    std::sort(result.begin(), result.end());
-    result.erase(std::unique(result.begin(), result.end()), result.end());
 
-    return result;
+std::vector<std::pair<double, std::size_t>> SearchEngine::or_top_k(const std::vector<std::size_t>& word_ids,
+                                                                   const ForwardIndex& fwd,
+                                                                   const InvertedIndex& inv,
+                                                                   std::size_t top_k) const
+{
+    std::vector<PostingList> postings;
+    std::vector<double> idf;
+    fetch_postings(word_ids, fwd, inv, postings, idf);
+
+    TopK<std::size_t> best(top_k);
+    if (!postings.empty())
+        wand_top_k(postings, idf, inv, fwd, best);
+    return best.take_sorted();
 }
 
 
-//finding term frequency using binary search
-std::size_t SearchEngine::term_freq_doc(const ForwardIndex& fwd, std::size_t doc_id, std::size_t word_id)
+//for query word present in either docs (OR operation), Block-Max WAND over the cursors.
+//Terms are kept ordered by their current doc_id; the pivot is the first term where the
+//summed list bounds exceed the current threshold, so no document before it can enter the top-k.
+void SearchEngine::wand_top_k(const std::vector<PostingList>& lists,
+                              const std::vector<double>& idf,
+                              const InvertedIndex& inv,
+                              const ForwardIndex& fwd,
+                              TopK<std::size_t>& best) const
 {
-    const auto* terms = fwd.fetch_terms(doc_id);
-    if (!terms) return 0;
+    struct Term {
+        PostingCursor cursor;
+        double idf;
+        double max_score;
+    };
+
+    double avg_length = inv.average_doc_length();
+    std::vector<Term> terms;
+    terms.reserve(lists.size());
+    for (std::size_t i = 0; i < lists.size(); ++i) {
+        terms.push_back({PostingCursor(lists[i]), idf[i], bm25_bound(idf[i], lists[i].bounds(), avg_length)});
+    }
 
-    std::size_t left = 0;
-    std::size_t right = terms->size();
+    std::vector<Term*> order;
+    for (auto& term : terms)
+        order.push_back(&term);
 
-    while (left < right) {
-        std::size_t mid = (left + right) / 2;
+    while (true) {
+        order.erase(std::remove_if(order.begin(), order.end(),
+                                   [](Term* t) { return t->cursor.at_end(); }),
+                    order.end());
+        if (order.empty())
+            break;
+
+        std::sort(order.begin(), order.end(),
+                  [](Term* a, Term* b) { return a->cursor.doc() < b->cursor.doc(); });
+
+        //a document has to score above this to change the top-k
+        double threshold = best.full() ? best.threshold() : 0.0;
+
+        //find the pivot term
+        double bound_sum = 0.0;
+        std::size_t pivot = order.size();
+        for (std::size_t i = 0; i < order.size(); ++i) {
+            bound_sum += order[i]->max_score;
+            if (bound_sum > threshold) {
+                pivot = i;
+                break;
+            }
+        }
+        if (pivot == order.size())
+            break;
 
-        if ((*terms)[mid].first == word_id)
-            return (*terms)[mid].second;
-        else if ((*terms)[mid].first < word_id)
-            left = mid + 1;
-        else
-            right = mid;
+        uint32_t pivot_doc = order[pivot]->cursor.doc();
+        while (pivot + 1 < order.size() && order[pivot + 1]->cursor.doc() == pivot_doc)
+            ++pivot;
+
+        //block-max check: bounds of the blocks that would hold pivot_doc
+        double block_sum = 0.0;
+        uint32_t block_end = UINT32_MAX;
+        for (std::size_t i = 0; i <= pivot; ++i) {
+            PostingBlockHeader header = order[i]->cursor.block_for(pivot_doc);
+            block_sum += bm25_bound(order[i]->idf, header.bounds, avg_length);
+            block_end = std::min(block_end, header.last_doc);
+        }
+
+        if (block_sum <= threshold) {
+            //nothing up to the end of the shortest of these blocks can qualify
+            uint32_t target = block_end == UINT32_MAX ? UINT32_MAX : block_end + 1;
+            if (pivot + 1 < order.size())
+                target = std::min(target, order[pivot + 1]->cursor.doc());
+            for (std::size_t i = 0; i <= pivot; ++i)
+                order[i]->cursor.next_geq(target);
+            continue;
+        }
+
+        if (order[0]->cursor.doc() == pivot_doc) {
+            //all terms up to the pivot sit on pivot_doc: score it fully
+            double length = inv.doc_length(pivot_doc);
+            double score = 0.0;
+            for (std::size_t i = 0; i <= pivot; ++i) {
+                score += bm25_term(order[i]->idf, order[i]->cursor.freq(), length, avg_length);
+                order[i]->cursor.next();
+            }
+
+            if (score > 0.0 && best.would_accept(score, pivot_doc) && fwd.fetch_cord_uid(pivot_doc))
+                best.push(score, pivot_doc);
+        }
+        else {
+            //move the terms before the pivot up to it
+            for (std::size_t i = 0; i < pivot; ++i) {
+                if (order[i]->cursor.doc() < pivot_doc)
+                    order[i]->cursor.next_geq(pivot_doc);
+            }
+        }
     }
-    return 0;
+}
+
+
+//Robertson-Sparck Jones idf, shifted by one so it never goes negative for very common terms
+double SearchEngine::bm25_idf(std::size_t df, std::size_t total_docs)
+{
+    double n = static_cast<double>(df);
+    double N = static_cast<double>(std::max(total_docs, df));
+    return std::log(1.0 + (N - n + 0.5) / (n + 0.5));
+}
+
+double SearchEngine::bm25_term(double idf, double tf, double length, double avg_length) const
+{
+    //length normalization, documents of average length get factor 1
+    double length_ratio = avg_length > 0.0 ? length / avg_length : 1.0;
+    double norm = bm25.k1 * (1.0 - bm25.b + bm25.b * length_ratio);
+    return idf * tf * (bm25.k1 + 1.0) / (tf + norm);
+}
+
+double SearchEngine::bm25_bound(double idf, const PostingBounds& bounds, double avg_length) const
+{
+    if (bounds.max_tf == 0)
+        return 0.0;
+    //small slack so floating point rounding never makes a bound undercut a real score
+    return bm25_term(idf, bounds.max_tf, bounds.min_len, avg_length) * (1.0 + 1e-9);
 }
 
 //score of each document (one call scores one document only)
-double SearchEngine::score_by_tf_sum(const ForwardIndex& fwd, std::size_t doc_id, const std::vector<std::size_t>& query_word_ids)
+double SearchEngine::score_bm25(std::size_t doc_id,
+                                std::vector<PostingCursor>& cursors,
+                                const std::vector<double>& idf,
+                                const InvertedIndex& inv) const
 {
+    double avg_length = inv.average_doc_length();
+    double length = inv.doc_length(doc_id);
+
     double score = 0.0;
-    for (std::size_t word_id : query_word_ids) {
-        score += term_freq_doc(fwd, doc_id, word_id);
+    for (std::size_t i = 0; i < cursors.size(); ++i) {
+        PostingCursor& cursor = cursors[i];
+        cursor.next_geq(static_cast<uint32_t>(doc_id));
+        if (cursor.at_end() || cursor.doc() != doc_id)
+            continue;
+
+        score += bm25_term(idf[i], cursor.freq(), length, avg_length);
     }
     return score;
-}
\ No newline at end of file
+}
@@ -1,5 +1,8 @@
 #include "semantic_search.hpp"
 #include "text_processing.hpp"
+#include "simd_kernels.hpp"
+#include "top_k.hpp"
+#include "thread_pool.hpp"
 #include <fstream>
 #include <sstream>
 #include <cmath>
@@ -9,16 +12,19 @@
 SemanticSearch::SemanticSearch() 
     : embeddings_loaded(false), embedding_dim(300) 
 {
+    doc_embeddings.reset(embedding_dim);
 }
 
 bool SemanticSearch::load_glove_embeddings(const std::string& glove_file_path) {
+    invalidate_results();
     std::ifstream file(glove_file_path);
     if (!file.is_open()) {
         std::cerr << "Error: Cannot open GloVe file: " << glove_file_path << std::endl;
         return false;
     }
 
-    word_embeddings.clear();
+    word_embeddings.reset(embedding_dim);
+    vocab_embeddings.clear();
     std::string line;
     std::size_t count = 0;
 
@@ -46,7 +52,7 @@ bool SemanticSearch::load_glove_embeddings(const std::string& glove_file_path) {
 
         // Normalize the embedding vector for faster cosine similarity
         normalize_vector(embedding);
-        word_embeddings[word] = std::move(embedding);
+        word_embeddings.add(word, embedding.data());
         
         count++;
         if (count % 10000 == 0) {
@@ -55,6 +61,7 @@ bool SemanticSearch::load_glove_embeddings(const std::string& glove_file_path) {
     }
 
     file.close();
+    word_embeddings.freeze();
     embeddings_loaded = true;
     
     std::cout << "\nLoaded " << word_embeddings.size() 
@@ -64,55 +71,50 @@ bool SemanticSearch::load_glove_embeddings(const std::string& glove_file_path) {
 }
 
 bool SemanticSearch::save_embeddings_binary(const std::string& binary_file_path) const {
-    if (!embeddings_loaded) {
+    if (!embeddings_loaded || word_embeddings.empty()) {
         std::cerr << "Error: No embeddings to save!" << std::endl;
         return false;
     }
 
-    std::ofstream file(binary_file_path, std::ios::binary);
-    if (!file.is_open()) {
-        std::cerr << "Error: Cannot create binary file: " << binary_file_path << std::endl;
-        return false;
-    }
-
     std::cout << "Saving embeddings to binary file..." << std::flush;
-
-    // Write header: number of words and embedding dimension
-    std::size_t num_words = word_embeddings.size();
-    file.write(reinterpret_cast<const char*>(&num_words), sizeof(num_words));
-    file.write(reinterpret_cast<const char*>(&embedding_dim), sizeof(embedding_dim));
-
-    // Write each word and its embedding
-    for (const auto& entry : word_embeddings) {
-        const std::string& word = entry.first;
-        const std::vector<float>& embedding = entry.second;
-
-        // Write word length and word
-        std::size_t word_len = word.size();
-        file.write(reinterpret_cast<const char*>(&word_len), sizeof(word_len));
-        file.write(word.c_str(), word_len);
-
-        // Write embedding vector
-        file.write(reinterpret_cast<const char*>(embedding.data()), 
-                   embedding_dim * sizeof(float));
+    if (!word_embeddings.save(binary_file_path)) {
+        return false;
     }
-
-    file.close();
-    std::cout << " Done! Saved " << num_words << " word embeddings.\n";
+    std::cout << " Done! Saved " << word_embeddings.size() << " word embeddings.\n";
     return true;
 }
 
 bool SemanticSearch::load_embeddings_binary(const std::string& binary_file_path) {
+    invalidate_results();
+    embeddings_loaded = false;
+    vocab_embeddings.clear();  // its rows may point into the old word table
+
+    // Current format: mapped, nothing is read until a word is looked up
+    if (WordEmbeddings::is_file(binary_file_path)) {
+        if (!word_embeddings.map_from_file(binary_file_path)) {
+            std::cerr << "Error: Cannot map embedding file: " << binary_file_path << std::endl;
+            return false;
+        }
+        if (word_embeddings.dim() != embedding_dim) {
+            std::cerr << "Error: Dimension mismatch! Expected " << embedding_dim 
+                      << " but file has " << word_embeddings.dim() << std::endl;
+            word_embeddings.clear();
+            return false;
+        }
+        embeddings_loaded = true;
+        std::cout << "Mapped " << word_embeddings.size() << " word embeddings from binary file!\n";
+        return true;
+    }
+
     std::ifstream file(binary_file_path, std::ios::binary);
     if (!file.is_open()) {
         std::cerr << "Error: Cannot open binary file: " << binary_file_path << std::endl;
         return false;
     }
 
+    // Old format: size_t count, size_t dim, then per word a size_t length, the word and dim floats
     std::cout << "Loading embeddings from binary file..." << std::flush;
 
-    word_embeddings.clear();
-
     // Read header
     std::size_t num_words;
     std::size_t saved_dim;
@@ -126,20 +128,29 @@ bool SemanticSearch::load_embeddings_binary(const std::string& binary_file_path)
     }
 
     // Read each word and embedding
+    word_embeddings.reset(embedding_dim);
+    // (a corrupt count must not reserve more rows than the file can hold)
+    std::streampos data_start = file.tellg();
+    file.seekg(0, std::ios::end);
+    std::size_t max_words = static_cast<std::size_t>(file.tellg() - data_start) / (embedding_dim * sizeof(float));
+    file.seekg(data_start);
+    word_embeddings.reserve(std::min(num_words, max_words));
+    std::string word;
+    std::vector<float> embedding(embedding_dim);
     for (std::size_t i = 0; i < num_words; ++i) {
         // Read word
         std::size_t word_len;
         file.read(reinterpret_cast<char*>(&word_len), sizeof(word_len));
         
-        std::string word(word_len, '\0');
+        word.resize(word_len);
         file.read(&word[0], word_len);
 
         // Read embedding
-        std::vector<float> embedding(embedding_dim);
         file.read(reinterpret_cast<char*>(embedding.data()), 
                   embedding_dim * sizeof(float));
+        if (!file) break;
 
-        word_embeddings[word] = std::move(embedding);
+        word_embeddings.add(word, embedding.data());
 
         if ((i + 1) % 50000 == 0) {
             std::cout << "." << std::flush;
@@ -147,10 +158,11 @@ bool SemanticSearch::load_embeddings_binary(const std::string& binary_file_path)
     }
 
     file.close();
+    word_embeddings.freeze();
     embeddings_loaded = true;
 
     std::cout << "\nLoaded " << word_embeddings.size() 
-              << " word embeddings from binary file! (Fast!)\n";
+              << " word embeddings from binary file! (main_tools convert-glove rewrites it to be mapped)\n";
     return true;
 }
 
@@ -169,20 +181,19 @@ bool SemanticSearch::save_document_embeddings(const std::string& binary_file_pat
     std::cout << "Saving document embeddings to binary file..." << std::flush;
 
     // Write header: number of documents and embedding dimension
-    std::size_t num_docs = doc_embeddings.size();
+    std::size_t num_docs = doc_embeddings.rows();
     file.write(reinterpret_cast<const char*>(&num_docs), sizeof(num_docs));
     file.write(reinterpret_cast<const char*>(&embedding_dim), sizeof(embedding_dim));
 
-    // Write each document ID and its embedding
-    for (const auto& entry : doc_embeddings) {
-        std::size_t doc_id = entry.first;
-        const std::vector<float>& embedding = entry.second;
+    // Write each document ID and its embedding (without the row padding)
+    for (std::size_t row = 0; row < num_docs; ++row) {
+        std::size_t doc_id = doc_embeddings.doc_id(row);
 
         // Write doc_id
         file.write(reinterpret_cast<const char*>(&doc_id), sizeof(doc_id));
 
         // Write embedding vector
-        file.write(reinterpret_cast<const char*>(embedding.data()), 
+        file.write(reinterpret_cast<const char*>(doc_embeddings.row(row)), 
                    embedding_dim * sizeof(float));
     }
 
@@ -192,6 +203,7 @@ bool SemanticSearch::save_document_embeddings(const std::string& binary_file_pat
 }
 
 bool SemanticSearch::load_document_embeddings(const std::string& binary_file_path) {
+    invalidate_results();
     std::ifstream file(binary_file_path, std::ios::binary);
     if (!file.is_open()) {
         std::cerr << "Error: Cannot open binary file: " << binary_file_path << std::endl;
@@ -200,7 +212,9 @@ bool SemanticSearch::load_document_embeddings(const std::string& binary_file_pat
 
     std::cout << "Loading document embeddings from binary file..." << std::flush;
 
-    doc_embeddings.clear();
+    doc_embeddings.reset(embedding_dim);
+    quantized_docs.clear();
+    ann_index.clear();
 
     // Read header
     std::size_t num_docs;
@@ -214,18 +228,20 @@ bool SemanticSearch::load_document_embeddings(const std::string& binary_file_pat
         return false;
     }
 
-    // Read each document ID and embedding
+    // Read each document ID and embedding straight into the matrix
+    doc_embeddings.reserve(num_docs);
+    std::vector<float> embedding(embedding_dim);
     for (std::size_t i = 0; i < num_docs; ++i) {
         // Read doc_id
         std::size_t doc_id;
         file.read(reinterpret_cast<char*>(&doc_id), sizeof(doc_id));
 
         // Read embedding
-        std::vector<float> embedding(embedding_dim);
         file.read(reinterpret_cast<char*>(embedding.data()), 
                   embedding_dim * sizeof(float));
+        if (!file) break;
 
-        doc_embeddings[doc_id] = std::move(embedding);
+        doc_embeddings.add_row(doc_id, embedding.data());
 
         if ((i + 1) % 1000 == 0) {
             std::cout << "." << std::flush;
@@ -234,87 +250,109 @@ bool SemanticSearch::load_document_embeddings(const std::string& binary_file_pat
 
     file.close();
 
-    std::cout << "\nLoaded " << doc_embeddings.size() 
+    std::cout << "\nLoaded " << doc_embeddings.rows() 
               << " document embeddings from binary file! (Fast!)\n";
     return true;
 }
 
-void SemanticSearch::build_document_embeddings(const ForwardIndex& fwd, 
-                                                const Lexicon& lex) {
+void SemanticSearch::build_document_embeddings(const ForwardIndex& fwd,
+                                                const Lexicon& lex,
+                                                std::size_t threads) {
+    invalidate_results();
     if (!embeddings_loaded) {
         std::cerr << "Error: GloVe embeddings not loaded yet!" << std::endl;
         return;
     }
 
-    doc_embeddings.clear();
+    doc_embeddings.reset(embedding_dim);
+    quantized_docs.clear();
+    ann_index.clear();
     std::cout << "Building document embeddings..." << std::flush;
 
     std::size_t total_docs = fwd.total_documents();
-    const auto& lexicon_data = lex.get_data();
     
-    // Build reverse lookup: word_id -> word
-    std::unordered_map<std::size_t, std::string> id_to_word;
-    for (const auto& entry : lexicon_data) {
-        id_to_word[entry.second.first] = entry.first;
+    // word_id -> vector, so terms are looked up by array index instead of by string
+    LexiconEmbeddings local_vectors;
+    if (vocab_embeddings.empty()) {
+        local_vectors.build(word_embeddings, lex, false);
     }
+    const LexiconEmbeddings& vectors = vocab_embeddings.empty() ? local_vectors : vocab_embeddings;
 
-    for (std::size_t doc_id = 0; doc_id < total_docs; ++doc_id) {
+    // documents without any word vector get no row
+    auto has_vector = [&](std::size_t doc_id) {
         const auto* terms = fwd.fetch_terms(doc_id);
-        if (!terms || terms->empty()) continue;
-
-        // Collect words with their frequencies
-        std::vector<std::string> doc_words;
-        std::vector<float> doc_weights;
-
+        if (!terms) return false;
         for (const auto& term : *terms) {
-            std::size_t word_id = term.first;
-            std::size_t freq = term.second;
-            
-            auto it = id_to_word.find(word_id);
-            if (it == id_to_word.end()) continue;
-            
-            const std::string& word = it->second;
-            
-            // Check if word has embedding
-            if (word_embeddings.find(word) != word_embeddings.end()) {
-                doc_words.push_back(word);
-                doc_weights.push_back(static_cast<float>(freq));
-            }
+            if (vectors.contains(term.first)) return true;
         }
-
-        if (doc_words.empty()) continue;
-
-        // Compute weighted average embedding
-        std::vector<float> doc_embedding(embedding_dim, 0.0f);
-        float total_weight = 0.0f;
-
-        for (std::size_t i = 0; i < doc_words.size(); ++i) {
-            const auto& word_emb = word_embeddings[doc_words[i]];
-            float weight = doc_weights[i];
-            
-            for (std::size_t j = 0; j < embedding_dim; ++j) {
-                doc_embedding[j] += word_emb[j] * weight;
+        return false;
+    };
+
+    // Documents are split into chunks of consecutive doc_ids. The first pass counts the rows
+    // of every chunk, so each chunk knows where its rows start and the matrix is allocated
+    // once; the second pass fills the rows of every chunk in place, without any locking.
+    // Rows stay in doc_id order whatever the number of threads.
+    const std::size_t CHUNK_DOCS = 256;
+    std::size_t chunk_count = (total_docs + CHUNK_DOCS - 1) / CHUNK_DOCS;
+    ThreadPool pool(std::max<std::size_t>(1, std::min(threads ? threads : ThreadPool::default_threads(), chunk_count)));
+
+    std::vector<std::future<std::size_t>> counted;
+    counted.reserve(chunk_count);
+    for (std::size_t c = 0; c < chunk_count; ++c) {
+        counted.push_back(pool.submit([&, c] {
+            std::size_t rows = 0;
+            for (std::size_t doc_id = c * CHUNK_DOCS; doc_id < std::min(total_docs, (c + 1) * CHUNK_DOCS); ++doc_id) {
+                if (has_vector(doc_id)) ++rows;
             }
-            total_weight += weight;
-        }
-
-        // Average by total weight
-        if (total_weight > 0.0f) {
-            for (std::size_t j = 0; j < embedding_dim; ++j) {
-                doc_embedding[j] /= total_weight;
+            return rows;
+        }));
+    }
+    std::vector<std::size_t> first_row(chunk_count + 1, 0);
+    for (std::size_t c = 0; c < chunk_count; ++c) {
+        first_row[c + 1] = first_row[c] + counted[c].get();
+    }
+    doc_embeddings.resize(first_row[chunk_count]);
+
+    std::vector<std::future<void>> filled;
+    filled.reserve(chunk_count);
+    for (std::size_t c = 0; c < chunk_count; ++c) {
+        filled.push_back(pool.submit([&, c] {
+            std::size_t r = first_row[c];
+            for (std::size_t doc_id = c * CHUNK_DOCS; doc_id < std::min(total_docs, (c + 1) * CHUNK_DOCS); ++doc_id) {
+                const auto* terms = fwd.fetch_terms(doc_id);
+                if (!terms) continue;
+
+                // Weighted sum of the word vectors (weight = term frequency), straight into the row.
+                // Averaging would only scale the sum, which the normalization undoes
+                float* doc_embedding = doc_embeddings.row(r);
+                bool found = false;
+                for (const auto& term : *terms) {
+                    if (vectors.add_to(term.first, doc_embedding, static_cast<float>(term.second))) {
+                        found = true;
+                    }
+                }
+                if (!found) continue;
+
+                // Normalize for cosine similarity
+                double magnitude = std::sqrt(static_cast<double>(dot_product(doc_embedding, doc_embedding, embedding_dim)));
+                if (magnitude > 1e-10) {
+                    for (std::size_t j = 0; j < embedding_dim; ++j) {
+                        doc_embedding[j] /= static_cast<float>(magnitude);
+                    }
+                }
+                doc_embeddings.set_doc_id(r, doc_id);
+                ++r;
             }
-        }
-
-        // Normalize for cosine similarity
-        normalize_vector(doc_embedding);
-        doc_embeddings[doc_id] = std::move(doc_embedding);
-
-        if ((doc_id + 1) % 100 == 0) {
+        }));
+    }
+    for (std::size_t c = 0; c < chunk_count; ++c) {
+        filled[c].get();
+        if ((c + 1) % 4 == 0) {
             std::cout << "." << std::flush;
         }
     }
 
-    std::cout << "\nBuilt embeddings for " << doc_embeddings.size() 
+    std::cout << "\nBuilt embeddings for " << doc_embeddings.rows() 
               << " documents!" << std::endl;
 }
 
@@ -322,7 +360,7 @@ std::vector<SemanticResult> SemanticSearch::semantic_search(
     const std::string& raw_query,
     const Lexicon& lex,
     const ForwardIndex& fwd,
-    std::size_t top_k)
+    std::size_t top_k) const
 {
     std::vector<SemanticResult> results;
 
@@ -331,17 +369,24 @@ std::vector<SemanticResult> SemanticSearch::semantic_search(
         return results;
     }
 
-    if (doc_embeddings.empty()) {
+    if (doc_embeddings.empty() && quantized_docs.empty() && pq_index.empty()) {
         std::cerr << "Error: Document embeddings not built!" << std::endl;
         return results;
     }
 
+    // Popular queries are answered from the cache
+    std::string cache_key;
+    if (results_cache.enabled()) {
+        cache_key = query_cache_key(raw_query, lex, 'S', top_k);
+        if (auto cached = results_cache.get(cache_key)) return *cached;
+    }
+
     // Tokenize query
     std::vector<std::string> query_tokens = tokenize_text(raw_query);
     if (query_tokens.empty()) return results;
 
     // Compute query embedding (average of word embeddings)
-    std::vector<float> query_embedding = compute_average_embedding(query_tokens);
+    std::vector<float> query_embedding = compute_average_embedding(query_tokens, lex);
     
     // Check if query has valid embedding
     bool has_valid_embedding = false;
@@ -357,17 +402,60 @@ std::vector<SemanticResult> SemanticSearch::semantic_search(
         return results;
     }
 
-    // Compute similarity with all documents
-    for (const auto& doc_pair : doc_embeddings) {
-        std::size_t doc_id = doc_pair.first;
-        const auto& doc_emb = doc_pair.second;
+    // Keep only the best top_k (similarity, doc_id) pairs
+    TopK<std::size_t> best(top_k);
+    auto consider = [&](double similarity, std::size_t doc_id) {
+        if (similarity <= 0.0) return;  // Skip irrelevant documents
 
-        double similarity = cosine_similarity(query_embedding, doc_emb);
-        
-        if (similarity <= 0.0) continue;  // Skip irrelevant documents
+        if (!best.would_accept(similarity, doc_id)) return;
+        if (!fwd.fetch_cord_uid(doc_id)) return;
+
+        best.push(similarity, doc_id);
+    };
+
+    if (!quantized_docs.empty()) {
+        // Reduced precision: the same full pass, over a half or a quarter of the bytes
+        auto score = [&](std::size_t first, std::size_t count, float* out) {
+            quantized_docs.score_rows(query_embedding.data(), first, count, out);
+        };
+        for (const auto& [similarity, doc_id] : scan_top_k(quantized_docs.ids(), score, fwd, top_k)) {
+            best.push(similarity, doc_id);
+        }
+    } else if (doc_embeddings.empty()) {
+        // Compressed: approximate similarities from the IVF-PQ codes, optionally
+        // recomputed exactly for the best rerank_candidates from the mapped embedding file
+        bool rerank = rerank_candidates > 0 && rerank_vectors.is_open();
+        std::size_t candidates = rerank ? std::max(rerank_candidates, top_k) : top_k;
+        for (const auto& [similarity, row] : pq_index.search(query_embedding.data(), candidates, nprobe)) {
+            if (rerank) {
+                consider(dot_product(query_embedding.data(), rerank_vectors.row(row), embedding_dim),
+                         pq_index.doc_id(row));
+            } else {
+                consider(similarity, pq_index.doc_id(row));
+            }
+        }
+    } else if (use_ann && !ann_index.empty()) {
+        // Approximate: only the ef_search candidates found by walking the graph are ranked
+        // (all of them, so documents dropped by the filters above can be replaced)
+        std::size_t ef = std::max(ef_search, top_k);
+        for (const auto& [similarity, row] : ann_index.search(doc_embeddings, query_embedding.data(), ef, ef)) {
+            consider(similarity, doc_embeddings.doc_id(row));
+        }
+    } else {
+        // Compute similarity with all documents in one pass over the matrix
+        // (embeddings are normalized, so the dot product is the cosine similarity)
+        auto score = [&](std::size_t first, std::size_t count, float* out) {
+            dot_product_rows(query_embedding.data(), doc_embeddings.row(first), doc_embeddings.stride(),
+                             embedding_dim, count, out);
+        };
+        for (const auto& [similarity, doc_id] : scan_top_k(doc_embeddings.ids(), score, fwd, top_k)) {
+            best.push(similarity, doc_id);
+        }
+    }
 
+    // Attach cord_uid and metadata to the survivors only
+    for (const auto& [similarity, doc_id] : best.take_sorted()) {
         const std::string* cord_uid = fwd.fetch_cord_uid(doc_id);
-        if (!cord_uid) continue;
 
         SemanticResult result;
         result.doc_id = doc_id;
@@ -384,21 +472,216 @@ std::vector<SemanticResult> SemanticSearch::semantic_search(
         results.push_back(std::move(result));
     }
 
-    // Sort by similarity score (descending)
-    std::sort(results.begin(), results.end(),
-              [](const SemanticResult& a, const SemanticResult& b) {
-                  return a.score > b.score;
-              });
+    if (results_cache.enabled()) results_cache.put(cache_key, results);
+    return results;
+}
 
-    // Keep only top-k results
-    if (results.size() > top_k) {
-        results.resize(top_k);
+void SemanticSearch::set_scan_threads(std::size_t threads) {
+    scan_threads = threads ? threads : ThreadPool::default_threads();
+    scan_pool.reset();
+    if (scan_threads > 1) scan_pool = std::make_unique<ThreadPool>(scan_threads - 1);
+}
+
+std::vector<std::pair<double, std::size_t>> SemanticSearch::scan_top_k(
+    const std::vector<std::size_t>& doc_ids,
+    const std::function<void(std::size_t, std::size_t, float*)>& score,
+    const ForwardIndex& fwd,
+    std::size_t top_k) const
+{
+    // Rows are scored a block at a time into a small buffer that stays in cache,
+    // parts are whole blocks and a part is worth a thread from MIN_PART_BLOCKS on
+    const std::size_t BLOCK_ROWS = 1024;
+    const std::size_t MIN_PART_BLOCKS = 16;
+    std::size_t rows = doc_ids.size();
+    std::size_t blocks = (rows + BLOCK_ROWS - 1) / BLOCK_ROWS;
+
+    auto scan_part = [&](std::size_t first_block, std::size_t end_block) {
+        TopK<std::size_t> best(top_k);
+        std::vector<float> similarities(BLOCK_ROWS);
+        for (std::size_t b = first_block; b < end_block; ++b) {
+            std::size_t first = b * BLOCK_ROWS;
+            std::size_t count = std::min(BLOCK_ROWS, rows - first);
+            score(first, count, similarities.data());
+
+            for (std::size_t i = 0; i < count; ++i) {
+                double similarity = similarities[i];
+                std::size_t doc_id = doc_ids[first + i];
+                if (similarity <= 0.0) continue;  // Skip irrelevant documents
+                if (!best.would_accept(similarity, doc_id)) continue;
+                if (!fwd.fetch_cord_uid(doc_id)) continue;
+                best.push(similarity, doc_id);
+            }
+        }
+        return best.take_sorted();
+    };
+
+    std::size_t parts = std::max<std::size_t>(1, std::min(scan_threads, blocks / MIN_PART_BLOCKS));
+    if (parts == 1 || !scan_pool) return scan_part(0, blocks);
+
+    // The top_k of every part contains everything of the overall top_k from that part,
+    // and TopK breaks ties by doc_id, so the merge gives exactly the single thread result
+    // The parts reference scan_part, score and doc_ids on this stack: whatever throws,
+    // every submitted part has finished before the exception leaves this function
+    using Part = std::future<std::vector<std::pair<double, std::size_t>>>;
+    struct WaitAll {
+        std::vector<Part>& parts;
+        ~WaitAll() {
+            for (auto& part : parts) {
+                if (part.valid()) part.wait();
+            }
+        }
+    };
+    std::vector<Part> pending;
+    WaitAll wait_all{pending};
+    pending.reserve(parts - 1);
+    for (std::size_t p = 1; p < parts; ++p) {
+        pending.push_back(scan_pool->submit([&, p] {
+            return scan_part(blocks * p / parts, blocks * (p + 1) / parts);
+        }));
+    }
+    TopK<std::size_t> best(top_k);
+    for (const auto& [similarity, doc_id] : scan_part(0, blocks / parts)) {
+        best.push(similarity, doc_id);
+    }
+    for (auto& part : pending) {
+        for (const auto& [similarity, doc_id] : part.get()) {
+            best.push(similarity, doc_id);
+        }
     }
+    return best.take_sorted();
+}
 
-    return results;
+bool SemanticSearch::set_document_precision(VectorPrecision precision) {
+    invalidate_results();
+    if (precision == VectorPrecision::Float32) {
+        if (quantized_docs.empty()) return true;
+        std::cerr << "Error: float32 document embeddings were released, load them again" << std::endl;
+        return false;
+    }
+    if (doc_embeddings.empty()) {
+        std::cerr << "Error: Document embeddings not built!" << std::endl;
+        return false;
+    }
+
+    quantized_docs.assign(doc_embeddings, precision);
+    std::size_t float_bytes = doc_embeddings.memory_bytes();
+    doc_embeddings = EmbeddingMatrix(embedding_dim);
+    ann_index.clear();  // walks the float rows
+
+    std::cout << "Stored " << quantized_docs.rows() << " document embeddings as "
+              << precision_name(precision) << ": " << quantized_docs.memory_bytes() / 1024 << " KB instead of "
+              << float_bytes / 1024 << " KB" << std::endl;
+    return true;
+}
+
+void SemanticSearch::build_ann_index(std::size_t M, std::size_t ef_construction) {
+    invalidate_results();
+    if (doc_embeddings.empty()) {
+        std::cerr << "Error: Document embeddings not built!" << std::endl;
+        return;
+    }
+
+    std::cout << "Building HNSW index over " << doc_embeddings.rows() 
+              << " document embeddings (M=" << M << ", ef_construction=" 
+              << ef_construction << ")..." << std::flush;
+
+    HnswParams params;
+    params.M = M;
+    params.ef_construction = ef_construction;
+    ann_index.build(doc_embeddings, params);
+
+    std::cout << " Done! (" << ann_index.memory_bytes() / (1024 * 1024) << " MB)\n";
+}
+
+bool SemanticSearch::save_ann_index(const std::string& binary_file_path) const {
+    if (ann_index.empty()) {
+        std::cerr << "Error: No HNSW index to save!" << std::endl;
+        return false;
+    }
+
+    std::cout << "Saving HNSW index to binary file..." << std::flush;
+    if (!ann_index.save(binary_file_path, doc_embeddings)) {
+        return false;
+    }
+    std::cout << " Done!\n";
+    return true;
+}
+
+bool SemanticSearch::load_ann_index(const std::string& binary_file_path) {
+    invalidate_results();
+    if (!ann_index.load(binary_file_path, doc_embeddings)) {
+        return false;
+    }
+
+    std::cout << "Loaded HNSW index for " << ann_index.size() 
+              << " documents (M=" << ann_index.max_connections() << ")\n";
+    return true;
+}
+
+bool SemanticSearch::train_pq_index(const IvfPqParams& params) {
+    invalidate_results();
+    if (doc_embeddings.empty()) {
+        std::cerr << "Error: Document embeddings not built!" << std::endl;
+        return false;
+    }
+
+    std::cout << "Training IVF-PQ index over " << doc_embeddings.rows() 
+              << " document embeddings..." << std::flush;
+    if (!pq_index.train(doc_embeddings, params)) {
+        return false;
+    }
+
+    std::cout << " Done! " << pq_index.list_count() << " lists, " << pq_index.code_size() 
+              << " bytes per code (" << pq_index.memory_bytes() / (1024 * 1024) << " MB)\n";
+    return true;
+}
+
+bool SemanticSearch::save_pq_index(const std::string& binary_file_path) const {
+    std::cout << "Saving IVF-PQ index to binary file..." << std::flush;
+    if (!pq_index.save(binary_file_path)) {
+        return false;
+    }
+    std::cout << " Done!\n";
+    return true;
+}
+
+bool SemanticSearch::load_pq_index(const std::string& binary_file_path) {
+    invalidate_results();
+    if (!pq_index.load(binary_file_path)) {
+        return false;
+    }
+    if (pq_index.dim() != embedding_dim) {
+        std::cerr << "Error: Dimension mismatch! Expected " << embedding_dim 
+                  << " but IVF-PQ index has " << pq_index.dim() << std::endl;
+        pq_index.clear();
+        return false;
+    }
+
+    std::cout << "Loaded IVF-PQ index for " << pq_index.size() << " documents ("
+              << pq_index.memory_bytes() / (1024 * 1024) << " MB)\n";
+    return true;
+}
+
+bool SemanticSearch::open_rerank_vectors(const std::string& binary_file_path) {
+    invalidate_results();
+    if (!rerank_vectors.open(binary_file_path)) {
+        return false;
+    }
+
+    // The index refers to rows of the file it was trained from
+    std::size_t last = pq_index.size() - 1;
+    if (pq_index.empty() || rerank_vectors.rows() != pq_index.size() || rerank_vectors.dim() != embedding_dim ||
+        rerank_vectors.doc_id(0) != pq_index.doc_id(0) ||
+        rerank_vectors.doc_id(last) != pq_index.doc_id(static_cast<std::uint32_t>(last))) {
+        std::cerr << "Error: " << binary_file_path << " does not match the IVF-PQ index" << std::endl;
+        rerank_vectors.close();
+        return false;
+    }
+    return true;
 }
 
 bool SemanticSearch::load_metadata(const std::string& metadata_csv_path) {
+    invalidate_results();
     std::ifstream file(metadata_csv_path);
     if (!file.is_open()) {
         std::cerr << "Error: Cannot open metadata file: " << metadata_csv_path << std::endl;
@@ -454,26 +737,46 @@ bool SemanticSearch::load_metadata(const std::string& metadata_csv_path) {
     return corduid_to_meta.size() > 0;
 }
 
-const std::vector<float>* SemanticSearch::get_word_embedding(
-    const std::string& word) const 
-{
-    auto it = word_embeddings.find(word);
-    if (it != word_embeddings.end()) {
-        return &it->second;
+bool SemanticSearch::prune_embeddings(const Lexicon& lex, VectorPrecision precision) {
+    invalidate_results();
+    if (!embeddings_loaded || word_embeddings.empty()) {
+        std::cerr << "Error: GloVe embeddings not loaded yet!" << std::endl;
+        return false;
+    }
+
+    std::size_t all_words = word_embeddings.size();
+    bool mapped = word_embeddings.is_mapped();
+    vocab_embeddings.build(word_embeddings, lex, !mapped, precision);
+    if (!mapped || precision != VectorPrecision::Float32) {
+        word_embeddings.clear();
     }
-    return nullptr;
+
+    std::cout << "Kept embeddings of " << vocab_embeddings.size() << " of " << all_words
+              << " words (in the lexicon) as " << precision_name(precision) << ", "
+              << vocab_embeddings.memory_bytes() / (1024 * 1024) << " MB\n";
+    return true;
+}
+
+bool SemanticSearch::get_word_embedding(std::string_view word, const Lexicon& lex, float* out) const {
+    if (!vocab_embeddings.empty()) {
+        return vocab_embeddings.decode(lex.getID(word), out);
+    }
+    const float* emb = word_embeddings.find(word);
+    if (!emb) return false;
+    std::copy(emb, emb + embedding_dim, out);
+    return true;
 }
 
 std::vector<float> SemanticSearch::compute_average_embedding(
-    const std::vector<std::string>& words) const 
+    const std::vector<std::string>& words,
+    const Lexicon& lex) const 
 {
     std::vector<float> avg_embedding(embedding_dim, 0.0f);
+    std::vector<float> emb(embedding_dim);
     std::size_t count = 0;
 
     for (const auto& word : words) {
-        auto it = word_embeddings.find(word);
-        if (it != word_embeddings.end()) {
-            const auto& emb = it->second;
+        if (get_word_embedding(word, lex, emb.data())) {
             for (std::size_t i = 0; i < embedding_dim; ++i) {
                 avg_embedding[i] += emb[i];
             }
@@ -496,13 +799,8 @@ double SemanticSearch::cosine_similarity(const std::vector<float>& a,
 {
     if (a.size() != b.size()) return 0.0;
 
-    double dot_product = 0.0;
-    for (std::size_t i = 0; i < a.size(); ++i) {
-        dot_product += static_cast<double>(a[i]) * static_cast<double>(b[i]);
-    }
-
     // Vectors are already normalized, so dot product = cosine similarity
-    return dot_product;
+    return dot_product(a.data(), b.data(), a.size());
 }
 
 void SemanticSearch::normalize_vector(std::vector<float>& vec) {
@@ -0,0 +1,643 @@
+#include "simd_kernels.hpp"
+#include <cmath>
+#include <cstring>
+#include <string>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+//---------------------------------------------------------------- scalar
+
+static float dot_scalar(const float* a, const float* b, std::size_t n)
+{
+    double sum = 0.0;
+    for (std::size_t i = 0; i < n; ++i) {
+        sum += static_cast<double>(a[i]) * static_cast<double>(b[i]);
+    }
+    return static_cast<float>(sum);
+}
+
+static void rows_scalar(const float* query, const float* rows, std::size_t stride,
+                        std::size_t dim, std::size_t count, float* out)
+{
+    for (std::size_t r = 0; r < count; ++r) {
+        out[r] = dot_scalar(query, rows + r * stride, dim);
+    }
+}
+
+static void axpy_scalar(float* acc, const float* x, float w, std::size_t n)
+{
+    for (std::size_t i = 0; i < n; ++i) {
+        acc[i] += w * x[i];
+    }
+}
+
+//bit i of the result = byte i is an ASCII letter, byte i of lower = the byte lowercased
+static void classify_scalar(const char* text, std::size_t n, char* lower, std::uint64_t* letters)
+{
+    for (std::size_t w = 0; w < (n + 63) / 64; ++w) letters[w] = 0;
+    for (std::size_t i = 0; i < n; ++i) {
+        unsigned char ch = static_cast<unsigned char>(text[i]);
+        bool letter = static_cast<unsigned char>((ch | 0x20) - 'a') < 26;
+        lower[i] = static_cast<char>(letter ? (ch | 0x20) : ch);
+        if (letter) letters[i / 64] |= std::uint64_t(1) << (i % 64);
+    }
+}
+
+#ifdef SIMD_X86
+
+//---------------------------------------------------------------- SSE2 / AVX2 text
+
+// (byte | 0x20) - 'a' <= 25 selects exactly the ASCII letters; those get 0x20 ORed in.
+// The scalar kernel finishes the bytes after the last full vector.
+__attribute__((target("sse2")))
+static void classify_sse2(const char* text, std::size_t n, char* lower, std::uint64_t* letters)
+{
+    const __m128i case_bit = _mm_set1_epi8(0x20);
+    const __m128i first = _mm_set1_epi8('a');
+    const __m128i last = _mm_set1_epi8(25);
+
+    std::size_t full = n & ~static_cast<std::size_t>(63);
+    for (std::size_t i = 0; i < full; i += 64) {
+        std::uint64_t bits = 0;
+        for (std::size_t j = 0; j < 64; j += 16) {
+            __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + i + j));
+            __m128i offset = _mm_sub_epi8(_mm_or_si128(c, case_bit), first);
+            __m128i letter = _mm_cmpeq_epi8(_mm_min_epu8(offset, last), offset);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(lower + i + j),
+                             _mm_or_si128(c, _mm_and_si128(letter, case_bit)));
+            bits |= static_cast<std::uint64_t>(static_cast<std::uint16_t>(_mm_movemask_epi8(letter))) << j;
+        }
+        letters[i / 64] = bits;
+    }
+    if (full < n) classify_scalar(text + full, n - full, lower + full, letters + full / 64);
+}
+
+__attribute__((target("avx2")))
+static void classify_avx2(const char* text, std::size_t n, char* lower, std::uint64_t* letters)
+{
+    const __m256i case_bit = _mm256_set1_epi8(0x20);
+    const __m256i first = _mm256_set1_epi8('a');
+    const __m256i last = _mm256_set1_epi8(25);
+
+    std::size_t full = n & ~static_cast<std::size_t>(63);
+    for (std::size_t i = 0; i < full; i += 64) {
+        std::uint64_t bits = 0;
+        for (std::size_t j = 0; j < 64; j += 32) {
+            __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text + i + j));
+            __m256i offset = _mm256_sub_epi8(_mm256_or_si256(c, case_bit), first);
+            __m256i letter = _mm256_cmpeq_epi8(_mm256_min_epu8(offset, last), offset);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(lower + i + j),
+                                _mm256_or_si256(c, _mm256_and_si256(letter, case_bit)));
+            bits |= static_cast<std::uint64_t>(static_cast<std::uint32_t>(_mm256_movemask_epi8(letter))) << j;
+        }
+        letters[i / 64] = bits;
+    }
+    if (full < n) classify_scalar(text + full, n - full, lower + full, letters + full / 64);
+}
+
+//---------------------------------------------------------------- AVX2 + FMA
+
+__attribute__((target("avx2,fma")))
+static float hsum_avx2(__m256 v)
+{
+    __m128 lo = _mm256_castps256_ps128(v);
+    __m128 hi = _mm256_extractf128_ps(v, 1);
+    lo = _mm_add_ps(lo, hi);
+    lo = _mm_add_ps(lo, _mm_movehl_ps(lo, lo));
+    lo = _mm_add_ss(lo, _mm_shuffle_ps(lo, lo, 0x55));
+    return _mm_cvtss_f32(lo);
+}
+
+__attribute__((target("avx2,fma")))
+static float dot_avx2(const float* a, const float* b, std::size_t n)
+{
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+    std::size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+        acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8), acc1);
+    }
+    for (; i + 8 <= n; i += 8) {
+        acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+    }
+    float sum = hsum_avx2(_mm256_add_ps(acc0, acc1));
+    for (; i < n; ++i) sum += a[i] * b[i];
+    return sum;
+}
+
+__attribute__((target("avx2,fma")))
+static void rows_avx2(const float* query, const float* rows, std::size_t stride,
+                      std::size_t dim, std::size_t count, float* out)
+{
+    std::size_t r = 0;
+
+    //4 rows per pass: every query chunk is loaded once and used 4 times
+    for (; r + 4 <= count; r += 4) {
+        const float* r0 = rows + r * stride;
+        const float* r1 = r0 + stride;
+        const float* r2 = r1 + stride;
+        const float* r3 = r2 + stride;
+
+        __m256 acc0 = _mm256_setzero_ps();
+        __m256 acc1 = _mm256_setzero_ps();
+        __m256 acc2 = _mm256_setzero_ps();
+        __m256 acc3 = _mm256_setzero_ps();
+
+        std::size_t i = 0;
+        for (; i + 8 <= dim; i += 8) {
+            __m256 q = _mm256_loadu_ps(query + i);
+            acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(r0 + i), q, acc0);
+            acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(r1 + i), q, acc1);
+            acc2 = _mm256_fmadd_ps(_mm256_loadu_ps(r2 + i), q, acc2);
+            acc3 = _mm256_fmadd_ps(_mm256_loadu_ps(r3 + i), q, acc3);
+        }
+
+        float s0 = hsum_avx2(acc0), s1 = hsum_avx2(acc1);
+        float s2 = hsum_avx2(acc2), s3 = hsum_avx2(acc3);
+        for (; i < dim; ++i) {
+            s0 += r0[i] * query[i];
+            s1 += r1[i] * query[i];
+            s2 += r2[i] * query[i];
+            s3 += r3[i] * query[i];
+        }
+        out[r] = s0;
+        out[r + 1] = s1;
+        out[r + 2] = s2;
+        out[r + 3] = s3;
+    }
+
+    for (; r < count; ++r) {
+        out[r] = dot_avx2(query, rows + r * stride, dim);
+    }
+}
+
+__attribute__((target("avx2,fma")))
+static void axpy_avx2(float* acc, const float* x, float w, std::size_t n)
+{
+    __m256 weight = _mm256_set1_ps(w);
+    std::size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        _mm256_storeu_ps(acc + i, _mm256_fmadd_ps(_mm256_loadu_ps(x + i), weight, _mm256_loadu_ps(acc + i)));
+    }
+    for (; i < n; ++i) {
+        acc[i] += w * x[i];
+    }
+}
+
+//---------------------------------------------------------------- AVX-512
+
+__attribute__((target("avx512f")))
+static float dot_avx512(const float* a, const float* b, std::size_t n)
+{
+    __m512 acc = _mm512_setzero_ps();
+    std::size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        acc = _mm512_fmadd_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i), acc);
+    }
+    if (i < n) {
+        __mmask16 tail = static_cast<__mmask16>((1u << (n - i)) - 1);
+        acc = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(tail, a + i), _mm512_maskz_loadu_ps(tail, b + i), acc);
+    }
+    return _mm512_reduce_add_ps(acc);
+}
+
+__attribute__((target("avx512f")))
+static void rows_avx512(const float* query, const float* rows, std::size_t stride,
+                        std::size_t dim, std::size_t count, float* out)
+{
+    std::size_t full = dim & ~static_cast<std::size_t>(15);
+    __mmask16 tail = static_cast<__mmask16>((1u << (dim - full)) - 1);
+    std::size_t r = 0;
+
+    for (; r + 4 <= count; r += 4) {
+        const float* r0 = rows + r * stride;
+        const float* r1 = r0 + stride;
+        const float* r2 = r1 + stride;
+        const float* r3 = r2 + stride;
+
+        __m512 acc0 = _mm512_setzero_ps();
+        __m512 acc1 = _mm512_setzero_ps();
+        __m512 acc2 = _mm512_setzero_ps();
+        __m512 acc3 = _mm512_setzero_ps();
+
+        for (std::size_t i = 0; i < full; i += 16) {
+            __m512 q = _mm512_loadu_ps(query + i);
+            acc0 = _mm512_fmadd_ps(_mm512_loadu_ps(r0 + i), q, acc0);
+            acc1 = _mm512_fmadd_ps(_mm512_loadu_ps(r1 + i), q, acc1);
+            acc2 = _mm512_fmadd_ps(_mm512_loadu_ps(r2 + i), q, acc2);
+            acc3 = _mm512_fmadd_ps(_mm512_loadu_ps(r3 + i), q, acc3);
+        }
+        if (tail) {
+            __m512 q = _mm512_maskz_loadu_ps(tail, query + full);
+            acc0 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(tail, r0 + full), q, acc0);
+            acc1 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(tail, r1 + full), q, acc1);
+            acc2 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(tail, r2 + full), q, acc2);
+            acc3 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(tail, r3 + full), q, acc3);
+        }
+
+        out[r] = _mm512_reduce_add_ps(acc0);
+        out[r + 1] = _mm512_reduce_add_ps(acc1);
+        out[r + 2] = _mm512_reduce_add_ps(acc2);
+        out[r + 3] = _mm512_reduce_add_ps(acc3);
+    }
+
+    for (; r < count; ++r) {
+        out[r] = dot_avx512(query, rows + r * stride, dim);
+    }
+}
+
+__attribute__((target("avx512f")))
+static void axpy_avx512(float* acc, const float* x, float w, std::size_t n)
+{
+    __m512 weight = _mm512_set1_ps(w);
+    std::size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        _mm512_storeu_ps(acc + i, _mm512_fmadd_ps(_mm512_loadu_ps(x + i), weight, _mm512_loadu_ps(acc + i)));
+    }
+    if (i < n) {
+        __mmask16 tail = static_cast<__mmask16>((1u << (n - i)) - 1);
+        __m512 sum = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(tail, x + i), weight, _mm512_maskz_loadu_ps(tail, acc + i));
+        _mm512_mask_storeu_ps(acc + i, tail, sum);
+    }
+}
+
+#endif
+
+//---------------------------------------------------------------- dispatch
+
+struct KernelTable {
+    float (*dot)(const float*, const float*, std::size_t);
+    void (*rows)(const float*, const float*, std::size_t, std::size_t, std::size_t, float*);
+    void (*axpy)(float*, const float*, float, std::size_t);
+    const char* name;
+};
+
+static KernelTable select_kernels()
+{
+#ifdef SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+        return { dot_avx512, rows_avx512, axpy_avx512, "avx512" };
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        return { dot_avx2, rows_avx2, axpy_avx2, "avx2" };
+#endif
+    return { dot_scalar, rows_scalar, axpy_scalar, "scalar" };
+}
+
+static const KernelTable& kernels()
+{
+    static const KernelTable table = select_kernels();
+    return table;
+}
+
+float dot_product(const float* a, const float* b, std::size_t n)
+{
+    return kernels().dot(a, b, n);
+}
+
+void dot_product_rows(const float* query, const float* rows, std::size_t stride,
+                      std::size_t dim, std::size_t count, float* out)
+{
+    kernels().rows(query, rows, stride, dim, count, out);
+}
+
+void add_scaled(float* acc, const float* x, float w, std::size_t n)
+{
+    kernels().axpy(acc, x, w, n);
+}
+
+const char* simd_kernel_name()
+{
+    return kernels().name;
+}
+
+using ClassifyKernel = void (*)(const char*, std::size_t, char*, std::uint64_t*);
+
+struct TextKernel {
+    ClassifyKernel classify;
+    const char* name;
+};
+
+static TextKernel select_text_kernel()
+{
+#ifdef SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return { classify_avx2, "avx2" };
+    if (__builtin_cpu_supports("sse2"))
+        return { classify_sse2, "sse2" };
+#endif
+    return { classify_scalar, "scalar" };
+}
+
+static const TextKernel& text_kernel()
+{
+    static const TextKernel kernel = select_text_kernel();
+    return kernel;
+}
+
+void classify_letters(const char* text, std::size_t n, char* lower, std::uint64_t* letters)
+{
+    text_kernel().classify(text, n, lower, letters);
+}
+
+const char* text_kernel_name()
+{
+    return text_kernel().name;
+}
+
+bool classify_letters_with(const std::string& kernel, const char* text, std::size_t n, char* lower,
+                           std::uint64_t* letters)
+{
+    ClassifyKernel classify = nullptr;
+    if (kernel == "scalar") classify = classify_scalar;
+#ifdef SIMD_X86
+    __builtin_cpu_init();
+    if (kernel == "sse2" && __builtin_cpu_supports("sse2")) classify = classify_sse2;
+    if (kernel == "avx2" && __builtin_cpu_supports("avx2")) classify = classify_avx2;
+#endif
+    if (!classify) return false;
+    classify(text, n, lower, letters);
+    return true;
+}
+
+//---------------------------------------------------------------- half float / int8 rows
+
+std::uint16_t float_to_half(float value)
+{
+    std::uint32_t x;
+    std::memcpy(&x, &value, sizeof(x));
+    std::uint32_t sign = (x >> 16) & 0x8000u;
+    std::uint32_t magnitude = x & 0x7fffffffu;
+
+    if (magnitude >= 0x7f800000u)  //inf, nan (stays a quiet nan)
+        return static_cast<std::uint16_t>(sign | (magnitude > 0x7f800000u ? 0x7e00u : 0x7c00u));
+    if (magnitude >= 0x477ff000u)  //rounds to more than 65504
+        return static_cast<std::uint16_t>(sign | 0x7c00u);
+    if (magnitude < 0x38800000u) {
+        //below 2^-14: subnormal half, a multiple of 2^-24 (the float product is exact)
+        float a;
+        std::memcpy(&a, &magnitude, sizeof(a));
+        return static_cast<std::uint16_t>(sign | static_cast<std::uint32_t>(std::nearbyint(a * 16777216.0f)));
+    }
+    //rebias the exponent (127 -> 15) and round 23 mantissa bits to 10, ties to even
+    std::uint32_t h = magnitude - 0x38000000u;
+    h += 0xfffu + ((h >> 13) & 1u);
+    return static_cast<std::uint16_t>(sign | (h >> 13));
+}
+
+float half_to_float(std::uint16_t value)
+{
+    std::uint32_t sign = static_cast<std::uint32_t>(value & 0x8000u) << 16;
+    std::uint32_t exponent = (value >> 10) & 0x1fu;
+    std::uint32_t mantissa = value & 0x3ffu;
+
+    std::uint32_t x;
+    if (exponent == 0) {
+        float f = static_cast<float>(mantissa) * (1.0f / 16777216.0f);
+        std::memcpy(&x, &f, sizeof(x));
+        x |= sign;
+    } else if (exponent == 31) {
+        x = sign | 0x7f800000u | (mantissa << 13);
+    } else {
+        x = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    }
+    float result;
+    std::memcpy(&result, &x, sizeof(result));
+    return result;
+}
+
+static void rows_f16_scalar(const float* query, const std::uint16_t* rows, std::size_t stride,
+                            std::size_t dim, std::size_t count, float* out)
+{
+    for (std::size_t r = 0; r < count; ++r) {
+        const std::uint16_t* row = rows + r * stride;
+        float sum = 0.0f;
+        for (std::size_t i = 0; i < dim; ++i) sum += query[i] * half_to_float(row[i]);
+        out[r] = sum;
+    }
+}
+
+static void rows_i8_scalar(const std::int8_t* query, const std::int8_t* rows, std::size_t stride,
+                           std::size_t dim, std::size_t count, std::int32_t* out)
+{
+    for (std::size_t r = 0; r < count; ++r) {
+        const std::int8_t* row = rows + r * stride;
+        std::int32_t sum = 0;
+        for (std::size_t i = 0; i < dim; ++i) sum += static_cast<std::int32_t>(query[i]) * row[i];
+        out[r] = sum;
+    }
+}
+
+static void axpy_f16_scalar(float* acc, const std::uint16_t* x, float w, std::size_t n)
+{
+    for (std::size_t i = 0; i < n; ++i) acc[i] += w * half_to_float(x[i]);
+}
+
+static void axpy_i8_scalar(float* acc, const std::int8_t* x, float w, std::size_t n)
+{
+    for (std::size_t i = 0; i < n; ++i) acc[i] += w * static_cast<float>(x[i]);
+}
+
+#ifdef SIMD_X86
+
+//F16C widens 8 halves to 8 floats in one instruction, the products are plain float FMAs
+__attribute__((target("avx2,fma,f16c")))
+static void rows_f16_avx2(const float* query, const std::uint16_t* rows, std::size_t stride,
+                          std::size_t dim, std::size_t count, float* out)
+{
+    for (std::size_t r = 0; r < count; ++r) {
+        const std::uint16_t* row = rows + r * stride;
+        __m256 acc0 = _mm256_setzero_ps();
+        __m256 acc1 = _mm256_setzero_ps();
+        std::size_t i = 0;
+        for (; i + 16 <= dim; i += 16) {
+            __m256 x0 = _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i)));
+            __m256 x1 = _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i + 8)));
+            acc0 = _mm256_fmadd_ps(x0, _mm256_loadu_ps(query + i), acc0);
+            acc1 = _mm256_fmadd_ps(x1, _mm256_loadu_ps(query + i + 8), acc1);
+        }
+        for (; i + 8 <= dim; i += 8) {
+            __m256 x0 = _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i)));
+            acc0 = _mm256_fmadd_ps(x0, _mm256_loadu_ps(query + i), acc0);
+        }
+        float sum = hsum_avx2(_mm256_add_ps(acc0, acc1));
+        for (; i < dim; ++i) sum += query[i] * half_to_float(row[i]);
+        out[r] = sum;
+    }
+}
+
+__attribute__((target("avx512f,f16c")))
+static void rows_f16_avx512(const float* query, const std::uint16_t* rows, std::size_t stride,
+                            std::size_t dim, std::size_t count, float* out)
+{
+    std::size_t full = dim & ~static_cast<std::size_t>(15);
+    __mmask16 tail = static_cast<__mmask16>((1u << (dim - full)) - 1);
+    for (std::size_t r = 0; r < count; ++r) {
+        const std::uint16_t* row = rows + r * stride;
+        __m512 acc = _mm512_setzero_ps();
+        for (std::size_t i = 0; i < full; i += 16) {
+            __m512 x = _mm512_cvtph_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + i)));
+            acc = _mm512_fmadd_ps(x, _mm512_loadu_ps(query + i), acc);
+        }
+        if (tail) {
+            //stride is a multiple of 16, so the 16 half load stays inside the row's padding
+            //(zeros); the masked query load zeroes the products past dim
+            __m512 x = _mm512_cvtph_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + full)));
+            acc = _mm512_fmadd_ps(x, _mm512_maskz_loadu_ps(tail, query + full), acc);
+        }
+        out[r] = _mm512_reduce_add_ps(acc);
+    }
+}
+
+//int8 products summed in pairs to int32 (sign extended to int16 first, so nothing saturates)
+__attribute__((target("avx2")))
+static void rows_i8_avx2(const std::int8_t* query, const std::int8_t* rows, std::size_t stride,
+                         std::size_t dim, std::size_t count, std::int32_t* out)
+{
+    for (std::size_t r = 0; r < count; ++r) {
+        const std::int8_t* row = rows + r * stride;
+        __m256i acc = _mm256_setzero_si256();
+        std::size_t i = 0;
+        for (; i + 16 <= dim; i += 16) {
+            __m256i q = _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(query + i)));
+            __m256i x = _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i)));
+            acc = _mm256_add_epi32(acc, _mm256_madd_epi16(q, x));
+        }
+        __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+        sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4e));
+        sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xb1));
+        std::int32_t total = _mm_cvtsi128_si32(sum);
+        for (; i < dim; ++i) total += static_cast<std::int32_t>(query[i]) * row[i];
+        out[r] = total;
+    }
+}
+
+//VNNI multiplies unsigned by signed bytes and adds groups of 4 into int32 in one instruction.
+//The query is made unsigned by adding 128: sum((q + 128) * x) - sum(128 * x) = sum(q * x)
+__attribute__((target("avx512f,avx512bw,avx512vnni")))
+static void rows_i8_vnni(const std::int8_t* query, const std::int8_t* rows, std::size_t stride,
+                         std::size_t dim, std::size_t count, std::int32_t* out)
+{
+    const __m512i bias = _mm512_set1_epi8(static_cast<char>(0x80));
+    for (std::size_t r = 0; r < count; ++r) {
+        const std::int8_t* row = rows + r * stride;
+        __m512i acc = _mm512_setzero_si512();
+        __m512i offset = _mm512_setzero_si512();
+        for (std::size_t i = 0; i < dim; i += 64) {
+            __mmask64 mask = dim - i >= 64 ? ~__mmask64(0) : (__mmask64(1) << (dim - i)) - 1;
+            __m512i q = _mm512_xor_si512(_mm512_maskz_loadu_epi8(mask, query + i), bias);
+            __m512i x = _mm512_maskz_loadu_epi8(mask, row + i);
+            acc = _mm512_dpbusd_epi32(acc, q, x);
+            offset = _mm512_dpbusd_epi32(offset, bias, x);
+        }
+        out[r] = _mm512_reduce_add_epi32(_mm512_sub_epi32(acc, offset));
+    }
+}
+
+__attribute__((target("avx2,fma,f16c")))
+static void axpy_f16_avx2(float* acc, const std::uint16_t* x, float w, std::size_t n)
+{
+    __m256 weight = _mm256_set1_ps(w);
+    std::size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 v = _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(x + i)));
+        _mm256_storeu_ps(acc + i, _mm256_fmadd_ps(v, weight, _mm256_loadu_ps(acc + i)));
+    }
+    for (; i < n; ++i) acc[i] += w * half_to_float(x[i]);
+}
+
+__attribute__((target("avx2,fma")))
+static void axpy_i8_avx2(float* acc, const std::int8_t* x, float w, std::size_t n)
+{
+    __m256 weight = _mm256_set1_ps(w);
+    std::size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i bytes = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(x + i));
+        __m256 v = _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(bytes));
+        _mm256_storeu_ps(acc + i, _mm256_fmadd_ps(v, weight, _mm256_loadu_ps(acc + i)));
+    }
+    for (; i < n; ++i) acc[i] += w * static_cast<float>(x[i]);
+}
+
+#endif
+
+struct LowPrecisionKernels {
+    void (*rows_f16)(const float*, const std::uint16_t*, std::size_t, std::size_t, std::size_t, float*);
+    void (*rows_i8)(const std::int8_t*, const std::int8_t*, std::size_t, std::size_t, std::size_t, std::int32_t*);
+    void (*axpy_f16)(float*, const std::uint16_t*, float, std::size_t);
+    void (*axpy_i8)(float*, const std::int8_t*, float, std::size_t);
+    const char* f16_name;
+    const char* i8_name;
+};
+
+static LowPrecisionKernels select_low_precision_kernels()
+{
+    LowPrecisionKernels table = { rows_f16_scalar, rows_i8_scalar, axpy_f16_scalar, axpy_i8_scalar,
+                                  "scalar", "scalar" };
+#ifdef SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        table.rows_i8 = rows_i8_avx2;
+        table.axpy_i8 = axpy_i8_avx2;
+        table.i8_name = "avx2";
+        if (__builtin_cpu_supports("f16c")) {
+            table.rows_f16 = rows_f16_avx2;
+            table.axpy_f16 = axpy_f16_avx2;
+            table.f16_name = "avx2+f16c";
+        }
+    }
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("f16c")) {
+        table.rows_f16 = rows_f16_avx512;
+        table.f16_name = "avx512";
+    }
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") &&
+        __builtin_cpu_supports("avx512vnni")) {
+        table.rows_i8 = rows_i8_vnni;
+        table.i8_name = "avx512vnni";
+    }
+#endif
+    return table;
+}
+
+static const LowPrecisionKernels& low_precision_kernels()
+{
+    static const LowPrecisionKernels table = select_low_precision_kernels();
+    return table;
+}
+
+void dot_product_rows_f16(const float* query, const std::uint16_t* rows, std::size_t stride,
+                          std::size_t dim, std::size_t count, float* out)
+{
+    low_precision_kernels().rows_f16(query, rows, stride, dim, count, out);
+}
+
+void dot_product_rows_i8(const std::int8_t* query, const std::int8_t* rows, std::size_t stride,
+                         std::size_t dim, std::size_t count, std::int32_t* out)
+{
+    low_precision_kernels().rows_i8(query, rows, stride, dim, count, out);
+}
+
+void add_scaled_f16(float* acc, const std::uint16_t* x, float w, std::size_t n)
+{
+    low_precision_kernels().axpy_f16(acc, x, w, n);
+}
+
+void add_scaled_i8(float* acc, const std::int8_t* x, float w, std::size_t n)
+{
+    low_precision_kernels().axpy_i8(acc, x, w, n);
+}
+
+const char* f16_kernel_name()
+{
+    return low_precision_kernels().f16_name;
+}
+
+const char* i8_kernel_name()
+{
+    return low_precision_kernels().i8_name;
+}
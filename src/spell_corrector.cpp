@@ -0,0 +1,159 @@
+#include "spell_corrector.hpp"
+#include "text_processing.hpp"
+#include <algorithm>
+#include <iostream>
+
+std::size_t SpellCorrector::distance_for_length(std::size_t length)
+{
+    if (length <= 3) return 0;
+    if (length <= 7) return 1;
+    return 2;
+}
+
+std::size_t SpellCorrector::edit_distance(std::string_view a, std::string_view b, std::size_t limit)
+{
+    std::size_t n = a.size(), m = b.size();
+    if ((n > m ? n - m : m - n) > limit) return limit + 1;
+
+    //three rows: previous two for adjacent swaps
+    std::vector<std::size_t> prev2(m + 1), prev(m + 1), row(m + 1);
+    for (std::size_t j = 0; j <= m; ++j) prev[j] = j;
+    for (std::size_t i = 1; i <= n; ++i) {
+        row[0] = i;
+        std::size_t row_min = row[0];
+        for (std::size_t j = 1; j <= m; ++j) {
+            std::size_t cost = (a[i - 1] == b[j - 1]) ? 0 : 1;
+            std::size_t d = std::min({ prev[j] + 1, row[j - 1] + 1, prev[j - 1] + cost });
+            if (i > 1 && j > 1 && a[i - 1] == b[j - 2] && a[i - 2] == b[j - 1])
+                d = std::min(d, prev2[j - 2] + 1);
+            row[j] = d;
+            row_min = std::min(row_min, d);
+        }
+        if (row_min > limit) return limit + 1;
+        std::swap(prev2, prev);
+        std::swap(prev, row);
+    }
+    return std::min(prev[m], limit + 1);
+}
+
+//FNV-1a folded to 32 bits
+uint32_t SpellCorrector::hash_key(std::string_view key)
+{
+    uint64_t h = 1469598103934665603ULL;
+    for (unsigned char c : key) {
+        h ^= c;
+        h *= 1099511628211ULL;
+    }
+    return static_cast<uint32_t>(h ^ (h >> 32));
+}
+
+template <typename F>
+void SpellCorrector::for_each_delete(std::string& key, std::size_t distance, std::size_t from, F& f)
+{
+    f(std::string_view(key));
+    if (distance == 0) return;
+    //delete positions only increase, so every delete set is generated once per order
+    for (std::size_t i = from; i < key.size(); ++i) {
+        char c = key[i];
+        key.erase(i, 1);
+        for_each_delete(key, distance - 1, i, f);
+        key.insert(key.begin() + i, c);
+    }
+}
+
+void SpellCorrector::build(const Lexicon& lex, std::size_t distance, std::size_t prefix, std::size_t min_frequency)
+{
+    max_distance = distance;
+    prefix_length = std::max(prefix, distance + 1);
+    arena.clear();
+    offsets.assign(1, 0);
+    freqs.clear();
+    deletes.clear();
+
+    std::string key;
+    lex.for_each_word([&](std::string_view w, std::size_t, std::size_t freq) {
+        if (freq < min_frequency) return;
+        uint32_t index = static_cast<uint32_t>(freqs.size());
+        arena += w;
+        offsets.push_back(static_cast<uint32_t>(arena.size()));
+        freqs.push_back(static_cast<uint32_t>(std::min<std::size_t>(freq, UINT32_MAX)));
+
+        key.assign(w.substr(0, prefix_length));
+        auto add = [&](std::string_view d) {
+            deletes.push_back(static_cast<uint64_t>(hash_key(d)) << 32 | index);
+        };
+        for_each_delete(key, max_distance, 0, add);
+    });
+
+    std::sort(deletes.begin(), deletes.end());
+    deletes.erase(std::unique(deletes.begin(), deletes.end()), deletes.end());
+    deletes.shrink_to_fit();
+}
+
+std::size_t SpellCorrector::memory_bytes() const
+{
+    return arena.capacity() + (offsets.capacity() + freqs.capacity()) * sizeof(uint32_t)
+         + deletes.capacity() * sizeof(uint64_t);
+}
+
+std::vector<SpellSuggestion> SpellCorrector::lookup(std::string_view term, std::size_t distance) const
+{
+    std::vector<SpellSuggestion> results;
+    if (deletes.empty() || term.empty()) return results;
+    distance = std::min(distance, max_distance);
+
+    //every word sharing a delete with the term prefix is a candidate
+    std::vector<uint32_t> candidates;
+    std::string key(term.substr(0, prefix_length));
+    auto probe = [&](std::string_view d) {
+        uint64_t h = static_cast<uint64_t>(hash_key(d)) << 32;
+        auto it = std::lower_bound(deletes.begin(), deletes.end(), h);
+        for (; it != deletes.end() && (*it & 0xffffffff00000000ULL) == h; ++it) {
+            candidates.push_back(static_cast<uint32_t>(*it));
+        }
+    };
+    for_each_delete(key, distance, 0, probe);
+
+    std::sort(candidates.begin(), candidates.end());
+    candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+
+    for (uint32_t index : candidates) {
+        std::string_view w = word(index);
+        std::size_t d = edit_distance(term, w, distance);
+        if (d <= distance) results.push_back({ std::string(w), d, freqs[index] });
+    }
+    std::sort(results.begin(), results.end(), [](const SpellSuggestion& a, const SpellSuggestion& b) {
+        if (a.distance != b.distance) return a.distance < b.distance;
+        if (a.frequency != b.frequency) return a.frequency > b.frequency;
+        return a.word < b.word;
+    });
+    return results;
+}
+
+std::string SpellCorrector::correct(std::string_view term, const Lexicon& lex) const
+{
+    if (lex.present_in(term)) return std::string(term);
+
+    auto candidates = lookup(term, distance_for_length(term.size()));
+    if (candidates.empty()) return std::string();
+    return candidates.front().word;
+}
+
+std::string SpellCorrector::correct_query(const std::string& raw_query, const Lexicon& lex) const
+{
+    std::string corrected;
+    bool changed = false;
+    for_each_token(raw_query, [&](std::string_view token) {
+        std::string term(token);
+        if (!lex.present_in(token)) {
+            std::string replacement = correct(token, lex);
+            if (!replacement.empty()) {
+                term = replacement;
+                changed = true;
+            }
+        }
+        if (!corrected.empty()) corrected += ' ';
+        corrected += term;
+    });
+    return changed ? corrected : raw_query;
+}
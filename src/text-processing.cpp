@@ -1,10 +1,11 @@
 #include "text_processing.hpp"
-#include "lemmatizer.hpp"
-#include <unordered_set>
-#include <sstream>
+#include <array>
+#include <cstdint>
+
+namespace {
 
 //Some common words which dont have are not to be stored in lexicon
-std::unordered_set<std::string> common_words = {
+constexpr std::string_view common_words[] = {
     "a", "about", "above", "after", "again", "against", "all", "am", "an",
     "and", "any", "are", "aren't", "as", "at", "be", "because", "been",
     "before", "being", "below", "between", "both", "but", "by", "can't",
@@ -27,31 +28,57 @@ std::unordered_set<std::string> common_words = {
     "with", "won't", "would", "wouldn't", "you", "you'd", "you'll", "you're",
     "you've", "your", "yours", "yourself", "yourselves", "one", "two", "using", "also", "can","however", "may"};
 
+constexpr uint32_t word_hash(std::string_view word) {
+    uint32_t hash = 2166136261u;
+    for (char ch : word) {
+        hash ^= static_cast<unsigned char>(ch);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+//common words in an open addressing table filled at compile time (load factor < 0.5)
+constexpr size_t STOPWORD_SLOTS = 512;
+static_assert(sizeof(common_words) / sizeof(common_words[0]) * 2 < STOPWORD_SLOTS, "stopword table too small");
+
+struct StopwordTable {
+    std::array<std::string_view, STOPWORD_SLOTS> slots{};
+    size_t max_length = 0;
+};
+
+constexpr StopwordTable build_stopword_table() {
+    StopwordTable table{};
+    for (std::string_view word : common_words) {
+        size_t i = word_hash(word) & (STOPWORD_SLOTS - 1);
+        while (!table.slots[i].empty()) i = (i + 1) & (STOPWORD_SLOTS - 1);
+        table.slots[i] = word;
+        if (word.size() > table.max_length) table.max_length = word.size();
+    }
+    return table;
+}
+
+constexpr StopwordTable stopwords = build_stopword_table();
 
+}
+
+bool is_stopword(std::string_view word)
+{
+    if (word.size() > stopwords.max_length) return false;
+
+    size_t i = word_hash(word) & (STOPWORD_SLOTS - 1);
+    while (!stopwords.slots[i].empty()) {
+        if (stopwords.slots[i] == word) return true;
+        i = (i + 1) & (STOPWORD_SLOTS - 1);
+    }
+    return false;
+}
 
 // Basic tokenizer: lowercase, remove special chars, split, remove common words
 std::vector<std::string> tokenize_text(const std::string& text)
 {
-    std::string clean;
-    clean.reserve(text.size());
-
-    //keep letters and spaces only
-    for (char ch : text) {
-        if (std::isalpha(static_cast<unsigned char>(ch))) {   // C++ check for alphabet
-            clean += static_cast<char>(std::tolower(static_cast<unsigned char>(ch)));
-        } else {
-            clean += ' ';  // normalize everything else to space
-        }
-    }
-    //splitting using stringstream
-    std::stringstream ss(clean);
-    std::string word;
     std::vector<std::string> tokens;
-
-    while (ss >> word) {
-        if (word.size() < 3) continue;              //filter tiny words
-        if (common_words.count(word)) continue;      //filter common words
-        tokens.push_back(lemmatize(word));
-    }
+    for_each_token(text, [&tokens](std::string_view token) {
+        tokens.emplace_back(token);
+    });
     return tokens;
-}
\ No newline at end of file
+}
@@ -0,0 +1,357 @@
+#include "word_embeddings.hpp"
+#include "simd_kernels.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <numeric>
+
+namespace {
+
+const char MAGIC[4] = {'W', 'E', 'M', 'B'};
+
+//FNV-1a, fixed so the table layout does not depend on the standard library
+uint64_t hash_word(std::string_view word)
+{
+    uint64_t h = 1469598103934665603ULL;
+    for (unsigned char c : word) {
+        h ^= c;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+std::size_t padded_stride(std::size_t dim)
+{
+    const std::size_t floats_per_line = AlignedAllocator<float>::ALIGNMENT / sizeof(float);
+    return (dim + floats_per_line - 1) / floats_per_line * floats_per_line;
+}
+
+}
+
+void WordEmbeddings::clear()
+{
+    pending_words = std::vector<std::string>();
+    pending_rows = std::vector<float, AlignedAllocator<float>>();
+    owned_arena = std::string();
+    owned_offsets = std::vector<uint32_t>();
+    owned_slots = std::vector<uint32_t>();
+    owned_matrix = std::vector<float, AlignedAllocator<float>>();
+    file.close();
+    arena = nullptr;
+    offsets = slots = nullptr;
+    matrix = nullptr;
+    word_count = slot_count = 0;
+    dimension = row_stride = 0;
+}
+
+void WordEmbeddings::reset(std::size_t dim)
+{
+    clear();
+    dimension = dim;
+    row_stride = padded_stride(dim);
+}
+
+void WordEmbeddings::reserve(std::size_t words)
+{
+    pending_words.reserve(words);
+    pending_rows.reserve(words * row_stride);
+}
+
+void WordEmbeddings::add(std::string_view word, const float* values)
+{
+    pending_words.emplace_back(word);
+    pending_rows.insert(pending_rows.end(), values, values + dimension);
+    pending_rows.resize(pending_words.size() * row_stride, 0.0f);
+}
+
+void WordEmbeddings::freeze()
+{
+    //sorted by word; for a word added twice the later vector wins (stable sort, keep the last)
+    std::vector<uint32_t> order(pending_words.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(),
+                     [&](uint32_t a, uint32_t b) { return pending_words[a] < pending_words[b]; });
+    std::vector<uint32_t> unique;
+    unique.reserve(order.size());
+    for (std::size_t i = 0; i < order.size(); ++i) {
+        if (i + 1 < order.size() && pending_words[order[i]] == pending_words[order[i + 1]]) continue;
+        unique.push_back(order[i]);
+    }
+
+    owned_arena.clear();
+    owned_offsets.assign(1, 0);
+    owned_offsets.reserve(unique.size() + 1);
+    for (uint32_t i : unique) {
+        owned_arena += pending_words[i];
+        owned_offsets.push_back(static_cast<uint32_t>(owned_arena.size()));
+    }
+    pending_words = std::vector<std::string>();
+
+    //rows are moved into sorted order in place (the matrix is most of the memory, so no second copy):
+    //row i becomes old row perm[i], the rows of replaced duplicates go last and are cut off
+    std::size_t total = pending_rows.size() / std::max<std::size_t>(row_stride, 1);
+    std::vector<uint32_t> perm = unique;
+    std::vector<bool> kept(total, false);
+    for (uint32_t i : unique) kept[i] = true;
+    for (uint32_t i = 0; i < total; ++i) {
+        if (!kept[i]) perm.push_back(i);
+    }
+    std::vector<bool> placed(total, false);
+    std::vector<float> held(row_stride);
+    auto row_at = [&](std::size_t r) { return pending_rows.data() + r * row_stride; };
+    for (std::size_t start = 0; start < total; ++start) {
+        if (placed[start] || perm[start] == start) continue;
+        std::memcpy(held.data(), row_at(start), row_stride * sizeof(float));
+        std::size_t j = start;
+        while (true) {
+            placed[j] = true;
+            std::size_t from = perm[j];
+            if (from == start) {
+                std::memcpy(row_at(j), held.data(), row_stride * sizeof(float));
+                break;
+            }
+            std::memcpy(row_at(j), row_at(from), row_stride * sizeof(float));
+            j = from;
+        }
+    }
+    pending_rows.resize(unique.size() * row_stride);
+    owned_matrix = std::move(pending_rows);
+    pending_rows = std::vector<float, AlignedAllocator<float>>();
+
+    arena = owned_arena.data();
+    offsets = owned_offsets.data();
+    matrix = owned_matrix.data();
+    word_count = unique.size();
+
+    //at most half full so probe runs stay short
+    slot_count = 16;
+    while (slot_count < word_count * 2) slot_count <<= 1;
+    owned_slots.assign(slot_count, 0);
+    for (std::size_t i = 0; i < word_count; ++i) {
+        std::size_t s = hash_word(word(i)) & (slot_count - 1);
+        while (owned_slots[s] != 0) s = (s + 1) & (slot_count - 1);
+        owned_slots[s] = static_cast<uint32_t>(i + 1);
+    }
+    slots = owned_slots.data();
+}
+
+const float* WordEmbeddings::find(std::string_view w) const
+{
+    if (slot_count == 0) return nullptr;
+    std::size_t mask = slot_count - 1;
+    for (std::size_t s = hash_word(w) & mask;; s = (s + 1) & mask) {
+        uint32_t entry = slots[s];
+        if (entry == 0) return nullptr;
+        if (word(entry - 1) == w) return row(entry - 1);
+    }
+}
+
+std::size_t WordEmbeddings::memory_bytes() const
+{
+    std::size_t bytes = owned_arena.capacity() + owned_matrix.capacity() * sizeof(float) +
+                        (owned_offsets.capacity() + owned_slots.capacity()) * sizeof(uint32_t) +
+                        pending_rows.capacity() * sizeof(float);
+    for (const auto& w : pending_words) bytes += sizeof(std::string) + w.capacity();
+    return bytes;
+}
+
+bool WordEmbeddings::save(const std::string& path) const
+{
+    if (slots == nullptr) {
+        std::cerr << "Error: word embeddings have to be frozen before saving" << std::endl;
+        return false;
+    }
+
+    FileHeader header{};
+    std::memcpy(header.magic, MAGIC, 4);
+    header.version = FILE_VERSION;
+    header.word_count = word_count;
+    header.dim = dimension;
+    header.stride = row_stride;
+    header.slot_count = slot_count;
+    header.arena_bytes = offsets[word_count];
+    std::size_t tables = sizeof(header) + (word_count + 1 + slot_count) * sizeof(uint32_t) + header.arena_bytes;
+    header.matrix_offset = (tables + 63) / 64 * 64;
+
+    std::string tmp_path = path + ".tmp";
+    {
+        std::ofstream out(tmp_path, std::ios::binary);
+        if (!out.is_open()) {
+            std::cerr << "Error: cannot create embedding file " << tmp_path << std::endl;
+            return false;
+        }
+        const char zeros[64] = {};
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(offsets), (word_count + 1) * sizeof(uint32_t));
+        out.write(reinterpret_cast<const char*>(slots), slot_count * sizeof(uint32_t));
+        out.write(arena, header.arena_bytes);
+        out.write(zeros, header.matrix_offset - tables);
+        out.write(reinterpret_cast<const char*>(matrix), word_count * row_stride * sizeof(float));
+        if (!out) {
+            std::cerr << "Error: cannot write embedding file " << tmp_path << std::endl;
+            return false;
+        }
+    }
+
+    return MappedFile::replace(tmp_path, path);
+}
+
+bool WordEmbeddings::is_file(const std::string& path)
+{
+    std::ifstream in(path, std::ios::binary);
+    char magic[4] = {};
+    in.read(magic, 4);
+    return in && std::memcmp(magic, MAGIC, 4) == 0;
+}
+
+//map the file and check the header, word offsets and hash slots against it;
+//nothing is parsed or hashed, the rows are read on first lookup
+bool WordEmbeddings::map_from_file(const std::string& path)
+{
+    clear();
+    if (!file.open(path)) return false;
+
+    const char* base = file.data();
+    FileHeader header;
+    if (file.size() < sizeof(header)) {
+        file.close();
+        return false;
+    }
+    std::memcpy(&header, base, sizeof(header));
+    if (std::memcmp(header.magic, MAGIC, 4) != 0) {
+        file.close();
+        return false;
+    }
+    if (header.version != FILE_VERSION) {
+        std::cerr << "Error: " << path << " is not a version " << FILE_VERSION << " embedding file" << std::endl;
+        file.close();
+        return false;
+    }
+
+    //every size is bounded by the file size before it is multiplied or added, so a corrupt
+    //header cannot overflow the layout arithmetic
+    std::size_t size = file.size();
+    bool slots_ok = header.slot_count > header.word_count && (header.slot_count & (header.slot_count - 1)) == 0 &&
+                    header.slot_count <= size / sizeof(uint32_t);
+    bool layout_ok = slots_ok && header.arena_bytes <= size && header.matrix_offset <= size &&
+                     header.matrix_offset % 64 == 0 && header.stride >= header.dim && header.stride % 16 == 0;
+    if (layout_ok) {
+        std::size_t tables = sizeof(header) + (header.word_count + 1 + header.slot_count) * sizeof(uint32_t) + header.arena_bytes;
+        std::size_t row_bytes = header.stride * sizeof(float);
+        std::size_t matrix_bytes = size - header.matrix_offset;
+        layout_ok = header.matrix_offset >= tables &&
+                    (header.word_count == 0 ? matrix_bytes == 0
+                                            : header.stride > 0 && header.stride <= matrix_bytes / sizeof(float) &&
+                                              matrix_bytes % row_bytes == 0 && matrix_bytes / row_bytes == header.word_count);
+    }
+    if (!layout_ok) {
+        std::cerr << "Error: " << path << " is truncated or corrupt" << std::endl;
+        file.close();
+        return false;
+    }
+
+    offsets = reinterpret_cast<const uint32_t*>(base + sizeof(header));
+    slots = offsets + header.word_count + 1;
+    arena = reinterpret_cast<const char*>(slots + header.slot_count);
+    matrix = reinterpret_cast<const float*>(base + header.matrix_offset);
+    //words and slots are read straight from the mapping: every word must lie inside the arena and
+    //every slot must be empty or name a word, with at least one empty slot to end a probe
+    bool entries_ok = offsets[0] == 0 && offsets[header.word_count] == header.arena_bytes;
+    for (std::size_t i = 0; entries_ok && i < header.word_count; ++i) {
+        entries_ok = offsets[i] <= offsets[i + 1];
+    }
+    std::size_t used_slots = 0;
+    for (std::size_t i = 0; entries_ok && i < header.slot_count; ++i) {
+        if (slots[i] == 0) continue;
+        entries_ok = slots[i] <= header.word_count;
+        ++used_slots;
+    }
+    if (!entries_ok || used_slots > header.word_count) {
+        std::cerr << "Error: " << path << " is truncated or corrupt" << std::endl;
+        clear();
+        return false;
+    }
+
+    word_count = header.word_count;
+    slot_count = header.slot_count;
+    dimension = header.dim;
+    row_stride = header.stride;
+    return true;
+}
+
+void LexiconEmbeddings::clear()
+{
+    id_to_row = std::vector<uint32_t>();
+    owned_rows = std::vector<float, AlignedAllocator<float>>();
+    quantized_rows.clear();
+    mode = VectorPrecision::Float32;
+    base = nullptr;
+    dimension = row_stride = 0;
+    row_count = 0;
+}
+
+void LexiconEmbeddings::build(const WordEmbeddings& words, const Lexicon& lex, bool copy,
+                              VectorPrecision precision)
+{
+    clear();
+    mode = precision;
+    dimension = words.dim();
+    row_stride = words.stride();
+
+    //one string lookup per lexicon word, here and never again
+    std::size_t max_id = 0;
+    std::vector<std::pair<std::size_t, const float*>> found;
+    lex.for_each_word([&](std::string_view word, std::size_t id, std::size_t) {
+        max_id = std::max(max_id, id + 1);
+        if (const float* row = words.find(word)) found.emplace_back(id, row);
+    });
+    id_to_row.assign(max_id, MISSING);
+    row_count = found.size();
+
+    if (precision != VectorPrecision::Float32) {
+        std::sort(found.begin(), found.end());
+        quantized_rows.reset(dimension, precision);
+        quantized_rows.reserve(row_count);
+        for (const auto& [id, row] : found) {
+            id_to_row[id] = static_cast<uint32_t>(quantized_rows.add_row(id, row));
+        }
+    } else if (copy) {
+        std::sort(found.begin(), found.end());  //rows in word_id order
+        owned_rows.resize(row_count * row_stride);
+        for (std::size_t r = 0; r < row_count; ++r) {
+            std::memcpy(owned_rows.data() + r * row_stride, found[r].second, row_stride * sizeof(float));
+            id_to_row[found[r].first] = static_cast<uint32_t>(r);
+        }
+        base = owned_rows.data();
+    } else {
+        //rows of the word table: row r starts at words.row(0) + r * stride
+        base = words.empty() ? nullptr : words.row(0);
+        for (const auto& [id, row] : found) {
+            id_to_row[id] = static_cast<uint32_t>((row - base) / row_stride);
+        }
+    }
+}
+
+bool LexiconEmbeddings::add_to(std::size_t word_id, float* acc, float weight) const
+{
+    if (!contains(word_id)) return false;
+    if (mode == VectorPrecision::Float32) {
+        add_scaled(acc, float_row(word_id), weight, dimension);
+    } else {
+        quantized_rows.add_row_to(id_to_row[word_id], acc, weight);
+    }
+    return true;
+}
+
+bool LexiconEmbeddings::decode(std::size_t word_id, float* out) const
+{
+    if (!contains(word_id)) return false;
+    if (mode == VectorPrecision::Float32) {
+        std::memcpy(out, float_row(word_id), dimension * sizeof(float));
+    } else {
+        quantized_rows.decode_row(id_to_row[word_id], out);
+    }
+    return true;
+}
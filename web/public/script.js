@@ -32,6 +32,11 @@ async function performSearch(query) {
             document.getElementById("searchTime").innerText = 
                 `About ${resultsCount} results`;
         }
+        // the server searched a spelling-corrected query
+        if (data.corrected_query) {
+            document.getElementById("searchTime").innerText +=
+                ` - showing results for "${data.corrected_query}"`;
+        }
 
         loadingDiv.classList.add('hidden');
 
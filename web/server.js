@@ -27,7 +27,12 @@ if (!fs.existsSync(CPP_SERVER)) {
 // Start the C++ server process
 let cppProcess = null;
 let isReady = false;
-let pendingRequests = [];
+// Commands waiting for the server to finish loading
+let queuedCommands = [];
+// Commands sent to the C++ server, by request id. Commands carry an id ("#7 SEARCH ...")
+// so several can be in flight at once; the responses come back tagged, in any order
+const inFlight = new Map();
+let nextRequestId = 1;
 
 function startCppServer() {
     console.log(' Starting C++ search server...');
@@ -52,17 +57,19 @@ function startCppServer() {
                 if (response.status === 'ready') {
                     isReady = true;
                     console.log('⚡ C++ server is ready!');
-                    while (pendingRequests.length > 0) {
-                        const req = pendingRequests.shift();
-                        req.process();
+                    while (queuedCommands.length > 0) {
+                        queuedCommands.shift()();
                     }
                     return;
                 }
 
-                // Normal JSON response
-                if (pendingRequests.length > 0) {
-                    const req = pendingRequests.shift();
-                    req.resolve(response);
+                // Tagged response
+                const request = inFlight.get(response.id);
+                if (request) {
+                    inFlight.delete(response.id);
+                    clearTimeout(request.timer);
+                    delete response.id;
+                    request.resolve(response);
                 }
             } catch (err) {
                 console.error("❌ Invalid JSON:", line);
@@ -87,10 +94,11 @@ function startCppServer() {
         isReady = false;
         
         // Reject all pending requests
-        while (pendingRequests.length > 0) {
-            const req = pendingRequests.shift();
-            req.reject(new Error('C++ server crashed'));
+        for (const request of inFlight.values()) {
+            clearTimeout(request.timer);
+            request.reject(new Error('C++ server crashed'));
         }
+        inFlight.clear();
     });
 
     cppProcess.on('error', (err) => {
@@ -104,30 +112,24 @@ function sendCommand(command, query) {
     return new Promise((resolve, reject) => {
         if (!isReady) {
             // Queue the request until server is ready
-            pendingRequests.push({
-                process: () => sendCommand(command, query).then(resolve).catch(reject),
-                resolve,
-                reject
-            });
+            queuedCommands.push(() => sendCommand(command, query).then(resolve).catch(reject));
             return;
         }
 
-        const requestId = pendingRequests.length;
-        pendingRequests.push({ resolve, reject, requestId });
-        
-        const commandLine = `${command} ${query}\n`;
-        console.log('Sending to C++:', commandLine.trim());
-        
-        cppProcess.stdin.write(commandLine);
-        
+        const requestId = String(nextRequestId++);
         // Set timeout
-        setTimeout(() => {
-            const idx = pendingRequests.findIndex(r => r.requestId === requestId);
-            if (idx !== -1) {
-                pendingRequests.splice(idx, 1);
+        const timer = setTimeout(() => {
+            if (inFlight.delete(requestId)) {
                 reject(new Error('Request timeout'));
             }
         }, 30000); // 30 second timeout
+        inFlight.set(requestId, { resolve, reject, timer });
+
+        // a newline inside the query would end the command early
+        const commandLine = `#${requestId} ${command} ${query.replace(/[\r\n\t]/g, ' ')}\n`;
+        console.log('Sending to C++:', commandLine.trim());
+        
+        cppProcess.stdin.write(commandLine);
     });
 }
 
@@ -173,11 +175,20 @@ app.get('/api/autocomplete', async (req, res) => {
     }
 });
 
+// Result cache counters of the C++ server
+app.get('/api/stats', async (req, res) => {
+    try {
+        res.json(await sendCommand('STATS', ''));
+    } catch (err) {
+        res.status(500).json({ error: err.message });
+    }
+});
+
 // Health check endpoint
 app.get('/api/health', (req, res) => {
     res.json({ 
         status: isReady ? 'ready' : 'loading',
-        pendingRequests: pendingRequests.length
+        pendingRequests: inFlight.size + queuedCommands.length
     });
 });
 